@@ -0,0 +1,13 @@
+#include "AdcReader.hpp"
+
+Adc1Reader::Adc1Reader() {
+	adc1_config_width(ADC_WIDTH_12Bit);
+}
+
+void Adc1Reader::configure(adc1_channel_t channel) {
+	adc1_config_channel_atten(channel, ADC_ATTEN_11db);
+}
+
+int Adc1Reader::read(adc1_channel_t channel) {
+	return adc1_get_voltage(channel);
+}
@@ -0,0 +1,27 @@
+#ifndef ADCREADER_H_
+#define ADCREADER_H_
+
+#include "driver/adc.h"
+
+/**
+ * Source of raw ADC1 readings.  The sampler only talks to this interface
+ * so the hardware can be replaced by a fake when running off-device.
+ */
+class AdcReader {
+	public:
+	virtual void configure(adc1_channel_t) = 0;
+	virtual int read(adc1_channel_t) = 0;
+	virtual ~AdcReader() {}
+};
+
+/**
+ * ESP32 ADC1, 12 bit width with 11db attenuation (0 - 3.3V).
+ */
+class Adc1Reader : public AdcReader {
+	public:
+	Adc1Reader();
+	virtual void configure(adc1_channel_t);
+	virtual int read(adc1_channel_t);
+};
+
+#endif
@@ -0,0 +1,172 @@
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "Alarms.hpp"
+
+Alarms::Alarms() {
+	clearLimits(&limits);
+	for (int i = 0; i < MAX_PROBES; i++) {
+		state[i] = ALARM_OK;
+	}
+}
+
+void Alarms::clearLimits(alarm_limits_t* l) {
+	for (int i = 0; i < MAX_PROBES; i++) {
+		l->lower[i] = NAN;
+		l->upper[i] = NAN;
+		l->name[i][0] = 0;
+	}
+}
+
+static const char* skipSpace(const char* p, const char* end) {
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+		p++;
+	}
+	return p;
+}
+
+/**
+ * Read a JSON array of numbers, e.g. "[0, 52.5, null]", into out; null
+ * gives NAN.  Returns the number of elements, of which the first max are
+ * stored, or -1 if it is not such an array.
+ */
+int Alarms::parseNumbers(const char* json, size_t len, float* out, int max) {
+	const char* end = json + len;
+	const char* p = skipSpace(json, end);
+	if (p == end || *p++ != '[') {
+		return -1;
+	}
+	int n = 0;
+	p = skipSpace(p, end);
+	if (p < end && *p == ']') {
+		return 0;
+	}
+	while (p < end) {
+		float v;
+		if (end - p >= 4 && strncmp(p, "null", 4) == 0) {
+			v = NAN;
+			p += 4;
+		} else {
+			char num[24];
+			size_t k = 0;
+			while (p < end && k < sizeof(num) - 1 && (strchr("+-.eE", *p) || (*p >= '0' && *p <= '9'))) {
+				num[k++] = *p++;
+			}
+			num[k] = 0;
+			char* stop;
+			v = strtof(num, &stop);
+			if (k == 0 || *stop != 0) {
+				return -1;
+			}
+		}
+		if (n < max) {
+			out[n] = v;
+		}
+		n++;
+		p = skipSpace(p, end);
+		if (p < end && *p == ',') {
+			p = skipSpace(p + 1, end);
+		} else if (p < end && *p == ']') {
+			return n;
+		} else {
+			return -1;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Read a JSON array of strings into out, truncated to ALARM_NAME_SIZE - 1.
+ * A backslash keeps the next character as is; \u escapes are not decoded.
+ * Returns as parseNumbers().
+ */
+int Alarms::parseNames(const char* json, size_t len, char (*out)[ALARM_NAME_SIZE], int max) {
+	const char* end = json + len;
+	const char* p = skipSpace(json, end);
+	if (p == end || *p++ != '[') {
+		return -1;
+	}
+	int n = 0;
+	p = skipSpace(p, end);
+	if (p < end && *p == ']') {
+		return 0;
+	}
+	while (p < end && *p == '"') {
+		p++;
+		size_t k = 0;
+		while (p < end && *p != '"') {
+			if (*p == '\\' && p + 1 < end) {
+				p++;
+			}
+			if (n < max && k < ALARM_NAME_SIZE - 1) {
+				out[n][k++] = *p;
+			}
+			p++;
+		}
+		if (p == end) {
+			return -1;
+		}
+		if (n < max) {
+			out[n][k] = 0;
+		}
+		n++;
+		p = skipSpace(p + 1, end);
+		if (p < end && *p == ',') {
+			p = skipSpace(p + 1, end);
+		} else if (p < end && *p == ']') {
+			return n;
+		} else {
+			return -1;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Take new limits.  Alarms on a limit that was removed clear at the next
+ * check; the others carry on.
+ */
+void Alarms::setLimits(const alarm_limits_t* l) {
+	limits = *l;
+}
+
+/**
+ * Evaluate a sweep against the limits.  Returns a bit per probe whose
+ * alarm state changed, for the caller to report.
+ */
+uint32_t Alarms::check(const probe_sweep_t* sweep) {
+	uint32_t changed = 0;
+	for (int i = 0; i < sweep->count && i < MAX_PROBES; i++) {
+		float t = sweep->temp[i];
+		float lower = limits.lower[i];
+		float upper = limits.upper[i];
+		alarm_state_t next = state[i];
+		switch (state[i]) {
+		case ALARM_LOW:
+			if (isnan(lower) || t > lower + ALARM_HYSTERESIS) {
+				next = ALARM_OK;
+			}
+			break;
+		case ALARM_HIGH:
+			if (isnan(upper) || t < upper - ALARM_HYSTERESIS) {
+				next = ALARM_OK;
+			}
+			break;
+		default:
+			break;
+		}
+		if (next == ALARM_OK) {
+			if (t < lower) {
+				next = ALARM_LOW;
+			} else if (t > upper) {
+				next = ALARM_HIGH;
+			}
+		}
+		if (next != state[i]) {
+			state[i] = next;
+			changed |= 1u << i;
+		}
+	}
+	return changed;
+}
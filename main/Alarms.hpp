@@ -0,0 +1,52 @@
+#ifndef ALARMS_H_
+#define ALARMS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ProbeSampler.hpp"
+
+#define ALARM_NAME_SIZE 16
+#define ALARM_HYSTERESIS 1.0f	// degC back inside a limit to clear
+
+typedef enum {
+	ALARM_OK,
+	ALARM_LOW,
+	ALARM_HIGH
+} alarm_state_t;
+
+/**
+ * Per probe limits and names, the shadow's tl, tu and td arrays.  A
+ * missing limit is NAN.
+ */
+typedef struct {
+	float lower[MAX_PROBES];
+	float upper[MAX_PROBES];
+	char name[MAX_PROBES][ALARM_NAME_SIZE];
+} alarm_limits_t;
+
+/**
+ * Temperature alarms checked on the device against limits pushed from the
+ * shadow, so an alert goes out with the sweep that crossed the limit
+ * instead of waiting for the cloud to notice.  An alarm clears once the
+ * probe is ALARM_HYSTERESIS back inside the limit.
+ *
+ * The parse functions read the JSON arrays of a shadow delta in place;
+ * nothing here allocates.  No ESP-IDF dependencies.
+ */
+class Alarms {
+	alarm_limits_t limits;
+	alarm_state_t state[MAX_PROBES];
+
+	public:
+	Alarms();
+	static void clearLimits(alarm_limits_t*);
+	static int parseNumbers(const char* json, size_t len, float* out, int max);
+	static int parseNames(const char* json, size_t len, char (*out)[ALARM_NAME_SIZE], int max);
+	void setLimits(const alarm_limits_t*);
+	const alarm_limits_t* getLimits() { return &limits; }
+	uint32_t check(const probe_sweep_t*);
+	alarm_state_t getState(int probe) { return state[probe]; }
+};
+
+#endif
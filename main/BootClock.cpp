@@ -0,0 +1,78 @@
+#include "esp_log.h"
+
+#include "BootClock.hpp"
+
+static const char* TAG = "boot";
+
+// Only used by ESP_LOGD, which may compile to nothing.
+static const char* PHASE_NAMES[BOOT_PHASES] __attribute__((unused)) = {
+	"app_main", "nvs", "wifi", "sntp", "mqtt", "publish"
+};
+
+uint32_t BootClock::phaseMs[BOOT_PHASES];
+time_t BootClock::offset = 0;
+bool BootClock::reported = false;
+
+/**
+ * Wall clock time once set, seconds since boot before that.
+ */
+time_t BootClock::now() {
+	return synced() ? time(NULL) : (time_t)(esp_log_timestamp() / 1000);
+}
+
+/**
+ * Whether the wall clock has been set.  The first call that sees it set
+ * fixes the boot offset used by toWall().
+ */
+bool BootClock::synced() {
+	if (offset != 0) {
+		return true;
+	}
+	time_t t = time(NULL);
+	if (t < BOOT_CLOCK_VALID) {
+		return false;
+	}
+	offset = t - (time_t)(esp_log_timestamp() / 1000);
+	mark(BOOT_SNTP);
+	return true;
+}
+
+/**
+ * Turn a now() value taken before the clock was set into wall clock time.
+ * Wall clock stamps, and any stamp while the clock is still unset, are
+ * returned as they are.
+ */
+time_t BootClock::toWall(time_t stamp) {
+	if (stamp >= BOOT_CLOCK_VALID || !synced()) {
+		return stamp;
+	}
+	return stamp + offset;
+}
+
+/**
+ * Record the first time a phase completes.
+ */
+void BootClock::mark(boot_phase_t phase) {
+	if (phaseMs[phase] == 0) {
+		phaseMs[phase] = esp_log_timestamp();
+		ESP_LOGD(TAG, "%s at %u ms", PHASE_NAMES[phase], phaseMs[phase]);
+	}
+}
+
+/**
+ * Log the boot timeline, once, when every phase has completed.
+ */
+void BootClock::report() {
+	if (reported) {
+		return;
+	}
+	for (int i = 0; i < BOOT_PHASES; i++) {
+		if (phaseMs[i] == 0) {
+			return;
+		}
+	}
+	reported = true;
+	ESP_LOGI(TAG, "Boot: app_main %u, nvs %u, wifi %u, sntp %u, mqtt %u, first publish %u ms",
+		phaseMs[BOOT_APP_MAIN], phaseMs[BOOT_NVS], phaseMs[BOOT_WIFI],
+		phaseMs[BOOT_SNTP], phaseMs[BOOT_MQTT], phaseMs[BOOT_PUBLISH]);
+}
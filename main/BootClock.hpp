@@ -0,0 +1,40 @@
+#ifndef BOOTCLOCK_H_
+#define BOOTCLOCK_H_
+
+#include <stdint.h>
+#include <time.h>
+
+// The wall clock counts as set once it is past this (July 2017).
+#define BOOT_CLOCK_VALID 1500000000
+
+typedef enum {
+	BOOT_APP_MAIN,	// app_main entered
+	BOOT_NVS,		// NVS ready, WiFi starting
+	BOOT_WIFI,		// station has an IP address
+	BOOT_SNTP,		// wall clock set
+	BOOT_MQTT,		// shadow connection open
+	BOOT_PUBLISH,	// first shadow update acked
+	BOOT_PHASES
+} boot_phase_t;
+
+/**
+ * Boot time bookkeeping.  SNTP runs in the background while the device
+ * connects and samples, so sweeps taken before the wall clock is set are
+ * stamped with seconds since boot and back-stamped by toWall() once it
+ * is.  mark() records when each boot phase completed (ms since reset) and
+ * report() logs them once all are done.
+ */
+class BootClock {
+	static uint32_t phaseMs[BOOT_PHASES];
+	static time_t offset;
+	static bool reported;
+
+	public:
+	static time_t now();
+	static bool synced();
+	static time_t toWall(time_t stamp);
+	static void mark(boot_phase_t phase);
+	static void report();
+};
+
+#endif
@@ -0,0 +1,126 @@
+#include <math.h>
+
+#include "CookEstimator.hpp"
+
+#define P_INIT 1000.0f
+#define P_MAX 10000.0f		// bounds covariance windup while nothing changes
+#define OUTLIER_SIGMAS 5.0f
+#define ERR_FLOOR 0.01f		// (degC/min)^2, so a perfect fit still takes slopes
+
+// Temperatures enter the fit in hundreds of degC to keep it well scaled
+// in single precision.
+#define T_SCALE 0.01f
+
+CookEstimator::CookEstimator(uint32_t strideS, uint32_t memoryS) :
+	strideS(strideS), lambda(1.0f - (float) strideS / memoryS) {
+	reset();
+}
+
+void CookEstimator::reset() {
+	theta[0] = theta[1] = 0;
+	P[0][0] = P[1][1] = P_INIT;
+	P[0][1] = P[1][0] = 0;
+	errVar = 1.0f;
+	fits = 0;
+	rejected = 0;
+	lastTs = 0;
+	lastT = 0;
+	slope = 0;
+	started = false;
+}
+
+/**
+ * One RLS step for y = a + b x.
+ */
+void CookEstimator::fit(float x, float y) {
+	float err = y - (theta[0] + theta[1] * x);
+	if (fits >= ESTIMATOR_MIN_FITS && err * err > OUTLIER_SIGMAS * OUTLIER_SIGMAS * errVar) {
+		rejected++;
+		return;
+	}
+	float p0 = P[0][0] + P[0][1] * x;		// P phi
+	float p1 = P[1][0] + P[1][1] * x;
+	float denom = lambda + p0 + p1 * x;
+	float k0 = p0 / denom;
+	float k1 = p1 / denom;
+	theta[0] += k0 * err;
+	theta[1] += k1 * err;
+	P[0][0] = (P[0][0] - k0 * p0) / lambda;
+	P[0][1] = (P[0][1] - k0 * p1) / lambda;
+	P[1][0] = P[0][1];
+	P[1][1] = (P[1][1] - k1 * p1) / lambda;
+	float trace = P[0][0] + P[1][1];
+	if (trace > P_MAX) {
+		float s = P_MAX / trace;
+		P[0][0] *= s;
+		P[0][1] *= s;
+		P[1][0] *= s;
+		P[1][1] *= s;
+	}
+	errVar = lambda * errVar + (1 - lambda) * err * err;
+	if (errVar < ERR_FLOOR) {
+		errVar = ERR_FLOOR;
+	}
+	fits++;
+}
+
+/**
+ * Take a sweep's temperature, ts in seconds.
+ */
+void CookEstimator::update(uint32_t ts, float t) {
+	if (isnan(t)) {
+		return;
+	}
+	if (!started || ts < lastTs || ts - lastTs > 4 * strideS) {
+		started = true;
+		lastTs = ts;
+		lastT = t;
+		return;
+	}
+	float dt = (float) (ts - lastTs);
+	if (dt < strideS) {
+		return;
+	}
+	slope = (t - lastT) * 60 / dt;
+	fit((t + lastT) * 0.5f * T_SCALE, slope);
+	lastTs = ts;
+	lastT = t;
+}
+
+/**
+ * The temperature the fit is heading for, NAN if there is none yet.
+ */
+float CookEstimator::ambient() {
+	if (fits < ESTIMATOR_MIN_FITS || theta[1] >= 0) {
+		return NAN;
+	}
+	return -theta[0] / theta[1] / T_SCALE;
+}
+
+/**
+ * Seconds until the probe, now at t, reaches target: 0 once there, NAN
+ * if unknown.
+ */
+float CookEstimator::eta(float t, float target) {
+	if (isnan(target) || isnan(t) || fits < ESTIMATOR_MIN_FITS) {
+		return NAN;
+	}
+	if (t >= target) {
+		return 0;
+	}
+	float k = -theta[1] * T_SCALE;		// 1/min
+	float ta = ambient();
+	float minutes = NAN;
+	if (k > 0 && !isnan(ta) && ta > target) {
+		minutes = logf((ta - t) / (ta - target)) / k;
+	} else {
+		float trend = theta[0] + theta[1] * t * T_SCALE;
+		if (trend > 0) {
+			minutes = (target - t) / trend;
+		}
+	}
+	if (!(minutes * 60 <= ESTIMATOR_MAX_ETA_S)) {
+		return NAN;
+	}
+	return minutes * 60;
+}
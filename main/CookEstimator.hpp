@@ -0,0 +1,59 @@
+#ifndef COOKESTIMATOR_H_
+#define COOKESTIMATOR_H_
+
+#include <stdint.h>
+
+#define ESTIMATOR_MIN_FITS 6			// slopes fitted before an estimate
+#define ESTIMATOR_MAX_ETA_S (24 * 3600)	// longer is reported as unknown
+
+/**
+ * Time until a probe reaches a target temperature, fitted on the device
+ * as it cooks.
+ *
+ * Meat in a pit heats roughly by Newton's law, dT/dt = k (Ta - T), which
+ * is linear in T: dT/dt = a + b T.  Every strideS seconds the slope over
+ * the stride is fed with the mean temperature to a two parameter
+ * recursive least squares fit with exponential forgetting, so the fit
+ * follows a pit that changes temperature or a stall over about memoryS.
+ * From a and b, k = -b and Ta = -a / b, and
+ *
+ *   eta = ln((Ta - T) / (Ta - target)) / k
+ *
+ * When the fit says the target is out of reach (Ta below it, or k not
+ * positive) the fitted slope at T is extrapolated instead, if it is
+ * rising.  Nothing here predicts the end of a stall: while a brisket
+ * stalls the estimate stretches to the stall's pace, and comes back once
+ * the fit has forgotten it.
+ *
+ * Slopes far outside the fit's recent error, a lid opening say, are not
+ * fitted.  A gap of over four strides, e.g. the clock being set, restarts
+ * the stride without a slope.  Each update is O(1) in time and memory.
+ * No ESP-IDF dependencies.
+ */
+class CookEstimator {
+	float strideS;
+	float lambda;		// forgetting factor per stride
+	float theta[2];		// a (degC/min), b (1/min per 100 degC)
+	float P[2][2];
+	float errVar;		// running mean square of the fit error
+	uint32_t fits;
+	uint32_t rejected;
+	uint32_t lastTs;
+	float lastT;
+	float slope;		// degC/min over the last stride
+	bool started;
+
+	void fit(float x, float y);
+
+	public:
+	CookEstimator(uint32_t strideS, uint32_t memoryS);
+	void reset();
+	void update(uint32_t ts, float t);
+	float eta(float t, float target);
+	float rate() { return slope; }
+	float ambient();
+	uint32_t getFits() { return fits; }
+	uint32_t getRejected() { return rejected; }
+};
+
+#endif
@@ -0,0 +1,62 @@
+#include <string.h>
+
+#include "DutyCycle.hpp"
+
+static const uint32_t DUTY_CYCLE_MAGIC = 0x44435931;	// "DCY1"
+
+DutyCycle::DutyCycle(duty_cycle_state_t* state, float delta, uint32_t maxSilentMs) :
+	state(state), delta(delta), maxSilentMs(maxSilentMs), warm(false) {
+}
+
+/**
+ * Pick up the state left by the previous wake.  Returns false, and starts
+ * from scratch, after a power cycle or a firmware change of the layout.
+ */
+bool DutyCycle::resume() {
+	warm = state->magic == DUTY_CYCLE_MAGIC && state->count >= 0 && state->count <= DUTY_CYCLE_MAX_PROBES;
+	if (!warm) {
+		memset(state, 0, sizeof(*state));
+		state->magic = DUTY_CYCLE_MAGIC;
+	}
+	state->wakes++;
+	return warm;
+}
+
+/**
+ * Whether this wake's sweep has to be published: nothing was published
+ * yet, the probe set changed, a probe moved by more than delta, or the
+ * silence interval ran out.
+ */
+bool DutyCycle::due(const float* temp, int count) {
+	if (state->publishes == 0 || count != state->count || state->silentMs >= maxSilentMs) {
+		return true;
+	}
+	for (int i = 0; i < count; i++) {
+		float d = temp[i] - state->lastTemp[i];
+		if (d > delta || d < -delta) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Record the values that reached the server; later wakes compare to them.
+ */
+void DutyCycle::published(const float* temp, int count) {
+	if (count > DUTY_CYCLE_MAX_PROBES) {
+		count = DUTY_CYCLE_MAX_PROBES;
+	}
+	memcpy(state->lastTemp, temp, count * sizeof(float));
+	state->count = count;
+	state->silentMs = 0;
+	state->publishes++;
+}
+
+/**
+ * Account for this wake before going to sleep for sleepMs.
+ */
+void DutyCycle::sleeping(uint32_t awakeMs, uint32_t sleepMs) {
+	state->awakeMs += awakeMs;
+	state->silentMs += awakeMs + sleepMs;
+}
@@ -0,0 +1,47 @@
+#ifndef DUTYCYCLE_H_
+#define DUTYCYCLE_H_
+
+#include <stdint.h>
+
+#define DUTY_CYCLE_MAX_PROBES 4
+
+/**
+ * State carried from one deep sleep wake to the next.  Lives in RTC slow
+ * memory (RTC_DATA_ATTR), which keeps its contents through deep sleep but
+ * not through a power cycle; the magic word tells the two apart.
+ */
+typedef struct {
+	uint32_t magic;
+	uint32_t wakes;
+	uint32_t publishes;
+	uint32_t silentMs;	// since the last publish
+	uint32_t awakeMs;	// total time spent awake
+	int count;
+	float lastTemp[DUTY_CYCLE_MAX_PROBES];
+} duty_cycle_state_t;
+
+/**
+ * Deep sleep duty cycle decision: on each timer wake the probes are read
+ * and the network is only brought up when a probe moved more than delta
+ * from the last published value, or nothing was published for maxSilentMs.
+ *
+ * No ESP-IDF dependencies, so the same logic runs in the host simulator
+ * (tools/duty_cycle_sim.cpp).
+ */
+class DutyCycle {
+	duty_cycle_state_t* state;
+	float delta;
+	uint32_t maxSilentMs;
+	bool warm;
+
+	public:
+	DutyCycle(duty_cycle_state_t* state, float delta, uint32_t maxSilentMs);
+	bool resume();
+	bool resumed() { return warm; }
+	bool due(const float* temp, int count);
+	void published(const float* temp, int count);
+	void sleeping(uint32_t awakeMs, uint32_t sleepMs);
+	const duty_cycle_state_t* getState() { return state; }
+};
+
+#endif
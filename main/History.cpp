@@ -0,0 +1,421 @@
+#include <string.h>
+#include <math.h>
+
+#include "History.hpp"
+#include "Varint.hpp"
+
+#define CHECKPOINT_MAGIC 0x54534948 // "HIST"
+#define CHECKPOINT_SLOTS 2
+
+typedef struct {
+	uint32_t magic;
+	uint32_t seq;
+	uint32_t size;
+	uint32_t crc;
+} checkpoint_header_t;
+
+static const uint32_t ROLLUP_PERIOD[2] = { 60, 600 };
+
+static const size_t SLOT_SIZE =
+	(sizeof(checkpoint_header_t) + sizeof(history_state_t) + LOG_SEGMENT_SIZE - 1) / LOG_SEGMENT_SIZE * LOG_SEGMENT_SIZE;
+
+// CRC-32 (IEEE), bitwise; it only runs for a checkpoint.
+static uint32_t crc32(const void* data, size_t len) {
+	const uint8_t* p = (const uint8_t*) data;
+	uint32_t crc = 0xffffffff;
+	while (len--) {
+		crc ^= *p++;
+		for (int i = 0; i < 8; i++) {
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+		}
+	}
+	return ~crc;
+}
+
+static int16_t quantise(float t) {
+	long v = lroundf(t * 10);
+	return (int16_t) (v < INT16_MIN ? INT16_MIN : v > INT16_MAX ? INT16_MAX : v);
+}
+
+static void toPoint(history_point_t* point, uint32_t ts, uint16_t period, uint16_t count, int probes,
+		const int16_t* lo, const int16_t* avg, const int16_t* hi) {
+	point->ts = ts;
+	point->period = period;
+	point->count = count;
+	point->probes = probes;
+	for (int i = 0; i < probes; i++) {
+		point->min[i] = lo[i] / 10.0f;
+		point->avg[i] = avg[i] / 10.0f;
+		point->max[i] = hi[i] / 10.0f;
+	}
+}
+
+static void average(const history_acc_t* acc, int16_t* avg) {
+	int32_t n = (int32_t) acc->count;
+	for (int i = 0; i < acc->probes; i++) {
+		int32_t sum = acc->sum[i];
+		avg[i] = (int16_t) ((sum >= 0 ? sum + n / 2 : sum - n / 2) / n);
+	}
+}
+
+static history_rollup_t* rollups(history_state_t* state, int tier, uint16_t* slots) {
+	if (tier == 0) {
+		*slots = CONFIG_HISTORY_MINUTE_SLOTS;
+		return state->minutes;
+	}
+	*slots = CONFIG_HISTORY_TEN_MINUTE_SLOTS;
+	return state->tens;
+}
+
+History::History() : checkpointSeq(0) {
+	memset(&stats, 0, sizeof(stats));
+	clear();
+}
+
+void History::clear() {
+	memset(&state, 0, sizeof(state));
+}
+
+/**
+ * Start a new raw block with this sweep, recycling the oldest block when
+ * all are in use.
+ */
+void History::startBlock(uint32_t ts, const int16_t* t, int probes) {
+	history_ring_t* ring = &state.blockRing;
+	if (ring->used == 0) {
+		ring->used = 1;
+	} else {
+		ring->head = (ring->head + 1) % HISTORY_BLOCKS;
+		if (ring->used < HISTORY_BLOCKS) {
+			ring->used++;
+		} else {
+			stats.recycled++;
+		}
+	}
+	history_block_t* block = &state.blocks[ring->head];
+	block->firstTs = ts;
+	block->lastTs = ts;
+	memcpy(block->first, t, sizeof(int16_t) * probes);
+	block->count = 1;
+	block->len = 0;
+	block->probes = probes;
+	state.lastDelta = 0;
+}
+
+/**
+ * Fold count sweeps averaging t, ranging lo to hi, into a rollup tier's
+ * current period, closing it first if ts is past it.
+ */
+void History::accumulate(int tier, uint32_t ts, const int16_t* t, const int16_t* lo, const int16_t* hi,
+		int probes, uint32_t count) {
+	history_acc_t* acc = &state.acc[tier];
+	uint32_t start = ts - ts % ROLLUP_PERIOD[tier];
+	if (acc->count > 0 && (acc->start != start || acc->probes != probes)) {
+		closeRollup(tier);
+	}
+	if (acc->count == 0) {
+		acc->start = start;
+		acc->probes = probes;
+		memcpy(acc->min, lo, sizeof(int16_t) * probes);
+		memcpy(acc->max, hi, sizeof(int16_t) * probes);
+		memset(acc->sum, 0, sizeof(acc->sum));
+	}
+	for (int i = 0; i < probes; i++) {
+		if (lo[i] < acc->min[i]) {
+			acc->min[i] = lo[i];
+		}
+		if (hi[i] > acc->max[i]) {
+			acc->max[i] = hi[i];
+		}
+		acc->sum[i] += (int32_t) t[i] * (int32_t) count;
+	}
+	acc->count += count;
+}
+
+/**
+ * Move a tier's current period into its ring.  A closed minute is folded
+ * into the ten minute tier.
+ */
+void History::closeRollup(int tier) {
+	history_acc_t* acc = &state.acc[tier];
+	uint16_t slots;
+	history_rollup_t* ring = rollups(&state, tier, &slots);
+	history_ring_t* r = &state.rollupRing[tier];
+	history_rollup_t* rollup = &ring[r->head];
+
+	memset(rollup, 0, sizeof(*rollup));
+	rollup->start = acc->start;
+	rollup->count = acc->count > UINT16_MAX ? UINT16_MAX : acc->count;
+	rollup->probes = acc->probes;
+	memcpy(rollup->min, acc->min, sizeof(int16_t) * acc->probes);
+	memcpy(rollup->max, acc->max, sizeof(int16_t) * acc->probes);
+	average(acc, rollup->avg);
+	r->head = (r->head + 1) % slots;
+	if (r->used < slots) {
+		r->used++;
+	}
+	acc->count = 0;
+	if (tier == 0) {
+		accumulate(1, rollup->start, rollup->avg, rollup->min, rollup->max, rollup->probes, rollup->count);
+	}
+}
+
+/**
+ * Add a sweep stamped with the wall clock.  Returns -1, storing nothing,
+ * if it is older than the newest sweep already stored.
+ */
+int History::append(const probe_sweep_t* sweep) {
+	uint32_t ts = (uint32_t) sweep->timestamp;
+	int probes = sweep->count < MAX_PROBES ? sweep->count : MAX_PROBES;
+	int16_t t[MAX_PROBES];
+	history_block_t* block = &state.blocks[state.blockRing.head];
+
+	if (block->count > 0 && ts < state.lastTs) {
+		stats.rejected++;
+		return -1;
+	}
+	for (int i = 0; i < probes; i++) {
+		t[i] = quantise(sweep->temp[i]);
+	}
+	if (block->count == 0 || probes != block->probes) {
+		startBlock(ts, t, probes);
+	} else {
+		uint8_t tmp[5 + 5 * MAX_PROBES];
+		int32_t delta = (int32_t) (ts - state.lastTs);
+		size_t n = putZigzag(tmp, delta - state.lastDelta);
+		for (int i = 0; i < probes; i++) {
+			n += putZigzag(tmp + n, t[i] - state.last[i]);
+		}
+		if (block->len + n > sizeof(block->payload)) {
+			startBlock(ts, t, probes);
+		} else {
+			memcpy(block->payload + block->len, tmp, n);
+			block->len += n;
+			block->count++;
+			block->lastTs = ts;
+			state.lastDelta = delta;
+		}
+	}
+	memcpy(state.last, t, sizeof(int16_t) * probes);
+	state.lastTs = ts;
+	accumulate(0, ts, t, t, t, probes, 1);
+	stats.appended++;
+	return 0;
+}
+
+bool History::visitRollups(int tier, uint32_t from, uint32_t to, history_visitor_t visitor, void* context, int* n) {
+	uint16_t slots;
+	const history_rollup_t* ring = rollups(&state, tier, &slots);
+	const history_ring_t* r = &state.rollupRing[tier];
+	uint32_t period = ROLLUP_PERIOD[tier];
+	history_point_t point;
+
+	for (int k = 0; k < r->used; k++) {
+		const history_rollup_t* rollup = &ring[(r->head + slots - r->used + k) % slots];
+		if (rollup->start + period <= from) {
+			continue;
+		}
+		if (rollup->start >= to) {
+			return true;
+		}
+		toPoint(&point, rollup->start, period, rollup->count, rollup->probes, rollup->min, rollup->avg, rollup->max);
+		++*n;
+		if (!visitor(&point, context)) {
+			return false;
+		}
+	}
+	// The period in progress, if any.
+	const history_acc_t* acc = &state.acc[tier];
+	if (acc->count > 0 && acc->start + period > from && acc->start < to) {
+		int16_t avg[MAX_PROBES];
+		average(acc, avg);
+		toPoint(&point, acc->start, period, acc->count > UINT16_MAX ? UINT16_MAX : acc->count,
+			acc->probes, acc->min, avg, acc->max);
+		++*n;
+		return visitor(&point, context);
+	}
+	return true;
+}
+
+/**
+ * Call visitor, oldest first, for each point of a tier in [from, to).
+ * A rollup is included if its period overlaps the range, the one still in
+ * progress too.  Returns the number of points visited.
+ */
+int History::query(history_tier_t tier, uint32_t from, uint32_t to, history_visitor_t visitor, void* context) {
+	int n = 0;
+	if (tier != HISTORY_RAW) {
+		visitRollups(tier == HISTORY_MINUTES ? 0 : 1, from, to, visitor, context, &n);
+		return n;
+	}
+
+	const history_ring_t* r = &state.blockRing;
+	history_point_t point;
+	for (int k = 0; k < r->used; k++) {
+		const history_block_t* block = &state.blocks[(r->head + HISTORY_BLOCKS - r->used + 1 + k) % HISTORY_BLOCKS];
+		if (block->lastTs < from) {
+			continue;
+		}
+		if (block->firstTs >= to) {
+			break;
+		}
+		uint32_t ts = block->firstTs;
+		int32_t delta = 0;
+		int16_t t[MAX_PROBES];
+		size_t pos = 0;
+		memcpy(t, block->first, sizeof(t));
+		for (int i = 0; i < block->count; i++) {
+			if (i > 0) {
+				int32_t v;
+				if (!getZigzag(block->payload, block->len, &pos, &v)) {
+					break;
+				}
+				delta += v;
+				ts += delta;
+				for (int p = 0; p < block->probes; p++) {
+					if (!getZigzag(block->payload, block->len, &pos, &v)) {
+						break;
+					}
+					t[p] += v;
+				}
+			}
+			if (ts >= to) {
+				return n;
+			}
+			if (ts >= from) {
+				toPoint(&point, ts, 0, 1, block->probes, t, t, t);
+				n++;
+				if (!visitor(&point, context)) {
+					return n;
+				}
+			}
+		}
+	}
+	return n;
+}
+
+/**
+ * Timestamp of the oldest point of a tier, or 0 if it is empty.
+ */
+uint32_t History::oldest(history_tier_t tier) {
+	if (tier == HISTORY_RAW) {
+		const history_ring_t* r = &state.blockRing;
+		if (r->used == 0) {
+			return 0;
+		}
+		return state.blocks[(r->head + HISTORY_BLOCKS - r->used + 1) % HISTORY_BLOCKS].firstTs;
+	}
+	int t = tier == HISTORY_MINUTES ? 0 : 1;
+	uint16_t slots;
+	const history_rollup_t* ring = rollups(&state, t, &slots);
+	const history_ring_t* r = &state.rollupRing[t];
+	if (r->used > 0) {
+		return ring[(r->head + slots - r->used) % slots].start;
+	}
+	return state.acc[t].count > 0 ? state.acc[t].start : 0;
+}
+
+/**
+ * The finest tier still holding from, or the coarsest if none does.
+ */
+history_tier_t History::tierFor(uint32_t from) {
+	for (int tier = HISTORY_RAW; tier < HISTORY_TEN_MINUTES; tier++) {
+		uint32_t ts = oldest((history_tier_t) tier);
+		if (ts != 0 && ts <= from) {
+			return (history_tier_t) tier;
+		}
+	}
+	return HISTORY_TEN_MINUTES;
+}
+
+uint32_t History::rawSamples() {
+	uint32_t n = 0;
+	for (int k = 0; k < state.blockRing.used; k++) {
+		n += state.blocks[(state.blockRing.head + HISTORY_BLOCKS - k) % HISTORY_BLOCKS].count;
+	}
+	return n;
+}
+
+/**
+ * Bytes of the raw blocks in use, headers included.
+ */
+size_t History::rawBytes() {
+	size_t n = 0;
+	for (int k = 0; k < state.blockRing.used; k++) {
+		n += HISTORY_BLOCK_HEADER + state.blocks[(state.blockRing.head + HISTORY_BLOCKS - k) % HISTORY_BLOCKS].len;
+	}
+	return n;
+}
+
+/**
+ * Bytes of storage one checkpoint slot takes.
+ */
+size_t History::checkpointSize() {
+	return SLOT_SIZE;
+}
+
+/**
+ * Write the store to the older of the two checkpoint slots.  The header
+ * goes last, so a slot is only valid once completely written.  Returns 0
+ * on success.
+ */
+int History::checkpoint(LogStorage& storage) {
+	int slots = storage.size() / SLOT_SIZE;
+	if (slots == 0) {
+		return -1;
+	}
+	if (slots > CHECKPOINT_SLOTS) {
+		slots = CHECKPOINT_SLOTS;
+	}
+	uint32_t seq = checkpointSeq + 1;
+	uint32_t offset = (seq % slots) * SLOT_SIZE;
+	checkpoint_header_t header = { CHECKPOINT_MAGIC, seq, sizeof(state), crc32(&state, sizeof(state)) };
+	if (storage.erase(offset, SLOT_SIZE) != 0 ||
+		storage.write(offset + sizeof(header), &state, sizeof(state)) != 0 ||
+		storage.write(offset, &header, sizeof(header)) != 0) {
+		return -1;
+	}
+	checkpointSeq = seq;
+	stats.checkpoints++;
+	return 0;
+}
+
+/**
+ * Load the newest valid checkpoint.  Returns 0 on success; otherwise the
+ * store is left empty.
+ */
+int History::restore(LogStorage& storage) {
+	int slots = storage.size() / SLOT_SIZE;
+	checkpoint_header_t headers[CHECKPOINT_SLOTS];
+	if (slots > CHECKPOINT_SLOTS) {
+		slots = CHECKPOINT_SLOTS;
+	}
+	for (int i = 0; i < slots; i++) {
+		if (storage.read(i * SLOT_SIZE, &headers[i], sizeof(headers[i])) != 0 ||
+			headers[i].magic != CHECKPOINT_MAGIC) {
+			headers[i].seq = 0;
+		} else if (headers[i].seq > checkpointSeq) {
+			checkpointSeq = headers[i].seq;
+		}
+	}
+	// Newest first, falling back to the other slot.
+	for (int tries = 0; tries < slots; tries++) {
+		int best = -1;
+		for (int i = 0; i < slots; i++) {
+			if (headers[i].seq != 0 && (best < 0 || headers[i].seq > headers[best].seq)) {
+				best = i;
+			}
+		}
+		if (best < 0) {
+			break;
+		}
+		if (headers[best].size == sizeof(state) &&
+			storage.read(best * SLOT_SIZE + sizeof(checkpoint_header_t), &state, sizeof(state)) == 0 &&
+			crc32(&state, sizeof(state)) == headers[best].crc) {
+			return 0;
+		}
+		headers[best].seq = 0;
+	}
+	clear();
+	return -1;
+}
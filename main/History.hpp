@@ -0,0 +1,148 @@
+#ifndef HISTORY_H_
+#define HISTORY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sdkconfig.h"
+#include "LogStorage.hpp"
+#include "ProbeSampler.hpp"
+
+#define HISTORY_BLOCK_SIZE 256
+#define HISTORY_BLOCKS (CONFIG_HISTORY_RAW_BYTES / HISTORY_BLOCK_SIZE)
+#define HISTORY_BLOCK_HEADER 24
+
+typedef enum {
+	HISTORY_RAW,			// every sweep
+	HISTORY_MINUTES,		// 1 minute rollups
+	HISTORY_TEN_MINUTES,	// 10 minute rollups
+	HISTORY_TIERS
+} history_tier_t;
+
+/**
+ * A block of raw sweeps.  The first sweep is in the header; each further
+ * one is a zvarint delta-of-delta timestamp followed by a zvarint delta of
+ * each probe from the previous sweep, in 0.1 degC.  At a steady sample
+ * interval that is one byte for the timestamp and about one per probe.
+ */
+typedef struct {
+	uint32_t firstTs;
+	uint32_t lastTs;
+	int16_t first[MAX_PROBES];
+	uint16_t count;
+	uint16_t len;		// payload bytes used
+	uint8_t probes;
+	uint8_t reserved[3];
+	uint8_t payload[HISTORY_BLOCK_SIZE - HISTORY_BLOCK_HEADER];
+} history_block_t;
+
+/**
+ * Min, max and average of each probe over one period, in 0.1 degC.
+ */
+typedef struct {
+	uint32_t start;
+	uint16_t count;		// sweeps
+	uint8_t probes;
+	uint8_t reserved;
+	int16_t min[MAX_PROBES];
+	int16_t max[MAX_PROBES];
+	int16_t avg[MAX_PROBES];
+} history_rollup_t;
+
+typedef struct {
+	uint32_t start;
+	uint32_t count;
+	uint8_t probes;
+	int16_t min[MAX_PROBES];
+	int16_t max[MAX_PROBES];
+	int32_t sum[MAX_PROBES];
+} history_acc_t;
+
+typedef struct {
+	uint16_t head;		// next slot to write
+	uint16_t used;
+} history_ring_t;
+
+/**
+ * Everything the store keeps, in one block so it can be checkpointed as
+ * is.  Its size depends on the configuration; a checkpoint taken with a
+ * different one is discarded.
+ */
+typedef struct {
+	history_block_t blocks[HISTORY_BLOCKS];
+	history_ring_t blockRing;	// head is the block being filled
+	uint32_t lastTs;
+	int32_t lastDelta;
+	int16_t last[MAX_PROBES];
+	history_rollup_t minutes[CONFIG_HISTORY_MINUTE_SLOTS];
+	history_rollup_t tens[CONFIG_HISTORY_TEN_MINUTE_SLOTS];
+	history_ring_t rollupRing[2];
+	history_acc_t acc[2];
+} history_state_t;
+
+/**
+ * A point returned by a query, in degC.  Raw sweeps have period 0, count
+ * 1 and min == avg == max.
+ */
+typedef struct {
+	uint32_t ts;
+	uint16_t period;	// seconds
+	uint16_t count;
+	int probes;
+	float min[MAX_PROBES];
+	float avg[MAX_PROBES];
+	float max[MAX_PROBES];
+} history_point_t;
+
+// Return false to end the query early.
+typedef bool (*history_visitor_t)(const history_point_t*, void* context);
+
+typedef struct {
+	uint32_t appended;
+	uint32_t rejected;		// older than the newest sweep kept
+	uint32_t recycled;		// raw blocks overwritten
+	uint32_t checkpoints;
+} history_stats_t;
+
+/**
+ * Temperature history kept on the device, so a recent cook can be graphed
+ * without the cloud.  Sweeps are stored with wall clock timestamps in
+ * three tiers in a fixed RAM arena: every sweep for the last
+ * CONFIG_HISTORY_RAW_BYTES worth of compressed blocks, then 1 minute and
+ * 10 minute min/max/average rollups in rings of
+ * CONFIG_HISTORY_MINUTE_SLOTS and CONFIG_HISTORY_TEN_MINUTE_SLOTS.  Values
+ * are quantised to 0.1 degC, the resolution the sweep log uses.
+ *
+ * checkpoint() writes the whole arena to flash, alternating between two
+ * slots so a reset during a write keeps the previous one, and restore()
+ * reads the newest back after a reset.  Each slot takes checkpointSize()
+ * bytes; with room for only one a reset during a write loses the history.
+ *
+ * Not thread safe.  No ESP-IDF dependencies.
+ */
+class History {
+	history_state_t state;
+	history_stats_t stats;
+	uint32_t checkpointSeq;
+
+	void startBlock(uint32_t ts, const int16_t* t, int probes);
+	void accumulate(int tier, uint32_t ts, const int16_t* t, const int16_t* lo, const int16_t* hi, int probes, uint32_t count);
+	void closeRollup(int tier);
+	bool visitRollups(int tier, uint32_t from, uint32_t to, history_visitor_t, void*, int* n);
+
+	public:
+	History();
+	void clear();
+	int append(const probe_sweep_t*);
+	int query(history_tier_t, uint32_t from, uint32_t to, history_visitor_t, void* context);
+	uint32_t oldest(history_tier_t);
+	history_tier_t tierFor(uint32_t from);
+	uint32_t rawSamples();
+	size_t rawBytes();
+	int checkpoint(LogStorage&);
+	int restore(LogStorage&);
+	static size_t checkpointSize();
+	const history_stats_t* getStats() { return &stats; }
+};
+
+#endif
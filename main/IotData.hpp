@@ -1,13 +1,29 @@
 #ifndef IOTDATA_H_
 #define IOTDATA_H_
 
+#include <stddef.h>
+#include "aws_iot_shadow_json_data.h"
+
 using namespace std;
 
+/**
+ * Outcome of an asynchronous publish, reported to its callback.
+ */
+typedef enum {
+	PUBLISH_ACCEPTED,
+	PUBLISH_REJECTED,
+	PUBLISH_TIMEOUT,
+	PUBLISH_FAILED    // could not be sent, e.g. the connection is down
+} publish_status_t;
+
+typedef void (*publish_callback_t)(publish_status_t status, void* context);
+
 class IotData {
 	public:
 	virtual int signup(char*,char*);
 	virtual int init(char*);
 	virtual int send(char*, size_t, jsonStruct_t*, int);
+	virtual int publishAsync(const char*, publish_callback_t, void*);
 	virtual int close();
 };
 
@@ -2,6 +2,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "esp_system.h"
 #include "esp_event.h"
 #include "esp_event_loop.h"
@@ -14,6 +15,9 @@
 #include "aws_iot_shadow_interface.h"
 #include "IotData.hpp"
 #include "IotDataMqtt.hpp"
+#include "JsonWriter.hpp"
+#include "Metrics.hpp"
+#include "Trace.hpp"
 
 using namespace std;
 extern const uint8_t aws_root_ca_pem_start[] asm("_binary_aws_root_ca_pem_start");
@@ -112,90 +116,85 @@ static void disconnectCallbackHandler(AWS_IoT_Client *pClient, void *data) {
     }
 }
 
-static bool shadowUpdateInProgress;
-
+/**
+ * Shadow update ack.  pContextData is the shadow_request_t slot the update
+ * was sent with; its window passes the outcome on in send order.
+ */
 static void ShadowUpdateStatusCallback(const char *pThingName, ShadowActions_t action, Shadow_Ack_Status_t status,
                                 const char *pReceivedJsonDocument, void *pContextData) {
     IOT_UNUSED(pThingName);
     IOT_UNUSED(action);
     IOT_UNUSED(pReceivedJsonDocument);
-    IOT_UNUSED(pContextData);
 
-    shadowUpdateInProgress = false;
+    shadow_request_t* request = (shadow_request_t*) pContextData;
     static const char* TAG = "shadow_callback";
+    publish_status_t result = PUBLISH_FAILED;
 
     if(SHADOW_ACK_TIMEOUT == status) {
         ESP_LOGE(TAG, "Update timed out");
+        result = PUBLISH_TIMEOUT;
     } else if(SHADOW_ACK_REJECTED == status) {
         ESP_LOGE(TAG, "Update rejected");
+        result = PUBLISH_REJECTED;
     } else if(SHADOW_ACK_ACCEPTED == status) {
-        ESP_LOGI(TAG, "Update accepted");
+        ESP_LOGD(TAG, "Update accepted");
+        result = PUBLISH_ACCEPTED;
     }
+
+    if (request == NULL) {
+        return;
+    }
+    ESP_LOGD(TAG, "Ack for %s", request->token);
+    request->window->complete(request, result);
 }
 
+/**
+ * Copy the clientToken value out of a shadow document.
+ */
+static void getClientToken(const char* doc, char* token, size_t size) {
+    static const char KEY[] = "\"clientToken\"";
+    token[0] = 0;
+    const char* p = strstr(doc, KEY);
+    if (p == NULL) {
+        return;
+    }
+    p = strchr(p + sizeof(KEY) - 1, '"');
+    if (p == NULL) {
+        return;
+    }
+    p++;
+    size_t len = 0;
+    while (p[len] && p[len] != '"' && len < size - 1) {
+        len++;
+    }
+    memcpy(token, p, len);
+    token[len] = 0;
+}
+
+IotDataMqtt::IotDataMqtt() {
+    connected = false;
+    sessionOpen = false;
+    networkTaskStarted = false;
+    networkTaskStopRequest = false;
+    deltaCount = 0;
+    rawStatus = PUBLISH_FAILED;
+}
+
+/**
+ * First boot registration: publish the username on topic/iot_signup and
+ * seed the shadow document.  Both go over the connection opened by init(),
+ * which stays up for telemetry afterwards.  Returns FAILURE, and saves
+ * nothing, if a document does not fit or the shadow does not accept the
+ * seed.
+ */
 int IotDataMqtt::signup(char* thingId,char* username) {
     if (isRegistered()) { return 0; }
     char cPayload[100];
 
-    //int32_t i = 0;
-
     IoT_Error_t rc = FAILURE;
-    AWS_IoT_Client client;
-    IoT_Client_Init_Params mqttInitParams = iotClientInitParamsDefault;
-    IoT_Client_Connect_Params connectParams = iotClientConnectParamsDefault;
+    this->init(thingId);
 
     IoT_Publish_Message_Params paramsQOS0;
- 
-    ESP_LOGI(TAG, "AWS IoT SDK Version %d.%d.%d-%s", VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH, VERSION_TAG);
-
-    mqttInitParams.enableAutoReconnect = false; // We enable this later below
-    mqttInitParams.pHostURL = (char*)IotDataMqtt::HOST;
-    mqttInitParams.port = IotDataMqtt::PORT;
-
-    mqttInitParams.pDeviceCertLocation = (const char *)certificate_and_ca_pem_crt_start;
-    //mqttInitParams.pDeviceCertLocation = (const char *)certificate_pem_crt_start;
-    mqttInitParams.pDevicePrivateKeyLocation = (const char *)private_pem_key_start;
-    mqttInitParams.pRootCALocation = (const char *)aws_root_ca_pem_start;
-    mqttInitParams.mqttCommandTimeout_ms = 20000;
-    mqttInitParams.tlsHandshakeTimeout_ms = 5000;
-    mqttInitParams.isSSLHostnameVerify = true;
-    mqttInitParams.disconnectHandler = disconnectCallbackHandler;
-    mqttInitParams.disconnectHandlerData = NULL;
-
-    rc = aws_iot_mqtt_init(&client, &mqttInitParams);
-    if(SUCCESS != rc) {
-        ESP_LOGE(TAG, "aws_iot_mqtt_init returned error : %d ", rc);
-        abort();
-    }
-
-    connectParams.keepAliveIntervalInSec = 10;
-    connectParams.isCleanSession = true;
-    connectParams.MQTTVersion = MQTT_3_1_1;
-    
-    connectParams.pClientID = thingId;
-    connectParams.clientIDLen = (uint16_t) strlen(thingId);
-    connectParams.isWillMsgPresent = false;
-
-    ESP_LOGI(TAG, "Connecting to AWS...");
-    do {
-        rc = aws_iot_mqtt_connect(&client, &connectParams);
-        if(SUCCESS != rc) {
-            ESP_LOGE(TAG, "Error(%d) connecting to %s:%d", rc, mqttInitParams.pHostURL, mqttInitParams.port);
-            vTaskDelay(1000 / portTICK_RATE_MS);
-        }
-    } while(SUCCESS != rc);
-
-    /*
-     * Enable Auto Reconnect functionality. Minimum and Maximum time of Exponential backoff are set in aws_iot_config.h
-     *  #AWS_IOT_MQTT_MIN_RECONNECT_WAIT_INTERVAL
-     *  #AWS_IOT_MQTT_MAX_RECONNECT_WAIT_INTERVAL
-     */
-    rc = aws_iot_mqtt_autoreconnect_set_status(&client, true);
-    if(SUCCESS != rc) {
-        ESP_LOGE(TAG, "Unable to set Auto Reconnect to true - %d", rc);
-        abort();
-    }
-
     const char *TOPIC = "topic/iot_signup";
     const int TOPIC_LEN = strlen(TOPIC);
 
@@ -203,23 +202,44 @@ int IotDataMqtt::signup(char* thingId,char* username) {
     paramsQOS0.payload = (void *) cPayload;
     paramsQOS0.isRetained = 0;
 
-    rc = aws_iot_mqtt_yield(&client, 100);
-    sprintf(cPayload, "{\"username\" : \"%s\"}",username);
-    paramsQOS0.payloadLen = strlen(cPayload);
-    rc = aws_iot_mqtt_publish(&client, TOPIC, TOPIC_LEN, &paramsQOS0);
+    rc = aws_iot_shadow_yield(&mqttClient, 100);
+    JsonWriter payload(cPayload, sizeof(cPayload));
+    payload.beginObject().key("username").value(username).endObject();
+    if (!payload.ok()) {
+        ESP_LOGE(TAG, "Signup payload too large");
+        return FAILURE;
+    }
+    paramsQOS0.payloadLen = payload.length();
+    rc = aws_iot_mqtt_publish(&mqttClient, TOPIC, TOPIC_LEN, &paramsQOS0);
     if (rc == MQTT_REQUEST_TIMEOUT_ERROR) {
         ESP_LOGW(TAG, "QOS1 publish ack not received.");
     } else {
         ESP_LOGI(TAG, "Signup publish successful.");
-		//TODO: fix race issue
-		this->init(thingId);
     	char JsonDocumentBuffer[400];
-		sprintf(JsonDocumentBuffer,
-			"{\"state\": {\"reported\": {\"thingname\":\"%s\",\"username\":\"%s\", \"td\": [\"Temp 1\",\"Temp 2\",\"Temp 3\"], \"t\": [0,0,0], \"tl\": [0,0,0], \"tu\": [100,100,100]}}, \"clientToken\":\"%s-100\"}",
-			thingId,username,thingId);
-	
-		this->sendraw(JsonDocumentBuffer);
-		this->close();
+		char clientToken[64];
+		snprintf(clientToken, sizeof(clientToken), "%s-100", thingId);
+		JsonWriter w(JsonDocumentBuffer, sizeof(JsonDocumentBuffer));
+		w.beginObject().key("state").beginObject().key("reported").beginObject();
+		w.key("thingname").value(thingId);
+		w.key("username").value(username);
+		w.key("td").beginArray().value("Temp 1").value("Temp 2").value("Temp 3").endArray();
+		const int32_t t = 0, tl = 0, tu = 100;
+		w.key("t").beginArray().value(t).value(t).value(t).endArray();
+		w.key("tl").beginArray().value(tl).value(tl).value(tl).endArray();
+		w.key("tu").beginArray().value(tu).value(tu).value(tu).endArray();
+		w.endObject().endObject();
+		w.key("clientToken").value(clientToken).endObject();
+		if (!w.ok()) {
+			ESP_LOGE(TAG, "Shadow seed document too large");
+			return FAILURE;
+		}
+		// Registered only once the shadow has taken the seed; otherwise
+		// the next boot signs up again.
+		publish_status_t status = this->sendraw(JsonDocumentBuffer);
+		if (status != PUBLISH_ACCEPTED) {
+			ESP_LOGW(TAG, "Shadow seed not accepted (%d)", status);
+			return FAILURE;
+		}
         saveRegisterStatus(true);
     }
 
@@ -229,11 +249,22 @@ int IotDataMqtt::signup(char* thingId,char* username) {
 
 
 
+/**
+ * Open the shadow connection used for everything: signup, the seed
+ * document and telemetry.  Does nothing if it is already open for this
+ * thing, so signup() and the caller can both call it; the SDK's auto
+ * reconnect keeps it up from then on.
+ */
 int IotDataMqtt::init(char* thingName) {
     IoT_Error_t rc = FAILURE;
 
+    if (sessionOpen && strcmp(this->thingName, thingName) == 0) {
+        return SUCCESS;
+    }
+
     strcpy(this->thingName,thingName);
     strcpy(this->thingId,thingName);
+    snprintf(telemetryTopic, sizeof(telemetryTopic), "%s/%s", CONFIG_TELEMETRY_TOPIC, thingName);
 
     ESP_LOGI(IotDataMqtt::TAG, "AWS IoT SDK Version %d.%d.%d-%s", VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH, VERSION_TAG);
     ShadowInitParameters_t sp = ShadowInitParametersDefault;
@@ -266,6 +297,8 @@ int IotDataMqtt::init(char* thingName) {
         ESP_LOGE(IotDataMqtt::TAG, "aws_iot_shadow_connect returned error %d, aborting...", rc);
         abort();
     }
+    connected = true;
+    sessionOpen = true;
 
     /*
      * Enable Auto Reconnect functionality. Minimum and Maximum time of Exponential backoff are set in aws_iot_config.h
@@ -277,14 +310,40 @@ int IotDataMqtt::init(char* thingName) {
         ESP_LOGE(IotDataMqtt::TAG, "Unable to set Auto Reconnect to true - %d, aborting...", rc);
     }
 
-    if(SUCCESS != rc) {
-        ESP_LOGE(IotDataMqtt::TAG, "Shadow Register Delta Error");
+    for (int i = 0; i < deltaCount; i++) {
+        IoT_Error_t deltaRc = aws_iot_shadow_register_delta(&mqttClient, &deltaHandlers[i].json);
+        if(SUCCESS != deltaRc) {
+            ESP_LOGE(IotDataMqtt::TAG, "Shadow Register Delta Error %d for %s", deltaRc, deltaHandlers[i].json.pKey);
+        }
     }
-	
-
 
     return rc;
 }
+
+static void ShadowDeltaCallback(const char *pJsonValueBuffer, uint32_t valueLength, jsonStruct_t *pJsonStruct_t) {
+    delta_handler_t* handler = (delta_handler_t*) pJsonStruct_t;
+    handler->callback(pJsonStruct_t->pKey, pJsonValueBuffer, valueLength, handler->context);
+}
+
+/**
+ * Call back on changes to a key of the desired state.  Register before
+ * init(), which subscribes to the delta topic; key must stay valid.  The
+ * value is left as raw JSON (SHADOW_JSON_OBJECT), so arrays work too.
+ */
+int IotDataMqtt::onDelta(const char* key, delta_callback_t callback, void* context) {
+    if (deltaCount >= SHADOW_DELTA_HANDLERS) {
+        return FAILURE;
+    }
+    delta_handler_t* handler = &deltaHandlers[deltaCount++];
+    memset(handler, 0, sizeof(*handler));
+    handler->json.pKey = key;
+    handler->json.pData = NULL;
+    handler->json.type = SHADOW_JSON_OBJECT;
+    handler->json.cb = ShadowDeltaCallback;
+    handler->callback = callback;
+    handler->context = context;
+    return SUCCESS;
+}
 int IotDataMqtt::send(char* JsonDocumentBuffer, size_t sizeOfJsonDocumentBuffer, jsonStruct_t* data, int sizeData) {
 
     IoT_Error_t rc = SUCCESS;
@@ -292,7 +351,7 @@ int IotDataMqtt::send(char* JsonDocumentBuffer, size_t sizeOfJsonDocumentBuffer,
 
     while(NETWORK_ATTEMPTING_RECONNECT == rc || NETWORK_RECONNECTED == rc || SUCCESS == rc) {
         rc = aws_iot_shadow_yield(&mqttClient, 200);
-        if(NETWORK_ATTEMPTING_RECONNECT == rc || shadowUpdateInProgress) {
+        if(NETWORK_ATTEMPTING_RECONNECT == rc || window.depth() > 0) {
             rc = aws_iot_shadow_yield(&mqttClient, 1000);
             // If the client is attempting to reconnect, or already waiting on a shadow update,
             // we will skip the rest of the loop.
@@ -301,24 +360,18 @@ int IotDataMqtt::send(char* JsonDocumentBuffer, size_t sizeOfJsonDocumentBuffer,
         if (sent) {
               break;
         }
-		ESP_LOGI(IotDataMqtt::TAG, "init_json");
         rc = aws_iot_shadow_init_json_document(JsonDocumentBuffer, sizeOfJsonDocumentBuffer);
         if(SUCCESS == rc) {
-		ESP_LOGI(IotDataMqtt::TAG, "add_array");
             rc = aws_iot_shadow_add_array_reported(JsonDocumentBuffer, sizeOfJsonDocumentBuffer, sizeData, data);
             if(SUCCESS == rc) {
-		ESP_LOGI(IotDataMqtt::TAG, "finalize");
                 rc = aws_iot_finalize_json_document(JsonDocumentBuffer, sizeOfJsonDocumentBuffer);
                 if(SUCCESS == rc) {
-                    ESP_LOGI(IotDataMqtt::TAG, "Update Shadow: %s", JsonDocumentBuffer);
-                    rc = aws_iot_shadow_update(&mqttClient, thingName, JsonDocumentBuffer,
-                                               ShadowUpdateStatusCallback, NULL, 4, true);
-                    shadowUpdateInProgress = true;
+                    ESP_LOGD(IotDataMqtt::TAG, "Update Shadow: %s", JsonDocumentBuffer);
+                    rc = update(JsonDocumentBuffer, NULL, NULL);
                     sent = true;
                 }
             }
         }
-        ESP_LOGI(TAG, "*****************************************************************************************");
     }
 
     if(SUCCESS != rc) {
@@ -328,16 +381,24 @@ int IotDataMqtt::send(char* JsonDocumentBuffer, size_t sizeOfJsonDocumentBuffer,
     return rc;
 }
 
-int IotDataMqtt::sendraw(char* JsonDocumentBuffer) {
+void IotDataMqtt::rawDone(publish_status_t status, void* context) {
+    ((IotDataMqtt*) context)->rawStatus = status;
+}
+
+/**
+ * Send a shadow update and wait for the broker's answer.  Returns that,
+ * or PUBLISH_FAILED if the connection went first; only the ack says the
+ * update was taken.  Not once start() has handed the client over.
+ */
+publish_status_t IotDataMqtt::sendraw(char* JsonDocumentBuffer) {
 
     IoT_Error_t rc = SUCCESS;
     bool sent = false;
+    rawStatus = PUBLISH_FAILED;
 
     while(NETWORK_ATTEMPTING_RECONNECT == rc || NETWORK_RECONNECTED == rc || SUCCESS == rc) {
-		ESP_LOGI(TAG, "yield");
         rc = aws_iot_shadow_yield(&mqttClient, 100);
-        if(NETWORK_ATTEMPTING_RECONNECT == rc || shadowUpdateInProgress) {
-			ESP_LOGI(TAG, "yield2");
+        if(NETWORK_ATTEMPTING_RECONNECT == rc || window.depth() > 0) {
             rc = aws_iot_shadow_yield(&mqttClient, 100);
             // If the client is attempting to reconnect, or already waiting on a shadow update,
             // we will skip the rest of the loop.
@@ -346,29 +407,187 @@ int IotDataMqtt::sendraw(char* JsonDocumentBuffer) {
         if (sent) {
               break;
         }
-        ESP_LOGI(IotDataMqtt::TAG, "Update Shadow: %s", JsonDocumentBuffer);
-        rc = aws_iot_shadow_update(&mqttClient, thingName, JsonDocumentBuffer,
-                            ShadowUpdateStatusCallback, NULL, 4, true);
-		ESP_LOGI(TAG, "update: %d",rc);
-        shadowUpdateInProgress = true;
+        ESP_LOGD(IotDataMqtt::TAG, "Update Shadow: %s", JsonDocumentBuffer);
+        rc = update(JsonDocumentBuffer, rawDone, this);
+        ESP_LOGD(TAG, "update: %d",rc);
         sent = true;
-		vTaskDelay(2000 / portTICK_RATE_MS);
-        ESP_LOGI(TAG, "*****************************************************************************************");
     }
 
     if(SUCCESS != rc) {
         ESP_LOGE(TAG, "An error occurred in the loop %d", rc);
     }
 
+    return rawStatus;
+}
+
+
+
+/**
+ * Queue a shadow update document for the network task and return at once.
+ * The document is copied.  Returns FAILURE without calling back if the
+ * queue is full or the document does not fit a queue slot; otherwise the
+ * callback (may be NULL) runs on the network task with the outcome.
+ */
+int IotDataMqtt::publishAsync(const char* JsonDocument, publish_callback_t callback, void* context) {
+    size_t len = strlen(JsonDocument);
+    if (len >= PUBLISH_DOC_SIZE) {
+        ESP_LOGE(TAG, "Document too large for publish queue (%u)", (unsigned) len);
+        return FAILURE;
+    }
+    publish_request_t* request = publishQueue.reserve();
+    if (request == NULL) {
+        ESP_LOGW(TAG, "Publish queue full");
+        return FAILURE;
+    }
+    memcpy(request->doc, JsonDocument, len + 1);
+    request->len = len;
+    request->binary = false;
+    request->callback = callback;
+    request->context = context;
+    publishQueue.commit();
+    return SUCCESS;
+}
+
+/**
+ * Queue a binary telemetry frame (see TelemetryCodec.hpp) for the network
+ * task, to be published with QoS 0 on <CONFIG_TELEMETRY_TOPIC>/<thing name>.
+ * Same contract as publishAsync(); ACCEPTED means the frame was sent.
+ */
+int IotDataMqtt::publishBinaryAsync(const uint8_t* frame, size_t len, publish_callback_t callback, void* context) {
+    if (len > PUBLISH_DOC_SIZE) {
+        ESP_LOGE(TAG, "Frame too large for publish queue (%u)", (unsigned) len);
+        return FAILURE;
+    }
+    publish_request_t* request = publishQueue.reserve();
+    if (request == NULL) {
+        ESP_LOGW(TAG, "Publish queue full");
+        return FAILURE;
+    }
+    memcpy(request->doc, frame, len);
+    request->len = len;
+    request->binary = true;
+    request->callback = callback;
+    request->context = context;
+    publishQueue.commit();
+    return SUCCESS;
+}
+
+/**
+ * Start the network task that drains publishAsync() requests.  From here
+ * on the client belongs to that task, so send()/sendraw() must not be used
+ * until close().
+ */
+int IotDataMqtt::start() {
+    if (networkTaskStarted) {
+        return SUCCESS;
+    }
+    networkTaskStopRequest = false;
+    networkTaskStarted = true;
+    // On the PRO CPU next to the WiFi stack; the APP CPU is for sampling.
+    if (xTaskCreatePinnedToCore(&IotDataMqtt::networkTask, "iot_network_task", 9216, this, 5, NULL, 0) != pdPASS) {
+        ESP_LOGE(TAG, "Unable to create network task");
+        networkTaskStarted = false;
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+void IotDataMqtt::networkTask(void* param) {
+    METRIC_WATCH_TASK("network");
+    ((IotDataMqtt*) param)->drain();
+    vTaskDelete(NULL);
+}
+
+/**
+ * Send one shadow update in a free window slot.  A failed send completes
+ * the slot at once so the callback still runs, in order.
+ */
+IoT_Error_t IotDataMqtt::update(const char* JsonDocument, publish_callback_t callback, void* context) {
+    char token[SHADOW_TOKEN_SIZE];
+    getClientToken(JsonDocument, token, sizeof(token));
+    shadow_request_t* request = window.acquire(token, callback, context);
+    if (request == NULL) {
+        return FAILURE;
+    }
+    IoT_Error_t rc = aws_iot_shadow_update(&mqttClient, thingName, (char*) JsonDocument,
+                            ShadowUpdateStatusCallback, request, 4, true);
+    TRACE(TRACE_UPDATE, rc);
+    if(SUCCESS != rc) {
+        ESP_LOGE(TAG, "Shadow update %s failed %d", token, rc);
+        window.complete(request, PUBLISH_FAILED);
+    }
     return rc;
 }
 
+/**
+ * Publish a queued binary frame.  There is no ack at QoS 0, so the
+ * callback runs as soon as it is sent.
+ */
+IoT_Error_t IotDataMqtt::publishFrame(const publish_request_t* request) {
+    IoT_Publish_Message_Params params;
+    params.qos = QOS0;
+    params.isRetained = 0;
+    params.payload = (void*) request->doc;
+    params.payloadLen = request->len;
+    IoT_Error_t rc = aws_iot_mqtt_publish(&mqttClient, telemetryTopic, (uint16_t) strlen(telemetryTopic), &params);
+    if(SUCCESS != rc) {
+        ESP_LOGE(TAG, "Telemetry publish failed %d", rc);
+    }
+    if (request->callback) {
+        request->callback(SUCCESS == rc ? PUBLISH_ACCEPTED : PUBLISH_FAILED, request->context);
+    }
+    return rc;
+}
+
+/**
+ * Network task body: keep the connection serviced and send queued
+ * documents while the in-flight window has room.
+ */
+void IotDataMqtt::drain() {
+    IoT_Error_t rc = SUCCESS;
 
+    while (!networkTaskStopRequest) {
+        {
+            METRIC_TIME(METRIC_YIELD);
+            rc = aws_iot_shadow_yield(&mqttClient, 100);
+        }
+        if(NETWORK_RECONNECTED == rc) {
+            METRIC_COUNT(METRIC_MQTT_RECONNECTS);
+        }
+        connected = (SUCCESS == rc || NETWORK_RECONNECTED == rc);
+        if(NETWORK_ATTEMPTING_RECONNECT == rc) {
+            continue;
+        }
+        if(SUCCESS != rc && NETWORK_RECONNECTED != rc) {
+            ESP_LOGE(TAG, "Yield error %d", rc);
+            TRACE(TRACE_YIELD, rc);
+            vTaskDelay(1000 / portTICK_PERIOD_MS);
+            continue;
+        }
+        // Fill the window; the next yield collects the acks.
+        publish_request_t* request;
+        while (!window.full() && (request = publishQueue.front()) != NULL) {
+            if (request->binary) {
+                publishFrame(request);
+            } else {
+                update(request->doc, request->callback, request->context);
+            }
+            publishQueue.release();
+        }
+    }
+    networkTaskStarted = false;
+}
 
 int IotDataMqtt::close() {
 
     IoT_Error_t rc = SUCCESS;
+    networkTaskStopRequest = true;
+    while (networkTaskStarted) {
+        vTaskDelay(100 / portTICK_PERIOD_MS);
+    }
     ESP_LOGI(TAG, "Disconnecting");
+    connected = false;
+    sessionOpen = false;
     rc = aws_iot_shadow_disconnect(&mqttClient);
 
     if(SUCCESS != rc) {
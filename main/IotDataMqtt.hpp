@@ -1,6 +1,7 @@
 #ifndef IOTDATAMQTT_H_
 #define IOTDATAMQTT_H_
 
+#include "sdkconfig.h"
 #include "aws_iot_config.h"
 #include "aws_iot_log.h"
 #include "aws_iot_version.h"
@@ -8,14 +9,65 @@
 #include "aws_iot_shadow_interface.h"
 
 #include "IotData.hpp"
+#include "SpscQueue.hpp"
+#include "ShadowWindow.hpp"
 
 using namespace std;
 
+#define PUBLISH_DOC_SIZE CONFIG_PUBLISH_DOC_SIZE
+#define PUBLISH_QUEUE_DEPTH CONFIG_PUBLISH_QUEUE_DEPTH
+#define SHADOW_DELTA_HANDLERS 4
+
+/**
+ * Called from the network task with the raw JSON value of key in a
+ * shadow delta, e.g. "[0,52.5]"; json is not NUL terminated.
+ */
+typedef void (*delta_callback_t)(const char* key, const char* json, size_t len, void* context);
+
+/**
+ * A handler for one key of the shadow delta.  json comes first so the
+ * jsonStruct_t the SDK passes back is also the handler.
+ */
+typedef struct {
+	jsonStruct_t json;
+	delta_callback_t callback;
+	void* context;
+} delta_handler_t;
+
+/**
+ * A shadow update, or a binary telemetry frame, waiting in the publish
+ * queue.
+ */
+typedef struct {
+	char doc[PUBLISH_DOC_SIZE];
+	size_t len;
+	bool binary;
+	publish_callback_t callback;
+	void* context;
+} publish_request_t;
+
 class IotDataMqtt : public IotData {
 	
 	AWS_IoT_Client mqttClient;
 	char thingId[255];
 	char thingName[255];
+	char telemetryTopic[300];
+
+	SpscQueue<publish_request_t, PUBLISH_QUEUE_DEPTH> publishQueue;
+	ShadowWindow window;
+	delta_handler_t deltaHandlers[SHADOW_DELTA_HANDLERS];
+	int deltaCount;
+	volatile bool connected;
+	bool sessionOpen;
+	volatile bool networkTaskStarted;
+	volatile bool networkTaskStopRequest;
+	publish_status_t rawStatus;  // outcome of the update sendraw() waits for
+
+	static void networkTask(void*);
+	static void rawDone(publish_status_t, void*);
+	void drain();
+	IoT_Error_t update(const char*, publish_callback_t, void*);
+	IoT_Error_t publishFrame(const publish_request_t*);
 
 	const char* TAG = "shadow";
 
@@ -24,11 +76,18 @@ class IotDataMqtt : public IotData {
 	uint32_t PORT = CONFIG_AWS_IOT_MQTT_PORT;
 	
         public:
+	IotDataMqtt();
 	virtual int signup(char*,char*);
 	virtual int init(char*);
+	int onDelta(const char* key, delta_callback_t, void*);
 	virtual int send(char*, size_t, jsonStruct_t*, int);
-	virtual int sendraw(char*);
+	virtual publish_status_t sendraw(char*);
+	virtual int publishAsync(const char*, publish_callback_t, void*);
+	virtual int publishBinaryAsync(const uint8_t*, size_t, publish_callback_t, void*);
+	virtual int start();
 	virtual int close();
+	const shadow_stats_t* getStats() { return window.getStats(); }
+	bool isConnected() { return connected; }
 
 };
 
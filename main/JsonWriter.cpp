@@ -0,0 +1,167 @@
+#include <math.h>
+#include <string.h>
+
+#include "JsonWriter.hpp"
+
+static const int32_t POW10[] = { 1, 10, 100, 1000, 10000, 100000 };
+
+JsonWriter::JsonWriter(char* buf, size_t size) :
+	buf(buf), size(size), len(0), overflow(false), first(1), depth(0) {
+	if (buf && size > 0) {
+		buf[0] = 0;
+	}
+}
+
+void JsonWriter::put(char c) {
+	if (buf) {
+		if (overflow || len + 1 >= size) {
+			overflow = true;
+			return;
+		}
+		buf[len] = c;
+		buf[len + 1] = 0;
+	}
+	len++;
+}
+
+void JsonWriter::put(const char* s, size_t n) {
+	if (buf) {
+		if (overflow || len + n >= size) {
+			overflow = true;
+			return;
+		}
+		memcpy(buf + len, s, n);
+		buf[len + n] = 0;
+	}
+	len += n;
+}
+
+// Comma before every element but the first at this level.
+void JsonWriter::separator() {
+	uint32_t bit = 1u << depth;
+	if (first & bit) {
+		first &= ~bit;
+	} else {
+		put(',');
+	}
+}
+
+JsonWriter& JsonWriter::begin(char c) {
+	separator();
+	put(c);
+	if (depth < 31) {
+		depth++;
+	}
+	first |= 1u << depth;
+	return *this;
+}
+
+JsonWriter& JsonWriter::end(char c) {
+	if (depth > 0) {
+		depth--;
+	}
+	put(c);
+	return *this;
+}
+
+/**
+ * Keys are written with their colon and mark the value that follows as
+ * not needing a comma.
+ */
+JsonWriter& JsonWriter::keyName(const char* name, size_t n) {
+	separator();
+	put('"');
+	put(name, n);
+	put("\":", 2);
+	first |= 1u << depth;
+	return *this;
+}
+
+JsonWriter& JsonWriter::value(const char* s) {
+	static const char HEX[] = "0123456789abcdef";
+	separator();
+	put('"');
+	// Runs that need no escaping go in one piece.
+	const char* run = s;
+	for (; *s; s++) {
+		unsigned char c = *s;
+		if (c != '"' && c != '\\' && c >= 0x20) {
+			continue;
+		}
+		put(run, s - run);
+		if (c < 0x20) {
+			char esc[6] = { '\\', 'u', '0', '0', HEX[c >> 4], HEX[c & 0xf] };
+			put(esc, sizeof(esc));
+		} else {
+			char esc[2] = { '\\', (char) c };
+			put(esc, sizeof(esc));
+		}
+		run = s + 1;
+	}
+	put(run, s - run);
+	put('"');
+	return *this;
+}
+
+JsonWriter& JsonWriter::value(uint32_t v) {
+	char digits[10];
+	int n = 0;
+	do {
+		digits[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+	separator();
+	while (n) {
+		put(digits[--n]);
+	}
+	return *this;
+}
+
+JsonWriter& JsonWriter::value(int32_t v) {
+	if (v >= 0) {
+		return value((uint32_t) v);
+	}
+	separator();
+	put('-');
+	first |= 1u << depth;
+	return value((uint32_t) -(int64_t) v);
+}
+
+/**
+ * Fixed point with the given number of decimals (0-5), rounded.  Values
+ * that do not fit 32 bits once scaled, and NaN, are written as null.
+ */
+JsonWriter& JsonWriter::value(float v, int decimals) {
+	if (decimals < 0) {
+		decimals = 0;
+	} else if (decimals > 5) {
+		decimals = 5;
+	}
+	float scaled = v * POW10[decimals];
+	if (!(scaled > -2147483520.0f && scaled < 2147483520.0f)) {
+		separator();
+		put("null", 4);
+		return *this;
+	}
+	int32_t fixed = (int32_t) lroundf(scaled);
+	uint32_t mag = fixed < 0 ? (uint32_t) -(int64_t) fixed : (uint32_t) fixed;
+	uint32_t whole = mag / POW10[decimals];
+	uint32_t frac = mag % POW10[decimals];
+
+	separator();
+	if (fixed < 0) {
+		put('-');
+	}
+	first |= 1u << depth;
+	value(whole);
+	if (decimals > 0) {
+		char digits[5];
+		for (int i = decimals - 1; i >= 0; i--) {
+			digits[i] = '0' + frac % 10;
+			frac /= 10;
+		}
+		put('.');
+		put(digits, decimals);
+	}
+	return *this;
+}
@@ -0,0 +1,59 @@
+#ifndef JSONWRITER_H_
+#define JSONWRITER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Streaming JSON writer into a caller supplied buffer.  No allocation and
+ * no printf: integers and fixed point floats are formatted directly, keys
+ * are string literals whose length is known at compile time, and commas
+ * are inserted automatically.
+ *
+ *   JsonWriter w(buf, sizeof(buf));
+ *   w.beginObject().key("t").beginArray().value(21.5f).endArray().endObject();
+ *   if (!w.ok()) { ... overflow ... }
+ *
+ * Writing past the end sets the overflow flag and stops output; the buffer
+ * always stays NUL terminated.  A NULL buffer measures: length() reports
+ * how long the document would be.
+ */
+class JsonWriter {
+	char* buf;
+	size_t size;
+	size_t len;
+	bool overflow;
+	uint32_t first;  // bit per nesting level: nothing written at that level yet
+	int depth;
+
+	void put(char c);
+	void put(const char* s, size_t n);
+	void separator();
+	JsonWriter& begin(char c);
+	JsonWriter& end(char c);
+	JsonWriter& keyName(const char* name, size_t n);
+
+	public:
+	JsonWriter(char* buf, size_t size);
+
+	JsonWriter& beginObject() { return begin('{'); }
+	JsonWriter& endObject() { return end('}'); }
+	JsonWriter& beginArray() { return begin('['); }
+	JsonWriter& endArray() { return end(']'); }
+
+	template<size_t N>
+	JsonWriter& key(const char (&name)[N]) { return keyName(name, N - 1); }
+	// A key that is not a literal, e.g. from a table of names; not escaped.
+	JsonWriter& key(const char* name, size_t n) { return keyName(name, n); }
+
+	JsonWriter& value(const char* s);
+	JsonWriter& value(int32_t v);
+	JsonWriter& value(uint32_t v);
+	JsonWriter& value(float v, int decimals = 1);
+
+	bool ok() { return !overflow; }
+	size_t length() { return len; }
+	const char* c_str() { return buf; }
+};
+
+#endif
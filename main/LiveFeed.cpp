@@ -0,0 +1,26 @@
+#include "LiveFeed.hpp"
+#include "JsonWriter.hpp"
+
+/**
+ * Render a sweep into the next slot and make it the latest.  Returns
+ * false, publishing nothing, if it does not fit.
+ */
+bool LiveFeed::publish(const probe_sweep_t* sweep) {
+	uint32_t seq = newest.load(std::memory_order_relaxed) + 1;
+	live_frame_t* f = &frames[seq % LIVE_FEED_FRAMES];
+	JsonWriter w(f->text, sizeof(f->text));
+	w.beginObject().key("seq").value(seq);
+	w.key("ts").value((uint32_t) sweep->timestamp);
+	w.key("t").beginArray();
+	for (int i = 0; i < sweep->count; i++) {
+		w.value(sweep->temp[i]);
+	}
+	w.endArray().endObject();
+	if (!w.ok()) {
+		return false;
+	}
+	f->seq = seq;
+	f->len = w.length();
+	newest.store(seq, std::memory_order_release);
+	return true;
+}
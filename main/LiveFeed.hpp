@@ -0,0 +1,49 @@
+#ifndef LIVEFEED_H_
+#define LIVEFEED_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+#include "ProbeSampler.hpp"
+
+#define LIVE_FEED_FRAMES 8		// power of two
+#define LIVE_FRAME_SIZE 96
+
+/**
+ * A sweep rendered once as the JSON text sent to local clients:
+ *
+ *   {"seq":1234,"ts":1500000000,"t":[21.5,104.2,63.0,20.1]}
+ */
+typedef struct {
+	uint32_t seq;
+	uint16_t len;
+	char text[LIVE_FRAME_SIZE];
+} live_frame_t;
+
+/**
+ * The last LIVE_FEED_FRAMES sweeps for the local server, written by the
+ * telemetry task and read in place by the server task, which sends the
+ * same text to every client without formatting or copying it first.
+ *
+ * A reader may use frame seq while valid(seq) holds.  That keeps one
+ * slot between it and the slot being written, and the writer adds one
+ * frame per sweep, so it would have to run LIVE_FEED_FRAMES - 1 times
+ * during a single send to reach it.  Frames are numbered from 1.
+ */
+class LiveFeed {
+	live_frame_t frames[LIVE_FEED_FRAMES];
+	std::atomic<uint32_t> newest;
+
+	public:
+	LiveFeed() : newest(0) {}
+	bool publish(const probe_sweep_t*);
+	uint32_t latest() { return newest.load(std::memory_order_acquire); }
+	bool valid(uint32_t seq) {
+		uint32_t n = latest();
+		return seq != 0 && seq <= n && n - seq < LIVE_FEED_FRAMES - 1;
+	}
+	const live_frame_t* frame(uint32_t seq) { return &frames[seq % LIVE_FEED_FRAMES]; }
+};
+
+#endif
@@ -0,0 +1,296 @@
+#include <string.h>
+#include <stdlib.h>
+
+#include <mongoose.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "sdkconfig.h"
+#include "LocalServer.hpp"
+#include "JsonWriter.hpp"
+
+#define BACKLOG_BYTES (2 * LIVE_FRAME_SIZE)
+
+static const char* TAG = "LocalServer";
+
+typedef struct {
+	struct mg_connection* nc;	// NULL when free
+	uint32_t next;				// next frame to send
+} local_client_t;
+
+static local_client_t clients[CONFIG_LOCAL_SERVER_MAX_CLIENTS];
+
+LiveFeed* LocalServer::feed;
+local_server_stats_t LocalServer::stats;
+volatile bool LocalServer::running;
+volatile bool LocalServer::stopRequest;
+#if CONFIG_HISTORY
+History* LocalServer::history;
+SemaphoreHandle_t LocalServer::historyLock;
+#endif
+
+static bool uriIs(const struct mg_str* uri, const char* path) {
+	size_t n = strlen(path);
+	return uri->len == n && memcmp(uri->p, path, n) == 0;
+}
+
+static void sendStatus(struct mg_connection* nc, int code) {
+	mg_send_head(nc, code, 0, "Content-Type: text/plain");
+	nc->flags |= MG_F_SEND_AND_CLOSE;
+}
+
+void LocalServer::handler(struct mg_connection* nc, int ev, void* evData) {
+	switch (ev) {
+	case MG_EV_HTTP_REQUEST: {
+		struct http_message* message = (struct http_message*) evData;
+#if CONFIG_HISTORY
+		if (uriIs(&message->uri, "/api/history")) {
+			stats.requests++;
+			sendHistory(nc, message);
+			break;
+		}
+#endif
+		if (!uriIs(&message->uri, "/api/temps")) {
+			sendStatus(nc, 404);
+			break;
+		}
+		stats.requests++;
+		uint32_t seq = feed->latest();
+		if (!feed->valid(seq)) {
+			sendStatus(nc, 503);
+			break;
+		}
+		const live_frame_t* f = feed->frame(seq);
+		mg_send_head(nc, 200, f->len, "Content-Type: application/json\r\nAccess-Control-Allow-Origin: *");
+		mg_send(nc, f->text, f->len);
+		nc->flags |= MG_F_SEND_AND_CLOSE;
+		break;
+	}
+	case MG_EV_WEBSOCKET_HANDSHAKE_REQUEST: {
+		struct http_message* message = (struct http_message*) evData;
+		if (!uriIs(&message->uri, "/api/stream")) {
+			sendStatus(nc, 404);
+			break;
+		}
+		local_client_t* client = NULL;
+		for (int i = 0; i < CONFIG_LOCAL_SERVER_MAX_CLIENTS && !client; i++) {
+			if (clients[i].nc == NULL) {
+				client = &clients[i];
+			}
+		}
+		if (!client) {
+			stats.refused++;
+			sendStatus(nc, 503);
+			break;
+		}
+		client->nc = nc;
+		client->next = feed->latest();	// start with the current sweep
+		nc->user_data = client;
+		if (++stats.clients > stats.maxClients) {
+			stats.maxClients = stats.clients;
+		}
+		break;
+	}
+	case MG_EV_CLOSE: {
+		local_client_t* client = (local_client_t*) nc->user_data;
+		if (client) {
+			client->nc = NULL;
+			nc->user_data = NULL;
+			stats.clients--;
+		}
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+#if CONFIG_HISTORY
+static const char* TIER_NAMES[HISTORY_TIERS] = { "raw", "1m", "10m" };
+
+typedef struct {
+	struct mg_connection* nc;
+	int sent;
+	uint32_t next;		// first point not sent, 0 if none left
+} history_reply_t;
+
+static void sendFloats(JsonWriter& w, const float* v, int n) {
+	w.beginArray();
+	for (int i = 0; i < n; i++) {
+		w.value(v[i]);
+	}
+	w.endArray();
+}
+
+// A point as an HTTP chunk, until HISTORY_MAX_POINTS have gone.
+static bool sendPoint(const history_point_t* point, void* context) {
+	history_reply_t* reply = (history_reply_t*) context;
+	if (reply->sent == HISTORY_MAX_POINTS) {
+		reply->next = point->ts;
+		return false;
+	}
+	char buf[8 + 3 * (MAX_PROBES * 8 + 2) + 24];
+	JsonWriter w(buf, sizeof(buf));
+	w.beginArray().value(point->ts);
+	if (point->period == 0) {
+		sendFloats(w, point->avg, point->probes);
+	} else {
+		w.value((uint32_t) point->count);
+		sendFloats(w, point->min, point->probes);
+		sendFloats(w, point->avg, point->probes);
+		sendFloats(w, point->max, point->probes);
+	}
+	w.endArray();
+	if (!w.ok()) {
+		return false;
+	}
+	if (reply->sent++ > 0) {
+		mg_send_http_chunk(reply->nc, ",", 1);
+	}
+	mg_send_http_chunk(reply->nc, buf, strlen(buf));
+	return true;
+}
+
+static uint32_t queryNumber(struct http_message* message, const char* name, uint32_t otherwise) {
+	char buf[16];
+	if (mg_get_http_var(&message->query_string, name, buf, sizeof(buf)) <= 0) {
+		return otherwise;
+	}
+	return (uint32_t) strtoul(buf, NULL, 10);
+}
+
+/**
+ * Answer /api/history, holding the history lock while the points are
+ * written to the connection's buffer.
+ */
+void LocalServer::sendHistory(struct mg_connection* nc, struct http_message* message) {
+	char tierName[8];
+	int tier = -1;
+	if (mg_get_http_var(&message->query_string, "tier", tierName, sizeof(tierName)) > 0) {
+		for (int i = 0; i < HISTORY_TIERS; i++) {
+			if (strcmp(tierName, TIER_NAMES[i]) == 0) {
+				tier = i;
+			}
+		}
+		if (tier < 0) {
+			sendStatus(nc, 400);
+			return;
+		}
+	}
+	uint32_t from = queryNumber(message, "from", 0);
+	uint32_t to = queryNumber(message, "to", UINT32_MAX);
+	if (from >= to) {
+		sendStatus(nc, 400);
+		return;
+	}
+
+	history_reply_t reply = { nc, 0, 0 };
+	xSemaphoreTake(historyLock, portMAX_DELAY);
+	if (tier < 0) {
+		tier = history->tierFor(from);
+	}
+	uint32_t oldest = history->oldest((history_tier_t) tier);
+	mg_send_head(nc, 200, -1, "Content-Type: application/json\r\nAccess-Control-Allow-Origin: *");
+	mg_printf_http_chunk(nc, "{\"tier\":\"%s\",\"oldest\":%u,\"p\":[", TIER_NAMES[tier], oldest);
+	history->query((history_tier_t) tier, from, to, sendPoint, &reply);
+	xSemaphoreGive(historyLock);
+	if (reply.next) {
+		mg_printf_http_chunk(nc, "],\"next\":%u}", reply.next);
+	} else {
+		mg_printf_http_chunk(nc, "]}");
+	}
+	mg_send_http_chunk(nc, "", 0);
+	nc->flags |= MG_F_SEND_AND_CLOSE;
+}
+
+/**
+ * Answer /api/history from this history from now on.  lock is held by
+ * whoever appends to it or checkpoints it.
+ */
+void LocalServer::serveHistory(History* h, SemaphoreHandle_t lock) {
+	history = h;
+	historyLock = lock;
+}
+#endif
+
+/**
+ * Send each streaming client the frames it has not had.
+ */
+void LocalServer::push() {
+	uint32_t latest = feed->latest();
+	for (int i = 0; i < CONFIG_LOCAL_SERVER_MAX_CLIENTS; i++) {
+		local_client_t* client = &clients[i];
+		if (client->nc == NULL || !(client->nc->flags & MG_F_IS_WEBSOCKET)) {
+			continue;
+		}
+		if (client->next == 0 && latest != 0) {
+			client->next = latest;	// connected before the first sweep
+		}
+		if (client->next == 0 || client->next > latest) {
+			continue;
+		}
+		if (!feed->valid(client->next) || client->nc->send_mbuf.len > BACKLOG_BYTES) {
+			stats.skipped += latest - client->next;
+			client->next = latest;
+		}
+		while (client->next <= latest && client->nc->send_mbuf.len <= BACKLOG_BYTES) {
+			const live_frame_t* f = feed->frame(client->next);
+			mg_send_websocket_frame(client->nc, WEBSOCKET_OP_TEXT, f->text, f->len);
+			client->next++;
+			stats.frames++;
+		}
+	}
+}
+
+void LocalServer::task(void*) {
+	struct mg_mgr mgr;
+	char port[8];
+
+	mg_mgr_init(&mgr, NULL);
+	snprintf(port, sizeof(port), ":%d", CONFIG_LOCAL_SERVER_PORT);
+	struct mg_connection* connection = mg_bind(&mgr, port, handler);
+	if (connection == NULL) {
+		ESP_LOGE(TAG, "Cannot listen on port %d", CONFIG_LOCAL_SERVER_PORT);
+		mg_mgr_free(&mgr);
+		running = false;
+		vTaskDelete(NULL);
+		return;
+	}
+	mg_set_protocol_http_websocket(connection);
+	ESP_LOGI(TAG, "Listening on port %d", CONFIG_LOCAL_SERVER_PORT);
+	while (!stopRequest) {
+		mg_mgr_poll(&mgr, CONFIG_LOCAL_SERVER_POLL_MS);
+		push();
+	}
+	mg_mgr_free(&mgr);
+	memset(clients, 0, sizeof(clients));
+	stats.clients = 0;
+	ESP_LOGI(TAG, "Stopped");
+	running = false;
+	vTaskDelete(NULL);
+}
+
+/**
+ * Start serving the feed.  Call once the station has an address, after
+ * bootwifi.c has stopped its own server on the same port.
+ */
+void LocalServer::start(LiveFeed* liveFeed) {
+	feed = liveFeed;
+	stopRequest = false;
+	running = true;
+	if (xTaskCreatePinnedToCore(&task, "local_server_task", 6144, NULL, 4, NULL, 0) != pdPASS) {
+		running = false;
+	}
+}
+
+/**
+ * Close the port and end the server task, waiting until it has, e.g.
+ * before bootwifi.c listens on the same port as an access point.
+ */
+void LocalServer::stop() {
+	stopRequest = true;
+	while (running) {
+		vTaskDelay(CONFIG_LOCAL_SERVER_POLL_MS / portTICK_PERIOD_MS + 1);
+	}
+}
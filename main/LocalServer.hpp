@@ -0,0 +1,76 @@
+#ifndef LOCALSERVER_H_
+#define LOCALSERVER_H_
+
+#include <stdint.h>
+
+#include "sdkconfig.h"
+#include "LiveFeed.hpp"
+
+#if CONFIG_HISTORY
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "History.hpp"
+
+#define HISTORY_MAX_POINTS 120	// per /api/history response
+#endif
+
+typedef struct {
+	uint32_t requests;		// /api/temps and /api/history
+	uint32_t clients;		// streaming now
+	uint32_t maxClients;
+	uint32_t refused;		// over CONFIG_LOCAL_SERVER_MAX_CLIENTS
+	uint32_t frames;		// sent, all clients
+	uint32_t skipped;		// not sent to a client that fell behind
+} local_server_stats_t;
+
+/**
+ * HTTP and WebSocket server for dashboards on the LAN, on mongoose in
+ * station mode.  bootwifi.c serves its setup page on the same port as an
+ * access point, so stop() runs before it falls back to one:
+ *
+ *   GET /api/temps    the latest sweep as JSON, see LiveFeed.hpp
+ *   /api/stream       WebSocket, a text frame per sweep
+ *   GET /api/history?tier=raw|1m|10m&from=ts&to=ts
+ *                     the history between two wall clock times, for a
+ *                     dashboard to backfill its graph when it connects
+ *
+ * /api/history answers with
+ *
+ *   {"tier":"1m","oldest":ts,"p":[[ts,count,[min..],[avg..],[max..]],..],"next":ts}
+ *
+ * one point per rollup, or [ts,[t..]] per sweep for the raw tier, in
+ * degC.  Without tier it picks the finest one still holding from; from
+ * defaults to the oldest point and to to now.  At most HISTORY_MAX_POINTS
+ * are sent, and "next" is there when more remain: ask again from it.
+ *
+ * Streams are capped at CONFIG_LOCAL_SERVER_MAX_CLIENTS; the rest get a
+ * 503.  The server task polls every CONFIG_LOCAL_SERVER_POLL_MS and sends
+ * each client the frames it has not had yet, straight from the feed.  A
+ * client whose unsent data backs up past a couple of frames skips to the
+ * latest sweep rather than queueing more.
+ */
+class LocalServer {
+	static LiveFeed* feed;
+	static local_server_stats_t stats;
+	static volatile bool running;
+	static volatile bool stopRequest;
+
+#if CONFIG_HISTORY
+	static History* history;
+	static SemaphoreHandle_t historyLock;
+	static void sendHistory(struct mg_connection*, struct http_message*);
+#endif
+	static void handler(struct mg_connection*, int ev, void*);
+	static void push();
+	static void task(void*);
+
+	public:
+	static void start(LiveFeed*);
+#if CONFIG_HISTORY
+	static void serveHistory(History*, SemaphoreHandle_t lock);
+#endif
+	static void stop();
+	static const local_server_stats_t* getStats() { return &stats; }
+};
+
+#endif
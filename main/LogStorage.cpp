@@ -0,0 +1,23 @@
+#include "LogStorage.hpp"
+
+#define LOG_PARTITION_SUBTYPE ((esp_partition_subtype_t) 0x40)
+
+PartitionStorage::PartitionStorage(const char* label) {
+	partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, LOG_PARTITION_SUBTYPE, label);
+}
+
+int PartitionStorage::read(uint32_t offset, void* buf, size_t len) {
+	return esp_partition_read(partition, offset, buf, len);
+}
+
+int PartitionStorage::write(uint32_t offset, const void* buf, size_t len) {
+	return esp_partition_write(partition, offset, buf, len);
+}
+
+int PartitionStorage::erase(uint32_t offset, size_t len) {
+	return esp_partition_erase_range(partition, offset, len);
+}
+
+size_t PartitionStorage::size() {
+	return partition ? partition->size : 0;
+}
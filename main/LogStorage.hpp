@@ -0,0 +1,42 @@
+#ifndef LOGSTORAGE_H_
+#define LOGSTORAGE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_partition.h"
+
+#define LOG_SEGMENT_SIZE 4096 // flash sector, the unit of erase
+
+/**
+ * Raw storage under the sweep log: NOR flash semantics, i.e. writes can
+ * only clear bits and erase() sets whole segments back to 0xFF.  Offsets
+ * are bytes from the start of the area.  Methods return 0 on success.
+ * A file-backed implementation lets the log run off-device.
+ */
+class LogStorage {
+	public:
+	virtual int read(uint32_t offset, void*, size_t) = 0;
+	virtual int write(uint32_t offset, const void*, size_t) = 0;
+	virtual int erase(uint32_t offset, size_t) = 0;
+	virtual size_t size() = 0;
+	virtual ~LogStorage() {}
+};
+
+/**
+ * Log storage in a data partition, by default "telemetry" in
+ * partitions.csv.
+ */
+class PartitionStorage : public LogStorage {
+	const esp_partition_t* partition;
+
+	public:
+	PartitionStorage(const char* label);
+	bool valid() { return partition != NULL; }
+	virtual int read(uint32_t, void*, size_t);
+	virtual int write(uint32_t, const void*, size_t);
+	virtual int erase(uint32_t, size_t);
+	virtual size_t size();
+};
+
+#endif
@@ -0,0 +1,142 @@
+#include "Metrics.hpp"
+
+#if CONFIG_METRICS
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "freertos/portable.h"
+
+#include "JsonWriter.hpp"
+
+static const char* TAG = "metrics";
+
+static const char* TIMER_NAMES[METRIC_TIMERS] = {
+	"adc", "convert", "encode", "rtt", "yield", "sample"
+};
+
+static const char* COUNTER_NAMES[METRIC_COUNTERS] = {
+	"mqttReconnects", "change", "heartbeat", "held"
+};
+
+static const char* GAUGE_NAMES[METRIC_GAUGES] = {
+	"intervalMs", "deadband", "urgency"
+};
+
+metric_timer_stats_t Metrics::timers[METRIC_TIMERS];
+uint32_t Metrics::counters[METRIC_COUNTERS];
+uint32_t Metrics::gauges[METRIC_GAUGES];
+TaskHandle_t Metrics::tasks[METRICS_MAX_TASKS];
+const char* Metrics::taskNames[METRICS_MAX_TASKS];
+
+void Metrics::record(metric_timer_t id, uint32_t us) {
+	metric_timer_stats_t* t = &timers[id];
+	t->count++;
+	t->lastUs = us;
+	t->totalUs += us;
+	if (us > t->maxUs) {
+		t->maxUs = us;
+	}
+}
+
+/**
+ * Report the calling task's stack high-water mark from now on.  The task
+ * must not be deleted afterwards.
+ */
+void Metrics::watchTask(const char* name) {
+	for (int i = 0; i < METRICS_MAX_TASKS; i++) {
+		if (tasks[i] == NULL) {
+			taskNames[i] = name;
+			tasks[i] = xTaskGetCurrentTaskHandle();
+			return;
+		}
+	}
+}
+
+/**
+ * The "metrics" object of the shadow's reported state, but for the
+ * counters:
+ *
+ * "metrics":{"t":{"adc":[count,avg,max],...},"g":{"intervalMs":n,...},
+ *     "stack":{"sampler":free,...},"heap":[free,minFree]}
+ *
+ * Times are in microseconds, stack in bytes never used.  Gauges are as
+ * last set, 0 if never.
+ */
+void Metrics::write(JsonWriter& w) {
+	w.key("metrics").beginObject();
+	w.key("t").beginObject();
+	for (int i = 0; i < METRIC_TIMERS; i++) {
+		const metric_timer_stats_t* t = &timers[i];
+		w.key(TIMER_NAMES[i], strlen(TIMER_NAMES[i])).beginArray();
+		w.value(t->count);
+		w.value(t->count ? (uint32_t)(t->totalUs / t->count) : 0u);
+		w.value(t->maxUs);
+		w.endArray();
+	}
+	w.endObject();
+	w.key("g").beginObject();
+	for (int i = 0; i < METRIC_GAUGES; i++) {
+		w.key(GAUGE_NAMES[i], strlen(GAUGE_NAMES[i])).value(gauges[i]);
+	}
+	w.endObject();
+	w.key("stack").beginObject();
+	for (int i = 0; i < METRICS_MAX_TASKS && tasks[i]; i++) {
+		w.key(taskNames[i], strlen(taskNames[i])).value((uint32_t) uxTaskGetStackHighWaterMark(tasks[i]));
+	}
+	w.endObject();
+	w.key("heap").beginArray();
+	w.value((uint32_t) esp_get_free_heap_size());
+	w.value((uint32_t) xPortGetMinimumEverFreeHeapSize());
+	w.endArray();
+	w.endObject();
+}
+
+/**
+ * The counters, a second update to the same "metrics" object so neither
+ * outgrows a publish slot:
+ *
+ * "metrics":{"c":{"mqttReconnects":n,...,"sent":n,"accepted":n,"rejected":n,
+ *     "timeouts":n,"failed":n,"inflight":n}}
+ *
+ * The last six are the shadow updates' since boot, from shadow.
+ */
+void Metrics::writeCounters(JsonWriter& w, const shadow_stats_t* shadow) {
+	w.key("metrics").beginObject();
+	w.key("c").beginObject();
+	for (int i = 0; i < METRIC_COUNTERS; i++) {
+		w.key(COUNTER_NAMES[i], strlen(COUNTER_NAMES[i])).value(counters[i]);
+	}
+	w.key("sent").value(shadow->sent);
+	w.key("accepted").value(shadow->accepted);
+	w.key("rejected").value(shadow->rejected);
+	w.key("timeouts").value(shadow->timeouts);
+	w.key("failed").value(shadow->failed);
+	w.key("inflight").value((uint32_t) shadow->inflight);
+	w.endObject();
+	w.endObject();
+}
+
+/**
+ * Log everything in a readable form.
+ */
+void Metrics::dump() {
+	for (int i = 0; i < METRIC_TIMERS; i++) {
+		const metric_timer_stats_t* t = &timers[i];
+		ESP_LOGI(TAG, "%-8s %8u calls, avg %6u us, max %6u us, last %6u us", TIMER_NAMES[i],
+			t->count, t->count ? (uint32_t)(t->totalUs / t->count) : 0, t->maxUs, t->lastUs);
+	}
+	for (int i = 0; i < METRIC_COUNTERS; i++) {
+		ESP_LOGI(TAG, "%-14s %8u", COUNTER_NAMES[i], counters[i]);
+	}
+	for (int i = 0; i < METRIC_GAUGES; i++) {
+		ESP_LOGI(TAG, "%-14s %8u", GAUGE_NAMES[i], gauges[i]);
+	}
+	for (int i = 0; i < METRICS_MAX_TASKS && tasks[i]; i++) {
+		ESP_LOGI(TAG, "stack %-10s %u bytes free", taskNames[i], (uint32_t) uxTaskGetStackHighWaterMark(tasks[i]));
+	}
+	ESP_LOGI(TAG, "heap %u free, %u lowest", (uint32_t) esp_get_free_heap_size(), (uint32_t) xPortGetMinimumEverFreeHeapSize());
+}
+
+#endif
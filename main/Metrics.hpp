@@ -0,0 +1,116 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+/**
+ * Runtime metrics: timers around the hot paths, event counters, gauges
+ * holding the latest value of a setting chosen at run time, and
+ * stack/heap high-water marks.  Published as the "metrics" section of
+ * the shadow, in two updates that the shadow merges, and dumped to the
+ * log every CONFIG_METRICS_INTERVAL_S.
+ *
+ * Use the METRIC_* macros, which compile to nothing without
+ * CONFIG_METRICS.  Updates are not locked: each timer, counter and gauge
+ * is only written from one task, and a torn read just skews one report.
+ */
+
+typedef enum {
+	METRIC_ADC_READ,	// all reads of one sweep
+	METRIC_CONVERT,		// code to temperature and filters, one sweep
+	METRIC_ENCODE,		// one telemetry document or frame
+	METRIC_SHADOW_RTT,	// shadow update to ack
+	METRIC_YIELD,		// one aws_iot_shadow_yield() call
+	METRIC_SAMPLE,		// telemetry task, one sample from dequeue to publish
+	METRIC_TIMERS
+} metric_timer_t;
+
+typedef enum {
+	METRIC_MQTT_RECONNECTS,
+	METRIC_PUBLISH_CHANGE,		// sweeps published for a change past the deadband
+	METRIC_PUBLISH_HEARTBEAT,	// and for a long silence
+	METRIC_SWEEPS_HELD,			// sweeps not published
+	METRIC_COUNTERS
+} metric_counter_t;
+
+typedef enum {
+	METRIC_SAMPLE_INTERVAL,	// ms between sweeps
+	METRIC_DEADBAND,		// publish deadband, hundredths of a degC
+	METRIC_URGENCY,			// rate controller urgency, percent
+	METRIC_GAUGES
+} metric_gauge_t;
+
+typedef struct {
+	uint32_t count;
+	uint32_t lastUs;
+	uint32_t maxUs;
+	uint64_t totalUs;
+} metric_timer_stats_t;
+
+#if CONFIG_METRICS
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "xtensa/hal.h"
+
+#include "ShadowWindow.hpp"
+
+class JsonWriter;
+
+#define METRICS_MAX_TASKS 6
+
+class Metrics {
+	static metric_timer_stats_t timers[METRIC_TIMERS];
+	static uint32_t counters[METRIC_COUNTERS];
+	static uint32_t gauges[METRIC_GAUGES];
+	static TaskHandle_t tasks[METRICS_MAX_TASKS];
+	static const char* taskNames[METRICS_MAX_TASKS];
+
+	public:
+	static void record(metric_timer_t id, uint32_t us);
+	static void count(metric_counter_t id) { counters[id]++; }
+	static void set(metric_gauge_t id, uint32_t value) { gauges[id] = value; }
+	static void watchTask(const char* name);
+	static void write(JsonWriter&);
+	static void writeCounters(JsonWriter&, const shadow_stats_t*);
+	static void dump();
+	static const metric_timer_stats_t* getTimer(metric_timer_t id) { return &timers[id]; }
+	static uint32_t getCounter(metric_counter_t id) { return counters[id]; }
+	static uint32_t getGauge(metric_gauge_t id) { return gauges[id]; }
+};
+
+/**
+ * Times its scope with the CPU cycle counter.
+ */
+class MetricScope {
+	metric_timer_t id;
+	uint32_t start;
+
+	public:
+	MetricScope(metric_timer_t id) : id(id), start(xthal_get_ccount()) {}
+	~MetricScope() {
+		Metrics::record(id, (xthal_get_ccount() - start) / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ);
+	}
+};
+
+#define METRIC_JOIN2(a, b) a##b
+#define METRIC_JOIN(a, b) METRIC_JOIN2(a, b)
+#define METRIC_TIME(id) MetricScope METRIC_JOIN(metricScope, __LINE__)(id)
+#define METRIC_RECORD_US(id, us) Metrics::record(id, us)
+#define METRIC_COUNT(id) Metrics::count(id)
+#define METRIC_SET(id, value) Metrics::set(id, value)
+#define METRIC_WATCH_TASK(name) Metrics::watchTask(name)
+
+#else
+
+#define METRIC_TIME(id)
+#define METRIC_RECORD_US(id, us)
+#define METRIC_COUNT(id)
+#define METRIC_SET(id, value)
+#define METRIC_WATCH_TASK(name)
+
+#endif
+
+#endif
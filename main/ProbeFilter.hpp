@@ -0,0 +1,105 @@
+#ifndef PROBEFILTER_H_
+#define PROBEFILTER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Noise filter applied to each converted probe value before the delta
+ * check.  Filters can be chained with setNext(); all state lives in the
+ * object so they can be allocated statically.
+ */
+class ProbeFilter {
+	ProbeFilter* next;
+
+	protected:
+	virtual float apply(float) = 0;
+
+	public:
+	ProbeFilter() : next(NULL) {}
+	virtual ~ProbeFilter() {}
+	virtual void reset() = 0;
+
+	ProbeFilter* setNext(ProbeFilter* f) {
+		next = f;
+		return f;
+	}
+
+	float filter(float v) {
+		v = apply(v);
+		return next ? next->filter(v) : v;
+	}
+};
+
+/**
+ * Median of the last N values, held in a ring buffer.  Rejects single
+ * sample spikes without smearing steps the way an average does.
+ */
+template<int N>
+class MedianFilter : public ProbeFilter {
+	static_assert(N > 0 && N <= 15, "median window must be 1..15");
+	float ring[N];
+	int head;
+	int fill;
+
+	protected:
+	virtual float apply(float v) {
+		if (N == 1) {
+			return v;
+		}
+		ring[head] = v;
+		head = (head + 1) % N;
+		if (fill < N) {
+			fill++;
+		}
+		// Insertion sort of a copy; N is small.
+		float sorted[N];
+		for (int i = 0; i < fill; i++) {
+			float x = ring[i];
+			int j = i;
+			while (j > 0 && sorted[j - 1] > x) {
+				sorted[j] = sorted[j - 1];
+				j--;
+			}
+			sorted[j] = x;
+		}
+		return sorted[fill / 2];
+	}
+
+	public:
+	MedianFilter() { reset(); }
+	virtual void reset() {
+		head = 0;
+		fill = 0;
+	}
+};
+
+/**
+ * Exponential moving average, y += alpha * (x - y).  The first value
+ * seeds the average so there is no ramp up from zero.
+ */
+class EmaFilter : public ProbeFilter {
+	float alpha;
+	float y;
+	bool primed;
+
+	protected:
+	virtual float apply(float v) {
+		if (!primed) {
+			y = v;
+			primed = true;
+		} else {
+			y += alpha * (v - y);
+		}
+		return y;
+	}
+
+	public:
+	EmaFilter(float alpha) : alpha(alpha) { reset(); }
+	virtual void reset() {
+		primed = false;
+		y = 0;
+	}
+};
+
+#endif
@@ -0,0 +1,70 @@
+#include "ProbeSampler.hpp"
+#include "BootClock.hpp"
+#include "Metrics.hpp"
+
+ProbeSampler::ProbeSampler(AdcReader& adc, const probe_channel_t* channels, int count) :
+	adc(adc), channels(channels), count(count > MAX_PROBES ? MAX_PROBES : count), oversampleBits(0) {
+	for (int i = 0; i < MAX_PROBES; i++) {
+		filters[i] = NULL;
+	}
+}
+
+/**
+ * Configure every channel in the table.
+ */
+void ProbeSampler::init() {
+	for (int i = 0; i < count; i++) {
+		adc.configure(channels[i].channel);
+	}
+}
+
+/**
+ * Read each channel 2^bits times per sweep and convert the sum, which
+ * keeps the extra resolution instead of rounding it back to 12 bits.
+ */
+void ProbeSampler::setOversample(int bits) {
+	oversampleBits = bits < 0 ? 0 : bits > MAX_OVERSAMPLE_BITS ? MAX_OVERSAMPLE_BITS : bits;
+}
+
+/**
+ * Filter (or chain of filters) run on a probe's converted value.  NULL
+ * disables filtering for the probe.
+ */
+void ProbeSampler::setFilter(int probe, ProbeFilter* filter) {
+	if (probe >= 0 && probe < MAX_PROBES) {
+		filters[probe] = filter;
+	}
+}
+
+/**
+ * Read all channels back to back and convert them.  The timestamp is taken
+ * once, before the reads, so all probes in a sweep share it; before the
+ * wall clock is set it is seconds since boot (see BootClock).
+ */
+void ProbeSampler::sweep(probe_sweep_t* out) {
+	uint32_t sum[MAX_PROBES];
+	const int reads = 1 << oversampleBits;
+
+	out->timestamp = BootClock::now();
+	out->count = count;
+	for (int i = 0; i < count; i++) {
+		sum[i] = 0;
+	}
+	// Interleave channels so a burst spans the same time window on each.
+	{
+		METRIC_TIME(METRIC_ADC_READ);
+		for (int n = 0; n < reads; n++) {
+			for (int i = 0; i < count; i++) {
+				sum[i] += adc.read(channels[i].channel);
+			}
+		}
+	}
+	METRIC_TIME(METRIC_CONVERT);
+	for (int i = 0; i < count; i++) {
+		out->raw[i] = sum[i] >> oversampleBits;
+		out->temp[i] = channels[i].convert(sum[i], oversampleBits);
+		if (filters[i]) {
+			out->temp[i] = filters[i]->filter(out->temp[i]);
+		}
+	}
+}
@@ -0,0 +1,52 @@
+#ifndef PROBESAMPLER_H_
+#define PROBESAMPLER_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include "AdcReader.hpp"
+#include "ProbeFilter.hpp"
+
+#define MAX_PROBES 4
+
+#define MAX_OVERSAMPLE_BITS 6
+
+/**
+ * One temperature probe: the ADC1 channel it is wired to and the
+ * conversion from raw code to degrees C for its thermistor, normally
+ * &ThermistorTable<...>::interpolate.  The code passed to convert carries
+ * fracBits bits below the ADC LSB when oversampling.
+ */
+typedef struct {
+	adc1_channel_t channel;
+	float (*convert)(uint32_t code, int fracBits);
+} probe_channel_t;
+
+/**
+ * All probes read in one sweep, stamped once.
+ */
+typedef struct {
+	time_t timestamp;
+	int count;
+	uint16_t raw[MAX_PROBES];
+	float temp[MAX_PROBES];
+} probe_sweep_t;
+
+class ProbeSampler {
+
+	AdcReader& adc;
+	const probe_channel_t* channels;
+	int count;
+	int oversampleBits;
+	ProbeFilter* filters[MAX_PROBES];
+
+	public:
+	ProbeSampler(AdcReader&, const probe_channel_t*, int);
+	void init();
+	void setOversample(int bits);
+	void setFilter(int probe, ProbeFilter*);
+	void sweep(probe_sweep_t*);
+	int size() { return count; }
+};
+
+#endif
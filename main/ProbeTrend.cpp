@@ -0,0 +1,136 @@
+#include <math.h>
+
+#include "ProbeTrend.hpp"
+
+ProbeTrend::ProbeTrend(uint32_t windowS, float dropC, float stallSlope) :
+	buckets(windowS / TREND_BUCKET_S), dropC(dropC), stallSlope(stallSlope) {
+	if (buckets < 2) {
+		buckets = 2;
+	} else if (buckets > TREND_MAX_BUCKETS) {
+		buckets = TREND_MAX_BUCKETS;
+	}
+	reset();
+}
+
+void ProbeTrend::reset() {
+	head = 0;
+	count = 0;
+	sum = 0;
+	weighted = 0;
+	bucketSum = 0;
+	bucketCount = 0;
+	started = false;
+	dropped = false;
+	rising = false;
+	stalled = false;
+}
+
+/**
+ * Add a bucket to the window, sliding out the oldest once it is full.
+ * Every index moves down one, so the weighted sum loses the old sum.
+ */
+void ProbeTrend::push(int16_t y) {
+	if (count < buckets) {
+		ring[(head + count) % buckets] = y;
+		weighted += (int32_t) count * y;
+		sum += y;
+		count++;
+		return;
+	}
+	int16_t old = ring[head];
+	weighted -= sum - old;
+	weighted += (int32_t) (buckets - 1) * y;
+	sum += y - old;
+	ring[head] = y;
+	head = (head + 1) % buckets;
+}
+
+/**
+ * Least squares slope over the window in degC/min, NAN until it holds
+ * two buckets.
+ */
+float ProbeTrend::slope() {
+	if (count < 2) {
+		return NAN;
+	}
+	float n = count;
+	float sx = n * (n - 1) / 2;
+	float sxx = (n - 1) * n * (2 * n - 1) / 6;
+	float perBucket = (n * weighted - sx * sum) / (n * sxx - sx * sx);
+	return perBucket / 10 * 60 / TREND_BUCKET_S;
+}
+
+/**
+ * Take a sweep, ts in seconds.  Returns the event it caused, if any.
+ */
+trend_event_t ProbeTrend::update(uint32_t ts, float t) {
+	if (isnan(t)) {
+		return TREND_NONE;
+	}
+	long q = lroundf(t * 10);
+	int16_t v = (int16_t) (q < INT16_MIN ? INT16_MIN : q > INT16_MAX ? INT16_MAX : q);
+	uint32_t windowS = (uint32_t) buckets * TREND_BUCKET_S;
+
+	// A clock step or a long gap leaves nothing to compare with.
+	if (started && (ts < bucketStart || ts - bucketStart > windowS)) {
+		reset();
+	}
+	if (!started) {
+		started = true;
+		bucketStart = ts - ts % TREND_BUCKET_S;
+		lastBucket = v;
+	}
+
+	if (dropped) {
+		if (t >= dropFrom - dropC / 2) {
+			dropped = false;
+			return TREND_DROP_END;
+		}
+		if (ts - dropTs >= windowS) {
+			// Not coming back; carry on from here.
+			reset();
+			return TREND_DROP_END;
+		}
+		return TREND_NONE;
+	}
+	if (lastBucket / 10.0f - t > dropC) {
+		dropped = true;
+		dropFrom = lastBucket / 10.0f;
+		dropTs = ts;
+		bucketSum = 0;
+		bucketCount = 0;
+		bucketStart = ts - ts % TREND_BUCKET_S;
+		return TREND_DROP;
+	}
+
+	trend_event_t event = TREND_NONE;
+	if (ts - bucketStart >= TREND_BUCKET_S) {
+		if (bucketCount > 0) {
+			int32_t avg = (bucketSum + (bucketSum >= 0 ? bucketCount / 2 : -bucketCount / 2)) / bucketCount;
+			lastBucket = (int16_t) avg;
+			push(lastBucket);
+		}
+		bucketStart = ts - ts % TREND_BUCKET_S;
+		bucketSum = 0;
+		bucketCount = 0;
+
+		if (count == buckets) {
+			float s = slope();
+			float at = lastBucket / 10.0f;
+			if (s > 2 * stallSlope && at < TREND_STALL_MAX) {
+				rising = true;
+			}
+			if (!stalled && rising && s < stallSlope && at >= TREND_STALL_MIN && at <= TREND_STALL_MAX) {
+				stalled = true;
+				event = TREND_STALL;
+			} else if (stalled && (s > 2 * stallSlope || at > TREND_STALL_MAX)) {
+				stalled = false;
+				rising = false;
+				event = TREND_STALL_END;
+			}
+		}
+	}
+	bucketSum += v;
+	bucketCount++;
+	return event;
+}
@@ -0,0 +1,73 @@
+#ifndef PROBETREND_H_
+#define PROBETREND_H_
+
+#include <stdint.h>
+
+#define TREND_BUCKET_S 30			// seconds averaged into each window point
+#define TREND_MAX_BUCKETS 64
+#define TREND_STALL_MIN 60.0f		// degC band a stall is looked for in
+#define TREND_STALL_MAX 80.0f
+
+typedef enum {
+	TREND_NONE,
+	TREND_STALL,		// slope fell to a plateau partway through a cook
+	TREND_STALL_END,
+	TREND_DROP,			// sudden fall: lid open, probe pulled out
+	TREND_DROP_END
+} trend_event_t;
+
+/**
+ * Streaming slope and event detection for one probe.
+ *
+ * Sweeps are averaged into TREND_BUCKET_S buckets, in 0.1 degC, and the
+ * slope is a least squares line through the last windowS of buckets.  The
+ * window's sums are kept as exact integers and slid in O(1), so a sweep
+ * costs the same however long the window.
+ *
+ * A drop is a sweep dropS below the last bucket's average.  Sweeps are
+ * left out of the window until the probe comes back to within half of
+ * that, or for at most a window, after which the window starts afresh.
+ *
+ * A stall is the slope falling below stallSlope (degC/min) between
+ * TREND_STALL_MIN and TREND_STALL_MAX after the probe had been rising at
+ * twice that, the way a brisket plateaus while its surface evaporates.
+ * It ends once the slope is back above twice stallSlope.  A pit holding
+ * its temperature is above the band.
+ *
+ * No ESP-IDF dependencies.
+ */
+class ProbeTrend {
+	int buckets;		// window length
+	float dropC;
+	float stallSlope;
+
+	int16_t ring[TREND_MAX_BUCKETS];
+	int head;			// oldest bucket
+	int count;
+	int32_t sum;		// sum of y
+	int32_t weighted;	// sum of i * y, i = 0 oldest
+
+	uint32_t bucketStart;
+	int32_t bucketSum;
+	int32_t bucketCount;
+	int16_t lastBucket;
+	bool started;
+
+	bool dropped;
+	float dropFrom;
+	uint32_t dropTs;
+	bool rising;
+	bool stalled;
+
+	void push(int16_t y);
+
+	public:
+	ProbeTrend(uint32_t windowS, float dropC, float stallSlope);
+	void reset();
+	trend_event_t update(uint32_t ts, float t);
+	float slope();
+	bool isStalled() { return stalled; }
+	bool isDropped() { return dropped; }
+};
+
+#endif
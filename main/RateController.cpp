@@ -0,0 +1,98 @@
+#include <math.h>
+
+#include "RateController.hpp"
+
+RateController::RateController(const rate_config_t* c) :
+	config(*c), publishedMs(0), havePublished(false), movedMs(0), settling(false), refMs(0), haveRef(false),
+	urgency(0), interval(c->maxIntervalMs), deadband(c->maxDeadband) {
+	for (int i = 0; i < MAX_PROBES; i++) {
+		slope[i] = 0;
+	}
+}
+
+static float limitUrgency(float t, float limit, float nearLimit) {
+	if (isnan(limit)) {
+		return 0;
+	}
+	return 1 - fabsf(t - limit) / nearLimit;
+}
+
+/**
+ * Take a sweep at nowMs and decide whether to publish it.  lower and
+ * upper are the alarm limits per probe, NAN for none; either may be NULL.
+ * Sets the interval to the next sweep.
+ */
+rate_decision_t RateController::update(uint32_t nowMs, const probe_sweep_t* sweep, const float* lower,
+		const float* upper) {
+	int count = sweep->count < MAX_PROBES ? sweep->count : MAX_PROBES;
+
+	if (!haveRef) {
+		haveRef = true;
+		refMs = nowMs;
+		for (int i = 0; i < count; i++) {
+			refT[i] = sweep->temp[i];
+		}
+	} else if (nowMs - refMs >= RATE_SLOPE_WINDOW_MS) {
+		float minutes = (nowMs - refMs) / 60000.0f;
+		for (int i = 0; i < count; i++) {
+			slope[i] = (sweep->temp[i] - refT[i]) / minutes;
+			refT[i] = sweep->temp[i];
+		}
+		refMs = nowMs;
+	}
+
+	// Each probe gets its own urgency and deadband, so a steady pit is not
+	// published at the resolution of a meat coming up to its limit.
+	float u = 0;
+	bool nearLimit = false;
+	bool moved = false;
+	for (int i = 0; i < count; i++) {
+		float t = sweep->temp[i];
+		float l = lower ? limitUrgency(t, lower[i], config.nearLimit) : 0;
+		float h = upper ? limitUrgency(t, upper[i], config.nearLimit) : 0;
+		nearLimit = nearLimit || l > 0 || h > 0;
+		float p = fmaxf(fabsf(slope[i]) / config.fastSlope, fmaxf(l, h));
+		p = p > 1 ? 1 : p;
+		u = fmaxf(u, p);
+		float band = config.maxDeadband - p * (config.maxDeadband - config.minDeadband);
+		if (havePublished && fabsf(t - published[i]) > band) {
+			moved = true;
+		}
+	}
+	urgency = u;
+	// Anywhere in the band a noisy probe can be over the limit and back
+	// between two slower sweeps, so it is sampled as fast as it can be.
+	interval = nearLimit ? config.minIntervalMs :
+		config.maxIntervalMs - (uint32_t) (urgency * (config.maxIntervalMs - config.minIntervalMs));
+	deadband = config.maxDeadband - urgency * (config.maxDeadband - config.minDeadband);
+
+	// A move is only published once it has lasted settleMs: a lid opened
+	// and closed again, or a probe knocked, costs nothing.  Crossing a
+	// limit is reported by the alarms as it happens, not through here.
+	rate_decision_t decision = RATE_HOLD;
+	if (!havePublished) {
+		decision = RATE_CHANGE;
+	} else if (moved) {
+		if (!settling) {
+			settling = true;
+			movedMs = nowMs;
+		}
+		if (nowMs - movedMs >= config.settleMs) {
+			decision = RATE_CHANGE;
+		}
+	} else {
+		settling = false;
+		if (config.maxSilenceMs && nowMs - publishedMs >= config.maxSilenceMs) {
+			decision = RATE_HEARTBEAT;
+		}
+	}
+	if (decision != RATE_HOLD) {
+		havePublished = true;
+		settling = false;
+		publishedMs = nowMs;
+		for (int i = 0; i < count; i++) {
+			published[i] = sweep->temp[i];
+		}
+	}
+	return decision;
+}
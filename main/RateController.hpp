@@ -0,0 +1,67 @@
+#ifndef RATECONTROLLER_H_
+#define RATECONTROLLER_H_
+
+#include <stdint.h>
+
+#include "ProbeSampler.hpp"
+
+#define RATE_SLOPE_WINDOW_MS 30000	// slopes are taken over at least this
+
+typedef struct {
+	uint32_t minIntervalMs;		// sampling when urgent
+	uint32_t maxIntervalMs;		// and when steady
+	float minDeadband;			// degC change published when urgent
+	float maxDeadband;			// and when steady
+	float fastSlope;			// degC/min that is fully urgent
+	float nearLimit;			// degC from a limit that starts to be urgent
+	uint32_t maxSilenceMs;		// publish at least this often, 0 never
+	uint32_t settleMs;			// a move lasts this long before it is published
+} rate_config_t;
+
+typedef enum {
+	RATE_HOLD,			// nothing worth publishing
+	RATE_CHANGE,		// a probe held past its deadband for settleMs
+	RATE_HEARTBEAT		// nothing moved for maxSilenceMs
+} rate_decision_t;
+
+/**
+ * Adaptive sample and publish rates.  Each probe gets an urgency from 0
+ * to 1, the higher of how fast it is changing against fastSlope and how
+ * close it is to its lower or upper alarm limit against nearLimit, and
+ * its own publish deadband slides between the bounds with it: a steady
+ * pit is only published once it moves maxDeadband, a meat at its limit
+ * for every minDeadband.  The sample interval follows the highest
+ * urgency, and is minIntervalMs while any probe is within nearLimit of a
+ * limit, as noise can take it over and back between two slower sweeps.
+ *
+ * The deadband is measured from the last published value, not the
+ * previous sweep, so a slow ramp is still reported.  A probe has to stay
+ * past it for settleMs before the sweep is published, so a lid opened
+ * and closed again costs nothing; the alarms report a limit crossing as
+ * it happens.  update() assumes the sweep is sent (or logged) whenever
+ * it says so.  No ESP-IDF dependencies.
+ */
+class RateController {
+	rate_config_t config;
+	float published[MAX_PROBES];
+	uint32_t publishedMs;
+	bool havePublished;
+	uint32_t movedMs;			// a probe first moved past its deadband
+	bool settling;
+	float refT[MAX_PROBES];
+	uint32_t refMs;
+	bool haveRef;
+	float slope[MAX_PROBES];	// degC/min
+	float urgency;
+	uint32_t interval;
+	float deadband;
+
+	public:
+	RateController(const rate_config_t*);
+	rate_decision_t update(uint32_t nowMs, const probe_sweep_t*, const float* lower, const float* upper);
+	uint32_t intervalMs() { return interval; }
+	float getDeadband() { return deadband; }	// the smallest over the probes
+	float getUrgency() { return urgency; }
+};
+
+#endif
@@ -0,0 +1,130 @@
+#include <string.h>
+
+#include "SampleBatch.hpp"
+#include "JsonWriter.hpp"
+
+SampleBatch::SampleBatch(int maxSamples, uint32_t maxLatencyMs) :
+	head(0), count(0), firstMs(0),
+	maxSamples(maxSamples < 1 ? 1 : maxSamples > BATCH_CAPACITY ? BATCH_CAPACITY : maxSamples),
+	maxLatencyMs(maxLatencyMs) {
+	memset(&stats, 0, sizeof(stats));
+}
+
+void SampleBatch::push(const probe_sweep_t* sweep, uint32_t nowMs) {
+	if (count == 0) {
+		firstMs = nowMs;
+	}
+	ring[(head + count) % BATCH_CAPACITY] = *sweep;
+	if (count < BATCH_CAPACITY) {
+		count++;
+	} else {
+		head = (head + 1) % BATCH_CAPACITY;
+		stats.dropped++;
+	}
+}
+
+bool SampleBatch::due(uint32_t nowMs) {
+	return count >= maxSamples || (count > 0 && nowMs - firstMs >= maxLatencyMs);
+}
+
+static void writeTemps(JsonWriter& w, const probe_sweep_t* s) {
+	w.beginArray();
+	for (int i = 0; i < s->count; i++) {
+		w.value(s->temp[i]);
+	}
+	w.endArray();
+}
+
+/**
+ * The shadow update for the oldest n sweeps.
+ */
+void SampleBatch::write(JsonWriter& w, int n, const char* username, const char* clientToken) {
+	w.beginObject().key("state").beginObject().key("reported").beginObject();
+	w.key("username").value(username);
+	w.key("t");
+	writeTemps(w, at(count - 1));
+	w.key("batch").beginObject().key("ts").beginArray();
+	for (int k = 0; k < n; k++) {
+		w.value((uint32_t) at(k)->timestamp);
+	}
+	w.endArray().key("t").beginArray();
+	for (int k = 0; k < n; k++) {
+		writeTemps(w, at(k));
+	}
+	w.endArray().endObject();
+	w.endObject().endObject().key("clientToken").value(clientToken).endObject();
+}
+
+/**
+ * Write the oldest buffered sweeps as one shadow update.  "t" keeps the
+ * latest value of each probe, as in an unbatched update, and "batch" holds
+ * the sweeps as parallel arrays:
+ *
+ * {"state":{"reported":{"username":"u","t":[..],
+ *     "batch":{"ts":[t0,t1,..],"t":[[..],[..],..]}}},"clientToken":"c"}
+ *
+ * Sends fewer sweeps rather than overflow buf.  Returns the number of
+ * sweeps written, which the caller passes to consume() once the publish
+ * succeeds, or -1 if not even one sweep fits.
+ */
+int SampleBatch::format(char* buf, size_t size, const char* username, const char* clientToken) {
+	if (count == 0) {
+		return -1;
+	}
+
+	// Measure the document without sweeps, then add each sweep's timestamp
+	// and row (and their commas) until the buffer is full.
+	JsonWriter base(NULL, 0);
+	write(base, 0, username, clientToken);
+	size_t used = base.length() + 1;
+	int n = 0;
+	for (; n < count && n < maxSamples; n++) {
+		const probe_sweep_t* s = at(n);
+		JsonWriter m(NULL, 0);
+		m.value((uint32_t) s->timestamp);
+		writeTemps(m, s);
+		size_t cost = m.length() - 1 + (n ? 2 : 0);
+		if (used + cost > size) {
+			break;
+		}
+		used += cost;
+	}
+	if (n == 0) {
+		return -1;
+	}
+
+	JsonWriter w(buf, size);
+	write(w, n, username, clientToken);
+	return w.ok() ? n : -1;
+}
+
+/**
+ * Drop n published sweeps from the front of the ring.
+ */
+void SampleBatch::consume(int n, uint32_t nowMs) {
+	if (n <= 0) {
+		return;
+	}
+	if (n > count) {
+		n = count;
+	}
+	head = (head + n) % BATCH_CAPACITY;
+	count -= n;
+	firstMs = nowMs;
+	stats.flushes++;
+	stats.samples += n;
+	if (n > stats.maxPerFlush) {
+		stats.maxPerFlush = n;
+	}
+}
+
+/**
+ * Rewrite the timestamp of every buffered sweep, e.g. to back-stamp sweeps
+ * taken before the wall clock was set.
+ */
+void SampleBatch::restamp(time_t (*fix)(time_t)) {
+	for (int i = 0; i < count; i++) {
+		probe_sweep_t* s = &ring[(head + i) % BATCH_CAPACITY];
+		s->timestamp = fix(s->timestamp);
+	}
+}
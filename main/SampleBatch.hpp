@@ -0,0 +1,54 @@
+#ifndef SAMPLEBATCH_H_
+#define SAMPLEBATCH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sdkconfig.h"
+#include "ProbeSampler.hpp"
+#include "JsonWriter.hpp"
+
+#define BATCH_CAPACITY CONFIG_BATCH_CAPACITY
+
+/**
+ * Batching counters, since boot.
+ */
+typedef struct {
+	uint32_t flushes;      // documents published
+	uint32_t samples;      // sweeps carried by those documents
+	uint32_t dropped;      // sweeps overwritten while the ring was full
+	uint16_t maxPerFlush;  // largest batch sent in one document
+} batch_stats_t;
+
+/**
+ * Ring buffer of sweeps waiting to be published.  Sweeps are pushed as
+ * they are taken; once maxSamples are held, or the oldest has waited
+ * maxLatencyMs, the batch is due and is sent as one shadow document.
+ * When the ring is full the oldest sweep is dropped.
+ */
+class SampleBatch {
+
+	probe_sweep_t ring[BATCH_CAPACITY];
+	int head;
+	int count;
+	uint32_t firstMs;
+	int maxSamples;
+	uint32_t maxLatencyMs;
+	batch_stats_t stats;
+
+	void write(JsonWriter&, int, const char*, const char*);
+
+	public:
+	SampleBatch(int maxSamples, uint32_t maxLatencyMs);
+	void push(const probe_sweep_t*, uint32_t nowMs);
+	bool due(uint32_t nowMs);
+	int size() { return count; }
+	const probe_sweep_t* at(int i) { return &ring[(head + i) % BATCH_CAPACITY]; }
+	void clear() { head = 0; count = 0; }
+	int format(char*, size_t, const char* username, const char* clientToken);
+	void consume(int, uint32_t nowMs);
+	void restamp(time_t (*)(time_t));
+	const batch_stats_t* getStats() { return &stats; }
+};
+
+#endif
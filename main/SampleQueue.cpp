@@ -0,0 +1,48 @@
+#include <string.h>
+
+#include "SampleQueue.hpp"
+
+SampleQueue::SampleQueue(sample_overflow_t policy) : policy(policy), hasPending(false), seq(0) {
+	memset(&stats, 0, sizeof(stats));
+}
+
+/**
+ * Producer side: queue a sweep, applying the overflow policy if the
+ * consumer is behind.  Never blocks.
+ */
+void SampleQueue::push(const probe_sweep_t* sweep) {
+	sample_record_t record;
+	record.sweep = *sweep;
+	record.seq = seq++;
+	record.coalesced = 0;
+	stats.pushed++;
+
+	if (policy == SAMPLE_OVERFLOW_COALESCE) {
+		if (hasPending) {
+			if (queue.push(pending)) {
+				hasPending = false;
+			} else {
+				record.coalesced = pending.coalesced + 1;
+				stats.coalesced++;
+			}
+		}
+		if (hasPending || !queue.push(record)) {
+			pending = record;
+			hasPending = true;
+		}
+	} else if (!queue.pushOverwrite(record)) {
+		stats.dropped++;
+	}
+
+	uint32_t d = queue.size();
+	if (d > stats.maxDepth) {
+		stats.maxDepth = d;
+	}
+}
+
+/**
+ * Consumer side: take the oldest queued sweep.
+ */
+bool SampleQueue::pop(sample_record_t* record) {
+	return queue.pop(*record);
+}
@@ -0,0 +1,62 @@
+#ifndef SAMPLEQUEUE_H_
+#define SAMPLEQUEUE_H_
+
+#include <stdint.h>
+
+#include "sdkconfig.h"
+#include "ProbeSampler.hpp"
+#include "SpscQueue.hpp"
+
+#define SAMPLE_QUEUE_DEPTH CONFIG_SAMPLE_QUEUE_DEPTH
+
+typedef enum {
+	SAMPLE_OVERFLOW_DROP_OLDEST,	// the oldest queued sweep makes room
+	SAMPLE_OVERFLOW_COALESCE		// sweeps merge until there is room
+} sample_overflow_t;
+
+/**
+ * A sweep on its way from the sampler task to the telemetry task.  seq
+ * counts sweeps taken, so gaps show drops; coalesced is how many earlier
+ * sweeps this one replaced.
+ */
+typedef struct {
+	probe_sweep_t sweep;
+	uint32_t seq;
+	uint32_t coalesced;
+} sample_record_t;
+
+typedef struct {
+	uint32_t pushed;
+	uint32_t dropped;
+	uint32_t coalesced;
+	uint32_t maxDepth;
+} sample_queue_stats_t;
+
+/**
+ * Lock-free hand-off of sweeps from the sampler (producer) to the
+ * telemetry task (consumer), so a slow publish or flash write never holds
+ * up sampling.  When the consumer falls behind the overflow policy
+ * decides what is lost:
+ *
+ * DROP_OLDEST keeps the newest SAMPLE_QUEUE_DEPTH sweeps.
+ * COALESCE keeps the queued sweeps and holds one more on the producer
+ * side, which each new sweep overwrites until the queue has room; the
+ * consumer sees the latest values with a count of the sweeps merged.
+ */
+class SampleQueue {
+	SpscQueue<sample_record_t, SAMPLE_QUEUE_DEPTH> queue;
+	sample_overflow_t policy;
+	sample_record_t pending;
+	bool hasPending;
+	uint32_t seq;
+	sample_queue_stats_t stats;
+
+	public:
+	SampleQueue(sample_overflow_t policy);
+	void push(const probe_sweep_t*);
+	bool pop(sample_record_t*);
+	uint32_t depth() { return queue.size(); }
+	const sample_queue_stats_t* getStats() { return &stats; }
+};
+
+#endif
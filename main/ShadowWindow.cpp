@@ -0,0 +1,73 @@
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "ShadowWindow.hpp"
+#include "Metrics.hpp"
+
+ShadowWindow::ShadowWindow() : head(0), count(0) {
+	memset(slots, 0, sizeof(slots));
+	memset(&stats, 0, sizeof(stats));
+}
+
+/**
+ * Take the next slot for an update about to be sent, or NULL if the
+ * window is full.
+ */
+shadow_request_t* ShadowWindow::acquire(const char* token, publish_callback_t callback, void* context) {
+	if (full()) {
+		return NULL;
+	}
+	shadow_request_t* request = &slots[(head + count) % SHADOW_WINDOW];
+	request->window = this;
+	request->done = false;
+	request->status = PUBLISH_FAILED;
+	request->callback = callback;
+	request->context = context;
+	request->sentMs = esp_log_timestamp();
+	strncpy(request->token, token ? token : "", SHADOW_TOKEN_SIZE - 1);
+	request->token[SHADOW_TOKEN_SIZE - 1] = 0;
+	count++;
+	stats.sent++;
+	stats.inflight = count;
+	if (count > stats.maxInflight) {
+		stats.maxInflight = count;
+	}
+	return request;
+}
+
+/**
+ * Record the outcome of an update, from its ack or a failed send.
+ */
+void ShadowWindow::complete(shadow_request_t* request, publish_status_t status) {
+	if (request->done) {
+		return;
+	}
+	request->done = true;
+	request->status = status;
+	if (status == PUBLISH_ACCEPTED || status == PUBLISH_REJECTED) {
+		METRIC_RECORD_US(METRIC_SHADOW_RTT, (esp_log_timestamp() - request->sentMs) * 1000);
+	}
+	switch (status) {
+	case PUBLISH_ACCEPTED: stats.accepted++; break;
+	case PUBLISH_REJECTED: stats.rejected++; break;
+	case PUBLISH_TIMEOUT: stats.timeouts++; break;
+	default: stats.failed++; break;
+	}
+	retire();
+}
+
+/**
+ * Free finished slots from the oldest on, calling back in send order.
+ */
+void ShadowWindow::retire() {
+	while (count > 0 && slots[head].done) {
+		shadow_request_t* request = &slots[head];
+		head = (head + 1) % SHADOW_WINDOW;
+		count--;
+		stats.inflight = count;
+		if (request->callback) {
+			request->callback(request->status, request->context);
+		}
+	}
+}
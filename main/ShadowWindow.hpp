@@ -0,0 +1,69 @@
+#ifndef SHADOWWINDOW_H_
+#define SHADOWWINDOW_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sdkconfig.h"
+#include "IotData.hpp"
+
+#define SHADOW_WINDOW CONFIG_SHADOW_INFLIGHT_WINDOW
+#define SHADOW_TOKEN_SIZE 64
+
+class ShadowWindow;
+
+/**
+ * A shadow update sent to the broker and waiting for its ack, keyed by the
+ * clientToken of its document.  Passed as the context of
+ * aws_iot_shadow_update() so the ack finds its slot.
+ */
+typedef struct {
+	ShadowWindow* window;
+	bool done;
+	publish_status_t status;
+	publish_callback_t callback;
+	void* context;
+	uint32_t sentMs;
+	char token[SHADOW_TOKEN_SIZE];
+} shadow_request_t;
+
+/**
+ * Shadow update counters, since boot.
+ */
+typedef struct {
+	uint32_t sent;
+	uint32_t accepted;
+	uint32_t rejected;
+	uint32_t timeouts;
+	uint32_t failed;
+	uint8_t inflight;     // updates currently waiting for an ack
+	uint8_t maxInflight;  // high-water mark of inflight
+} shadow_stats_t;
+
+/**
+ * Up to SHADOW_WINDOW shadow updates in flight at once.  Acks may arrive in
+ * any order, but completions are handed to callbacks in the order the
+ * updates were sent: a finished update waits for all older ones.
+ *
+ * Not thread safe; use it from the task that yields the MQTT client, which
+ * is also where acks are delivered.
+ */
+class ShadowWindow {
+
+	shadow_request_t slots[SHADOW_WINDOW];
+	uint8_t head;
+	uint8_t count;
+	shadow_stats_t stats;
+
+	void retire();
+
+	public:
+	ShadowWindow();
+	shadow_request_t* acquire(const char* token, publish_callback_t, void*);
+	void complete(shadow_request_t*, publish_status_t);
+	int depth() { return count; }
+	bool full() { return count >= SHADOW_WINDOW; }
+	const shadow_stats_t* getStats() { return &stats; }
+};
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef SPSCQUEUE_H_
+#define SPSCQUEUE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+/**
+ * Bounded lock-free queue for exactly one producer task and one consumer
+ * task.  Slots are filled and drained in place: the producer calls
+ * reserve(), writes the slot and commit()s it; the consumer reads front()
+ * and release()s it.  push()/pop() are copying shorthands.
+ *
+ * head and tail are free-running counters, so N must be a power of two.
+ *
+ * pushOverwrite() lets the producer drop the oldest entry when the queue
+ * is full.  The consumer must then only use pop(), which notices when the
+ * entry it was copying was dropped under it and retries; T should be a
+ * plain struct for that.
+ */
+template<typename T, uint32_t N>
+class SpscQueue {
+	static_assert(N > 0 && (N & (N - 1)) == 0, "queue size must be a power of two");
+
+	T slots[N];
+	std::atomic<uint32_t> head; // next slot to read, written by the consumer
+	std::atomic<uint32_t> tail; // next slot to write, written by the producer
+
+	public:
+	SpscQueue() : head(0), tail(0) {}
+
+	// Producer side.
+	T* reserve() {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) >= N) {
+			return NULL;
+		}
+		return &slots[t % N];
+	}
+	void commit() {
+		tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+	bool push(const T& v) {
+		T* slot = reserve();
+		if (!slot) {
+			return false;
+		}
+		*slot = v;
+		commit();
+		return true;
+	}
+	// Returns false if the oldest entry was dropped to make room.
+	bool pushOverwrite(const T& v) {
+		bool dropped = false;
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		uint32_t h = head.load(std::memory_order_acquire);
+		if (t - h >= N) {
+			// Fails only if the consumer released the slot meanwhile.
+			dropped = head.compare_exchange_strong(h, h + 1, std::memory_order_acq_rel);
+		}
+		slots[t % N] = v;
+		tail.store(t + 1, std::memory_order_release);
+		return !dropped;
+	}
+
+	// Consumer side.
+	T* front() {
+		uint32_t h = head.load(std::memory_order_relaxed);
+		if (tail.load(std::memory_order_acquire) == h) {
+			return NULL;
+		}
+		return &slots[h % N];
+	}
+	void release() {
+		head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+	bool pop(T& v) {
+		uint32_t h = head.load(std::memory_order_acquire);
+		do {
+			if (tail.load(std::memory_order_acquire) == h) {
+				return false;
+			}
+			v = slots[h % N];
+		} while (!head.compare_exchange_weak(h, h + 1, std::memory_order_acq_rel, std::memory_order_acquire));
+		return true;
+	}
+
+	// Either side; a snapshot that may be stale by the time it is used.
+	uint32_t size() {
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+	uint32_t capacity() { return N; }
+};
+
+#endif
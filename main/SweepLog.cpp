@@ -0,0 +1,307 @@
+#include <string.h>
+#include <math.h>
+
+#include "SweepLog.hpp"
+
+#define SEGMENT_MAGIC 0x474c5753 // "SWLG"
+#define STATE_EMPTY 0xffffffff
+#define STATE_VALID 0x0000ffff
+#define STATE_SENT  0x00000000
+
+typedef struct {
+	uint32_t magic;
+	uint32_t seq;
+	uint32_t erases;
+	uint32_t reserved;
+} segment_header_t;
+
+typedef struct {
+	uint32_t state;
+	uint32_t timestamp;
+	int16_t temp[MAX_PROBES];  // 0.1 degC
+	uint8_t count;
+	uint8_t crc;
+	uint16_t reserved;
+} sweep_record_t;
+
+static const uint32_t RECORDS_PER_SEGMENT =
+	(LOG_SEGMENT_SIZE - sizeof(segment_header_t)) / sizeof(sweep_record_t);
+
+// CRC-8 (poly 0x07) over everything after the state word.
+static uint8_t recordCrc(const sweep_record_t* r) {
+	const uint8_t* p = (const uint8_t*) &r->timestamp;
+	const uint8_t* end = (const uint8_t*) &r->crc;
+	uint8_t crc = 0;
+	while (p < end) {
+		crc ^= *p++;
+		for (int i = 0; i < 8; i++) {
+			crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+/**
+ * A complete record that has not been sent.  A torn write leaves the
+ * fields after the tear erased, and an erased count is out of range
+ * whatever the 8 bit CRC happens to match.
+ */
+static bool recordPending(const sweep_record_t* r) {
+	return r->state == STATE_VALID && r->count <= MAX_PROBES && r->crc == recordCrc(r);
+}
+
+SweepLog::SweepLog(LogStorage& storage) :
+	storage(storage), segments(0), nextSeq(1), writeSeg(0), writeRec(0), readSeg(0), readRec(0) {
+	memset(&stats, 0, sizeof(stats));
+}
+
+uint32_t SweepLog::offset(uint32_t seg, uint32_t rec) {
+	return seg * LOG_SEGMENT_SIZE + sizeof(segment_header_t) + rec * sizeof(sweep_record_t);
+}
+
+/**
+ * Step a position forward.  Returns false once it reaches the write
+ * position, which may be one past the end of a full segment.
+ */
+bool SweepLog::next(uint32_t* seg, uint32_t* rec) {
+	++*rec;
+	if (*seg == writeSeg && *rec == writeRec) {
+		return false;
+	}
+	if (*rec == RECORDS_PER_SEGMENT) {
+		*rec = 0;
+		*seg = (*seg + 1) % segments;
+	}
+	return !(*seg == writeSeg && *rec == writeRec);
+}
+
+bool SweepLog::isPending(uint32_t seg, uint32_t rec) {
+	sweep_record_t r;
+	if (storage.read(offset(seg, rec), &r, sizeof(r)) != 0) {
+		return false;
+	}
+	return recordPending(&r);
+}
+
+uint32_t SweepLog::countPending(uint32_t seg, uint32_t rec, uint32_t endSeg, uint32_t endRec) {
+	uint32_t n = 0;
+	while (!(seg == endSeg && rec == endRec)) {
+		if (isPending(seg, rec)) {
+			n++;
+		}
+		if (!next(&seg, &rec)) {
+			break;
+		}
+	}
+	return n;
+}
+
+/**
+ * Erase a segment and stamp it as the newest.
+ */
+int SweepLog::startSegment(uint32_t seg) {
+	segment_header_t header;
+	uint32_t erases = 0;
+	if (storage.read(seg * LOG_SEGMENT_SIZE, &header, sizeof(header)) == 0 &&
+			header.magic == SEGMENT_MAGIC) {
+		erases = header.erases;
+	}
+	int rc = storage.erase(seg * LOG_SEGMENT_SIZE, LOG_SEGMENT_SIZE);
+	if (rc != 0) {
+		return rc;
+	}
+	stats.erases++;
+	header.magic = SEGMENT_MAGIC;
+	header.seq = nextSeq++;
+	header.erases = erases + 1;
+	header.reserved = STATE_EMPTY;
+	writeSeg = seg;
+	writeRec = 0;
+	return storage.write(seg * LOG_SEGMENT_SIZE, &header, sizeof(header));
+}
+
+/**
+ * Recover the read and write positions from flash.  Call once at start.
+ */
+int SweepLog::mount() {
+	segments = storage.size() / LOG_SEGMENT_SIZE;
+	if (segments < 2) {
+		return -1;
+	}
+
+	// Segments in use hold a contiguous run of sequence numbers in ring
+	// order; find the two ends.
+	uint32_t oldestSeq = 0, newestSeq = 0;
+	uint32_t oldest = 0, newest = 0;
+	bool found = false;
+	for (uint32_t seg = 0; seg < segments; seg++) {
+		segment_header_t header;
+		if (storage.read(seg * LOG_SEGMENT_SIZE, &header, sizeof(header)) != 0 ||
+				header.magic != SEGMENT_MAGIC) {
+			continue;
+		}
+		if (!found || header.seq < oldestSeq) {
+			oldestSeq = header.seq;
+			oldest = seg;
+		}
+		if (!found || header.seq > newestSeq) {
+			newestSeq = header.seq;
+			newest = seg;
+		}
+		found = true;
+	}
+	if (!found) {
+		readSeg = readRec = 0;
+		int rc = startSegment(0);
+		stats.pending = 0;
+		return rc;
+	}
+	nextSeq = newestSeq + 1;
+
+	// Writing resumes after the last used record of the newest segment.
+	writeSeg = newest;
+	writeRec = 0;
+	for (uint32_t rec = 0; rec < RECORDS_PER_SEGMENT; rec++) {
+		uint32_t state;
+		if (storage.read(offset(newest, rec), &state, sizeof(state)) == 0 && state != STATE_EMPTY) {
+			writeRec = rec + 1;
+		}
+	}
+	// A full segment leaves writeRec at the end; append() rotates.
+
+	// Reading resumes at the first unsent record from the oldest segment.
+	readSeg = oldest;
+	readRec = 0;
+	while (!(readSeg == writeSeg && readRec == writeRec) && !isPending(readSeg, readRec)) {
+		next(&readSeg, &readRec);
+	}
+	stats.pending = countPending(readSeg, readRec, writeSeg, writeRec);
+	return 0;
+}
+
+int SweepLog::append(const probe_sweep_t* sweep) {
+	if (segments < 2) {
+		return -1;
+	}
+	if (writeRec == RECORDS_PER_SEGMENT) {
+		uint32_t seg = (writeSeg + 1) % segments;
+		if (stats.pending > 0 && readSeg == seg) {
+			// Ring full: give up the oldest segment's unsent sweeps.
+			uint32_t nextSeg = (seg + 1) % segments;
+			uint32_t lost = countPending(readSeg, readRec, nextSeg, 0);
+			stats.dropped += lost;
+			stats.pending -= lost;
+			readSeg = nextSeg;
+			readRec = 0;
+		}
+		int rc = startSegment(seg);
+		if (rc != 0) {
+			return rc;
+		}
+	}
+
+	sweep_record_t r;
+	memset(&r, 0xff, sizeof(r));
+	r.state = STATE_VALID;
+	r.timestamp = (uint32_t) sweep->timestamp;
+	r.count = sweep->count > MAX_PROBES ? MAX_PROBES : sweep->count;
+	for (int i = 0; i < r.count; i++) {
+		r.temp[i] = (int16_t) lroundf(sweep->temp[i] * 10);
+	}
+	r.crc = recordCrc(&r);
+	int rc = storage.write(offset(writeSeg, writeRec), &r, sizeof(r));
+	if (rc != 0) {
+		return rc;
+	}
+	if (stats.pending == 0) {
+		readSeg = writeSeg;
+		readRec = writeRec;
+	}
+	writeRec++;
+	stats.appended++;
+	stats.pending++;
+	return 0;
+}
+
+/**
+ * Copy up to max of the oldest unsent sweeps to out, without removing
+ * them.  Returns the number copied.
+ */
+int SweepLog::peek(probe_sweep_t* out, int max) {
+	int n = 0;
+	uint32_t seg = readSeg, rec = readRec;
+	for (uint32_t left = stats.pending; left > 0 && n < max; ) {
+		sweep_record_t r;
+		if (storage.read(offset(seg, rec), &r, sizeof(r)) == 0 && recordPending(&r)) {
+			out[n].timestamp = r.timestamp;
+			out[n].count = r.count;
+			for (int i = 0; i < r.count; i++) {
+				out[n].raw[i] = 0;
+				out[n].temp[i] = r.temp[i] / 10.0f;
+			}
+			n++;
+			left--;
+		}
+		if (!next(&seg, &rec)) {
+			break;
+		}
+	}
+	return n;
+}
+
+/**
+ * Mark the n oldest unsent sweeps as sent.
+ */
+int SweepLog::consume(int n) {
+	static const uint32_t sent = STATE_SENT;
+	while (n > 0 && stats.pending > 0) {
+		if (isPending(readSeg, readRec)) {
+			int rc = storage.write(offset(readSeg, readRec), &sent, sizeof(sent));
+			if (rc != 0) {
+				return rc;
+			}
+			n--;
+			stats.pending--;
+			stats.drained++;
+		}
+		if (!next(&readSeg, &readRec)) {
+			break;
+		}
+	}
+	if (stats.pending == 0) {
+		readSeg = writeSeg;
+		readRec = writeRec;
+	}
+	return 0;
+}
+
+/**
+ * Mark every unsent sweep stamped before timestamp as sent, counting it
+ * dropped.  Returns how many there were.
+ */
+int SweepLog::dropBefore(uint32_t timestamp) {
+	static const uint32_t sent = STATE_SENT;
+	int n = 0;
+	if (stats.pending == 0) {
+		return 0;
+	}
+	uint32_t seg = readSeg, rec = readRec;
+	do {
+		sweep_record_t r;
+		if (storage.read(offset(seg, rec), &r, sizeof(r)) == 0 && recordPending(&r) && r.timestamp < timestamp) {
+			if (storage.write(offset(seg, rec), &sent, sizeof(sent)) == 0) {
+				n++;
+				stats.pending--;
+				stats.dropped++;
+			}
+		}
+	} while (next(&seg, &rec));
+	while (!(readSeg == writeSeg && readRec == writeRec) && !isPending(readSeg, readRec)) {
+		next(&readSeg, &readRec);
+	}
+	if (stats.pending == 0) {
+		readSeg = writeSeg;
+		readRec = writeRec;
+	}
+	return n;
+}
@@ -0,0 +1,60 @@
+#ifndef SWEEPLOG_H_
+#define SWEEPLOG_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "LogStorage.hpp"
+#include "ProbeSampler.hpp"
+
+/**
+ * Sweep log counters, since boot.
+ */
+typedef struct {
+	uint32_t appended;
+	uint32_t drained;
+	uint32_t dropped;   // unsent sweeps lost when the log wrapped
+	uint32_t erases;
+	uint32_t pending;   // sweeps in the log waiting to be sent
+} sweep_log_stats_t;
+
+/**
+ * Store-and-forward queue of sweeps in flash, for when there is no
+ * connection.  The storage is an append-only ring of segments (flash
+ * sectors) holding fixed size records; temperatures are kept in 0.1 degC.
+ *
+ * Each segment starts with a header carrying a sequence number, so mount()
+ * can find the oldest and newest data after a reset, and its erase count.
+ * Records are written in one go with a CRC, so a torn write is detected
+ * and skipped, and are marked sent by clearing their state word in place.
+ * Segments are reused strictly round robin, which spreads erases evenly.
+ * When the ring is full the oldest segment is erased, unsent or not, so
+ * the log never outgrows its partition.
+ */
+class SweepLog {
+
+	LogStorage& storage;
+	uint32_t segments;
+	uint32_t nextSeq;
+	uint32_t writeSeg, writeRec;  // where the next record goes
+	uint32_t readSeg, readRec;    // oldest unsent record
+	sweep_log_stats_t stats;
+
+	uint32_t offset(uint32_t seg, uint32_t rec);
+	bool next(uint32_t* seg, uint32_t* rec);
+	int startSegment(uint32_t seg);
+	bool isPending(uint32_t seg, uint32_t rec);
+	uint32_t countPending(uint32_t seg, uint32_t rec, uint32_t endSeg, uint32_t endRec);
+
+	public:
+	SweepLog(LogStorage&);
+	int mount();
+	int append(const probe_sweep_t*);
+	int peek(probe_sweep_t*, int max);
+	int consume(int n);
+	int dropBefore(uint32_t timestamp);
+	uint32_t pending() { return stats.pending; }
+	const sweep_log_stats_t* getStats() { return &stats; }
+};
+
+#endif
@@ -0,0 +1,95 @@
+#include <string.h>
+#include <math.h>
+
+#include "TelemetryCodec.hpp"
+#include "Varint.hpp"
+
+TelemetryEncoder::TelemetryEncoder(uint8_t* buf, size_t size) :
+	buf(buf), size(size), len(0), count(0), sweeps(0), lastTs(0) {
+}
+
+/**
+ * Append a sweep.  Returns false, leaving the frame as it was, if it does
+ * not fit or its probe count differs from the first sweep's.
+ */
+bool TelemetryEncoder::add(const probe_sweep_t* sweep) {
+	uint8_t tmp[1 + 5 + 5 * MAX_PROBES];
+	size_t n = 0;
+	int16_t t[MAX_PROBES];
+	uint32_t ts = (uint32_t) sweep->timestamp;
+
+	if (sweeps > 0 && sweep->count != count) {
+		return false;
+	}
+	for (int i = 0; i < sweep->count; i++) {
+		t[i] = (int16_t) lroundf(sweep->temp[i] * 10);
+	}
+	if (sweeps == 0) {
+		tmp[n++] = (TELEMETRY_CODEC_VERSION << 4) | (sweep->count & 0x0f);
+		n += putVarint(tmp + n, ts);
+		for (int i = 0; i < sweep->count; i++) {
+			n += putZigzag(tmp + n, t[i]);
+		}
+	} else {
+		n += putZigzag(tmp + n, (int32_t) (ts - lastTs));
+		for (int i = 0; i < sweep->count; i++) {
+			n += putZigzag(tmp + n, t[i] - last[i]);
+		}
+	}
+	if (len + n > size) {
+		return false;
+	}
+	memcpy(buf + len, tmp, n);
+	len += n;
+	count = sweep->count;
+	sweeps++;
+	lastTs = ts;
+	memcpy(last, t, sizeof(int16_t) * count);
+	return true;
+}
+
+TelemetryDecoder::TelemetryDecoder(const uint8_t* buf, size_t len) :
+	buf(buf), len(len), pos(0), count(0), sweeps(0), lastTs(0) {
+	if (len > 0 && (buf[0] >> 4) == TELEMETRY_CODEC_VERSION) {
+		count = buf[0] & 0x0f;
+		if (count > MAX_PROBES) {
+			count = 0;
+		}
+		pos = 1;
+	}
+}
+
+/**
+ * Decode the next sweep.  Returns false at the end of the frame or on a
+ * malformed one.
+ */
+bool TelemetryDecoder::next(probe_sweep_t* out) {
+	if (count == 0 || pos >= len) {
+		return false;
+	}
+	int32_t v;
+	uint32_t u;
+	if (sweeps == 0) {
+		if (!getVarint(buf, len, &pos, &u)) {
+			return false;
+		}
+		lastTs = u;
+	} else {
+		if (!getZigzag(buf, len, &pos, &v)) {
+			return false;
+		}
+		lastTs += v;
+	}
+	for (int i = 0; i < count; i++) {
+		if (!getZigzag(buf, len, &pos, &v)) {
+			return false;
+		}
+		last[i] = sweeps == 0 ? v : last[i] + v;
+		out->raw[i] = 0;
+		out->temp[i] = last[i] / 10.0f;
+	}
+	out->timestamp = lastTs;
+	out->count = count;
+	sweeps++;
+	return true;
+}
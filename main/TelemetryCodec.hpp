@@ -0,0 +1,58 @@
+#ifndef TELEMETRYCODEC_H_
+#define TELEMETRYCODEC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ProbeSampler.hpp"
+
+#define TELEMETRY_CODEC_VERSION 1
+
+/**
+ * Compact binary telemetry frame, an alternative to the JSON shadow
+ * document for plain MQTT topics.  A frame carries one or more sweeps with
+ * the same probe count, temperatures in 0.1 degC:
+ *
+ *   byte      version << 4 | probe count
+ *   varint    timestamp of the first sweep (seconds)
+ *   zvarint   temperature of each probe
+ *   then for each further sweep:
+ *   zvarint   timestamp delta from the previous sweep
+ *   zvarint   temperature delta of each probe from the previous sweep
+ *
+ * varint is unsigned LEB128 and zvarint is a zigzag signed varint, so a
+ * slowly changing sweep costs about one byte per value.  There is no
+ * length field; the frame ends with the payload.
+ */
+class TelemetryEncoder {
+	uint8_t* buf;
+	size_t size;
+	size_t len;
+	int count;
+	int sweeps;
+	uint32_t lastTs;
+	int16_t last[MAX_PROBES];
+
+	public:
+	TelemetryEncoder(uint8_t*, size_t);
+	bool add(const probe_sweep_t*);
+	size_t length() { return len; }
+	int sweepCount() { return sweeps; }
+};
+
+class TelemetryDecoder {
+	const uint8_t* buf;
+	size_t len;
+	size_t pos;
+	int count;
+	int sweeps;
+	uint32_t lastTs;
+	int16_t last[MAX_PROBES];
+
+	public:
+	TelemetryDecoder(const uint8_t*, size_t);
+	bool valid() { return count > 0; }
+	bool next(probe_sweep_t*);
+};
+
+#endif
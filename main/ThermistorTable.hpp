@@ -0,0 +1,166 @@
+#ifndef THERMISTORTABLE_H_
+#define THERMISTORTABLE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Compile-time ADC code -> temperature conversion for NTC thermistor probes.
+ *
+ * The probe is described by a parameter struct with the constants used by
+ * the Beta equation:
+ *
+ *   struct MyProbe {
+ *       static constexpr double Ro = 90000;          // resistance at To (ohm)
+ *       static constexpr double Rt = 14000;          // divider resistor (ohm)
+ *       static constexpr double B = 3850;            // Beta coefficient
+ *       static constexpr double To = 298.15;         // reference temp (K)
+ *       static constexpr double ADC_STEP = 3.3/4096; // volts per ADC code
+ *   };
+ *
+ * ThermistorTable<MyProbe> holds one entry per 12-bit ADC code, generated
+ * by the compiler and placed in flash, so a conversion is a single load.
+ * Use ThermistorTable<MyProbe, ThermistorFixed> for 0.1 degC integer output
+ * and a smaller Bits value together with interpolate() to trade table size
+ * for a multiply.  The curve bends hardest at the hot end, so a coarse
+ * table loses most there.  interpolate() covers FIRST_CODE to LAST_CODE
+ * only and clamps beyond, where a line through the end entries is far off
+ * the curve: for the probe in main.cpp 256 entries cover 425 to -41 degC,
+ * within 0.02 degC from 0 to 150 degC, 1 degC from 290 to -41 degC, 2.5
+ * degC near 330 degC and 9 degC near 425 degC (tools/thermistor_check.cpp).
+ * Hotter or colder probes read as those ends.  The full table covers 1134
+ * to -67 degC.
+ */
+
+// Fixed point output: temperature in tenths of a degree C.
+typedef int16_t ThermistorFixed;
+
+namespace thermistor {
+
+static const int ADC_BITS = 12;
+constexpr double LN2 = 0.69314718055994530942;
+constexpr double KELVIN = 273.15;
+
+// Natural log usable in constant expressions (C++11 constexpr rules).
+constexpr double lnSeries(double y2, double term, int n, double sum) {
+	return n > 41 ? sum : lnSeries(y2, term * y2, n + 2, sum + term / n);
+}
+constexpr double lnReduced(double y) {
+	return 2 * lnSeries(y * y, y, 1, 0);
+}
+constexpr double ln(double x) {
+	return x > 2 ? ln(x / 2) + LN2 :
+		x < 0.5 ? ln(x * 2) - LN2 :
+		lnReduced((x - 1) / (x + 1));
+}
+
+// Beta equation, T = B / ln(R/Ri) with Ri = Ro * exp(-B/To).
+// ln(R/Ri) is expanded to ln(R/Ro) + B/To so no exp() is needed.
+// Code 0 maps to R = 0, for which the runtime equation yields -273.15.
+template<typename Probe>
+constexpr double betaTemperature(double code) {
+	return code <= 0 ? -KELVIN :
+		Probe::B / (ln(((Probe::Rt * code * Probe::ADC_STEP) /
+			(Probe::ADC_STEP * (1 << ADC_BITS) - code * Probe::ADC_STEP)) / Probe::Ro) +
+			Probe::B / Probe::To) - KELVIN;
+}
+
+template<typename T> struct Output {
+	static constexpr T from(double t) { return static_cast<T>(t); }
+	static float toFloat(T t) { return t; }
+};
+template<> struct Output<ThermistorFixed> {
+	static constexpr ThermistorFixed from(double t) {
+		return static_cast<ThermistorFixed>(t * 10 + (t < 0 ? -0.5 : 0.5));
+	}
+	static float toFloat(ThermistorFixed t) { return t / 10.0f; }
+};
+
+// C++11 stand-in for std::index_sequence, built in log(N) steps.
+template<size_t... I> struct Indices {};
+template<typename A, typename B> struct JoinIndices;
+template<size_t... A, size_t... B>
+struct JoinIndices<Indices<A...>, Indices<B...> > {
+	typedef Indices<A..., (sizeof...(A) + B)...> type;
+};
+template<size_t N> struct MakeIndices {
+	typedef typename JoinIndices<typename MakeIndices<N / 2>::type,
+		typename MakeIndices<N - N / 2>::type>::type type;
+};
+template<> struct MakeIndices<0> { typedef Indices<> type; };
+template<> struct MakeIndices<1> { typedef Indices<0> type; };
+
+template<typename T, size_t N> struct Entries {
+	T v[N];
+};
+
+template<typename Probe, typename T, int Shift, size_t... I>
+constexpr Entries<T, sizeof...(I)> generate(Indices<I...>) {
+	return {{ Output<T>::from(betaTemperature<Probe>(double(I << Shift))) ... }};
+}
+
+} // namespace thermistor
+
+template<typename Probe, typename T = float, int Bits = thermistor::ADC_BITS>
+class ThermistorTable {
+	static_assert(Bits > 1 && Bits <= thermistor::ADC_BITS, "table bits must be 2..12");
+	static const int SHIFT = thermistor::ADC_BITS - Bits;
+	static const size_t SIZE = size_t(1) << Bits;
+
+	static constexpr thermistor::Entries<T, SIZE> table =
+		thermistor::generate<Probe, T, SHIFT>(typename thermistor::MakeIndices<SIZE>::type());
+
+	public:
+	/**
+	 * Codes interpolate() covers, hottest to coldest: entry 1 (entry 0 is
+	 * R = 0) to the last entry.  Codes outside read as the end entry.
+	 */
+	static const uint32_t FIRST_CODE = uint32_t(1) << SHIFT;
+	static const uint32_t LAST_CODE = uint32_t(SIZE - 1) << SHIFT;
+
+	/**
+	 * Table entry covering a raw ADC code.  Exact when Bits is 12.
+	 */
+	static T lookup(uint32_t code) {
+		if (code >= (1u << thermistor::ADC_BITS)) {
+			code = (1u << thermistor::ADC_BITS) - 1;
+		}
+		return table.v[code >> SHIFT];
+	}
+
+	/**
+	 * Linear interpolation between entries.  code carries fracBits extra
+	 * bits below the ADC LSB, e.g. the sum of 2^fracBits oversampled reads.
+	 */
+	static T interpolate(uint32_t code, int fracBits = 0) {
+		const int shift = SHIFT + fracBits;
+		// Clamp rather than extrapolate: code 0 is a singularity of the
+		// Beta equation and the curve is far from a line beyond either end.
+		if (code < FIRST_CODE << fracBits) {
+			code = FIRST_CODE << fracBits;
+		} else if (code > LAST_CODE << fracBits) {
+			code = LAST_CODE << fracBits;
+		}
+		uint32_t index = code >> shift;
+		if (index >= SIZE - 1) {
+			index = SIZE - 2;
+		}
+		const int32_t rem = int32_t(code) - int32_t(index << shift);
+		const T lo = table.v[index];
+		const T hi = table.v[index + 1];
+		return lo + T((hi - lo) * rem / float(1u << shift));
+	}
+
+	static float toFloat(T t) {
+		return thermistor::Output<T>::toFloat(t);
+	}
+};
+
+template<typename Probe, typename T, int Bits>
+const uint32_t ThermistorTable<Probe, T, Bits>::FIRST_CODE;
+template<typename Probe, typename T, int Bits>
+const uint32_t ThermistorTable<Probe, T, Bits>::LAST_CODE;
+template<typename Probe, typename T, int Bits>
+constexpr thermistor::Entries<T, ThermistorTable<Probe, T, Bits>::SIZE> ThermistorTable<Probe, T, Bits>::table;
+
+#endif
@@ -0,0 +1,52 @@
+#include "Trace.hpp"
+
+#if CONFIG_TRACE_RING
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+static const char* TAG = "trace";
+
+static const char* TRACE_NAMES[TRACE_IDS] = {
+	"sample", "publish", "update", "yield"
+};
+
+static portMUX_TYPE traceLock = portMUX_INITIALIZER_UNLOCKED;
+
+trace_record_t Trace::ring[CONFIG_TRACE_RING_SIZE];
+uint32_t Trace::head;
+uint32_t Trace::nextMs[TRACE_IDS];
+trace_stats_t Trace::stats;
+
+void Trace::record(trace_id_t id, int arg) {
+	uint32_t now = xTaskGetTickCount() * portTICK_PERIOD_MS;
+	portENTER_CRITICAL(&traceLock);
+	if ((int32_t)(now - nextMs[id]) < 0) {
+		stats.suppressed++;
+	} else {
+		trace_record_t* r = &ring[head % CONFIG_TRACE_RING_SIZE];
+		r->ms = now;
+		r->id = id;
+		r->arg = arg;
+		head++;
+		nextMs[id] = now + CONFIG_TRACE_MIN_INTERVAL_MS;
+		stats.recorded++;
+	}
+	portEXIT_CRITICAL(&traceLock);
+}
+
+/**
+ * Log the ring, oldest first.
+ */
+void Trace::dump() {
+	uint32_t end = head;
+	uint32_t start = end > CONFIG_TRACE_RING_SIZE ? end - CONFIG_TRACE_RING_SIZE : 0;
+	ESP_LOGI(TAG, "%u recorded, %u suppressed", stats.recorded, stats.suppressed);
+	for (uint32_t i = start; i < end; i++) {
+		const trace_record_t* r = &ring[i % CONFIG_TRACE_RING_SIZE];
+		ESP_LOGI(TAG, "%10u %-8s %d", r->ms, TRACE_NAMES[r->id], r->arg);
+	}
+}
+
+#endif
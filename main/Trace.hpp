@@ -0,0 +1,61 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+/**
+ * Binary trace records in a RAM ring, standing in for the per-sample and
+ * per-yield logs in the production build profile.  A record is eight
+ * bytes and costs a critical section, not a format and a UART write.
+ *
+ * Each id is rate limited to one record per CONFIG_TRACE_MIN_INTERVAL_MS;
+ * the rest are only counted.  The ring is dumped with the metrics, and
+ * can be read from a core dump or debugger as Trace::ring.
+ *
+ * Use TRACE(), which compiles to nothing without CONFIG_TRACE_RING.
+ */
+
+typedef enum {
+	TRACE_SAMPLE,		// arg: sample number
+	TRACE_PUBLISH,		// arg: sample number
+	TRACE_UPDATE,		// arg: aws_iot_shadow_update() result
+	TRACE_YIELD,		// arg: aws_iot_shadow_yield() result, on error
+	TRACE_IDS
+} trace_id_t;
+
+typedef struct {
+	uint32_t ms;
+	uint16_t id;
+	int16_t arg;
+} trace_record_t;
+
+typedef struct {
+	uint32_t recorded;
+	uint32_t suppressed;
+} trace_stats_t;
+
+#if CONFIG_TRACE_RING
+
+class Trace {
+	static trace_record_t ring[CONFIG_TRACE_RING_SIZE];
+	static uint32_t head;
+	static uint32_t nextMs[TRACE_IDS];
+	static trace_stats_t stats;
+
+	public:
+	static void record(trace_id_t id, int arg);
+	static void dump();
+	static const trace_stats_t* getStats() { return &stats; }
+};
+
+#define TRACE(id, arg) Trace::record(id, arg)
+
+#else
+
+#define TRACE(id, arg)
+
+#endif
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef VARINT_H_
+#define VARINT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Unsigned LEB128 varints and zigzag signed varints, shared by the binary
+ * telemetry codec and the history store.  A put writes at most 5 bytes.
+ */
+
+static inline size_t putVarint(uint8_t* p, uint32_t v) {
+	size_t n = 0;
+	while (v >= 0x80) {
+		p[n++] = (uint8_t) (v | 0x80);
+		v >>= 7;
+	}
+	p[n++] = (uint8_t) v;
+	return n;
+}
+
+static inline size_t putZigzag(uint8_t* p, int32_t v) {
+	return putVarint(p, ((uint32_t) v << 1) ^ (uint32_t) (v >> 31));
+}
+
+// Returns false on a truncated or over-long varint.
+static inline bool getVarint(const uint8_t* p, size_t len, size_t* pos, uint32_t* v) {
+	uint32_t result = 0;
+	for (int shift = 0; shift < 35 && *pos < len; shift += 7) {
+		uint8_t b = p[(*pos)++];
+		result |= (uint32_t) (b & 0x7f) << shift;
+		if (!(b & 0x80)) {
+			*v = result;
+			return true;
+		}
+	}
+	return false;
+}
+
+static inline bool getZigzag(const uint8_t* p, size_t len, size_t* pos, int32_t* v) {
+	uint32_t u;
+	if (!getVarint(p, len, pos, &u)) {
+		return false;
+	}
+	*v = (int32_t) (u >> 1) ^ -(int32_t) (u & 1);
+	return true;
+}
+
+#endif
@@ -19,8 +19,11 @@
 #include <driver/gpio.h>
 #include <tcpip_adapter.h>
 #include <lwip/sockets.h>
+#include <lwip/dns.h>
 #include <mongoose.h>
+#include <freertos/timers.h>
 #include "bootwifi.h"
+#include "reconnect.h"
 #include "sdkconfig.h"
 #include "selectAP.h"
 
@@ -31,11 +34,37 @@
 uint32_t g_version=0x0200;
 
 #define KEY_CONNECTION_INFO "connectionInfo" // Key used in NVS for connection info
+#define KEY_STATION_CACHE "staCache" // Key used in NVS for the last good access point
 #define BOOTWIFI_NAMESPACE "bootwifi" // Namespace in NVS for bootwifi
 
+/**
+ * The access point and DHCP lease of the last successful connect.  The
+ * next boot connects straight to that BSSID and channel without a scan,
+ * and with CONFIG_WIFI_CACHE_LEASE reuses the address instead of waiting
+ * for DHCP, for up to CONFIG_WIFI_CACHE_LEASE_REUSES connects before DHCP
+ * is asked again.  Dropped if that connect fails.
+ */
+typedef struct {
+	char ssid[SSID_SIZE];	// the cache is only valid for this network
+	uint8_t bssid[6];
+	uint8_t channel;
+	uint8_t leaseReuses;	// connects on the lease since DHCP gave it
+	tcpip_adapter_ip_info_t lease;
+	ip_addr_t dns;
+} station_cache_t;
+
 
 static void saveConnectionInfo(connection_info_t *pConnectionInfo);
 static bootwifi_callback_t g_callback = NULL; // Callback function to be invoked when we have finished.
+static bootwifi_ap_callback_t g_apCallback = NULL; // Callback function to be invoked before becoming an access point.
+
+static station_cache_t g_stationCache;
+static int g_stationCacheValid = 0;
+static int g_usingStationCache = 0; // Is the current connect attempt using the cache?
+static int g_usingCachedLease = 0; // ... and its lease rather than DHCP?
+static bootwifi_timing_t g_timing;
+static reconnect_t g_reconnect;
+static TimerHandle_t g_reconnectTimer = NULL;
 
 static int g_mongooseStarted = 0; // Has the mongoose server started?
 static int g_mongooseStopRequest = 0; // Request to stop the mongoose server.
@@ -43,7 +72,11 @@ static int g_mongooseStopRequest = 0; // Request to stop the mongoose server.
 // Forward declarations
 
 static void becomeAccessPoint();
+static void becomeStation(connection_info_t *pConnectionInfo);
 static void bootWiFi2();
+static void saveStationCache(const tcpip_adapter_ip_info_t *pLease);
+static void clearStationCache();
+static void invokeCallback();
 
 static char tag[] = "bootwifi";
 
@@ -233,9 +266,7 @@ static void mongooseTask(void *data) {
 	g_mongooseStarted = 0;
 
 	// Since we HAVE ended mongoose, time to invoke the callback.
-	if (g_callback) {
-		g_callback(1);
-	}
+	invokeCallback();
 
 	ESP_LOGD(tag, "<< mongooseTask");
 	vTaskDelete(NULL);
@@ -281,11 +312,35 @@ static esp_err_t esp32_wifi_eventHandler(void *ctx, system_event_t *event) {
 			break;
 		} // SYSTEM_EVENT_AP_START
 
+		case SYSTEM_EVENT_STA_CONNECTED: {
+			g_timing.associated = esp_log_timestamp();
+			break;
+		} // SYSTEM_EVENT_STA_CONNECTED
+
 		// If we fail to connect to an access point as a station, become an access point.
 		case SYSTEM_EVENT_STA_DISCONNECTED: {
 			ESP_LOGD(tag, "Station disconnected started");
-			// We think we tried to connect as a station and failed! ... become
-			// an access point.
+			// The cached access point may have moved; forget it and try
+			// again with a full scan and DHCP before giving up.
+			if (g_usingStationCache) {
+				ESP_LOGW(tag, "Cached access point failed, scanning");
+				clearStationCache();
+				connection_info_t connectionInfo;
+				if (getConnectionInfo(&connectionInfo) == 0) {
+					becomeStation(&connectionInfo);
+					break;
+				}
+			}
+			// Retry with backoff; only after CONFIG_WIFI_AP_FALLBACK_FAILURES
+			// failures in a row do we become an access point.
+			int32_t delay = reconnect_down(&g_reconnect, esp_log_timestamp(), esp_random());
+			if (delay >= 0) {
+				ESP_LOGW(tag, "Station down, reconnect %u in %d ms", g_reconnect.stats.attempts, delay);
+				TickType_t ticks = delay / portTICK_PERIOD_MS;
+				xTimerChangePeriod(g_reconnectTimer, ticks > 0 ? ticks : 1, 0);
+				break;
+			}
+			ESP_LOGW(tag, "Station failed %d times, becoming an access point", CONFIG_WIFI_AP_FALLBACK_FAILURES);
 			becomeAccessPoint();
 			break;
 		} // SYSTEM_EVENT_AP_START
@@ -297,6 +352,21 @@ static esp_err_t esp32_wifi_eventHandler(void *ctx, system_event_t *event) {
 			ESP_LOGD(tag, "* We are now connected and ready to do work!")
 			ESP_LOGD(tag, "* - Our IP address is: " IPSTR, IP2STR(&event->event_info.got_ip.ip_info.ip));
 			ESP_LOGD(tag, "********************************************");
+			g_timing.gotIp = esp_log_timestamp();
+			g_timing.cached = g_usingStationCache;
+			ESP_LOGI(tag, "Station up (%s): connect %u ms, associated +%u ms, IP +%u ms",
+				g_usingStationCache ? "cached" : "scan",
+				g_timing.connect - g_timing.start, g_timing.associated - g_timing.connect,
+				g_timing.gotIp - g_timing.associated);
+			g_usingStationCache = 0;
+			saveStationCache(&event->event_info.got_ip.ip_info);
+			g_usingCachedLease = 0;
+			reconnect_up(&g_reconnect, g_timing.gotIp);
+			if (g_reconnect.stats.reconnects > 0) {
+				ESP_LOGI(tag, "Reconnected in %u ms; %u disconnects, %u reconnects, max %u ms",
+					g_reconnect.stats.lastReconnectMs, g_reconnect.stats.disconnects,
+					g_reconnect.stats.reconnects, g_reconnect.stats.maxReconnectMs);
+			}
 			// Start Mongoose ...
 			//if (!g_mongooseStarted)
 			//{
@@ -308,9 +378,7 @@ static esp_err_t esp32_wifi_eventHandler(void *ctx, system_event_t *event) {
 			// we will invoke the callback when mongoose has ended.
 
 			if (!g_mongooseStarted) {
-				if (g_callback) {
-					g_callback(1);
-				}
+				invokeCallback();
 			} // Mongoose was NOT started
 
 			break;
@@ -393,28 +461,130 @@ static void saveConnectionInfo(connection_info_t *pConnectionInfo) {
 } // setConnectionInfo
 
 /**
- * Become a station connecting to an existing access point.
+ * Load the cached access point for this SSID.  A rc==0 means ok.
+ */
+static int loadStationCache(const char *ssid) {
+	nvs_handle handle;
+	size_t size = sizeof(station_cache_t);
+	g_stationCacheValid = 0;
+	if (nvs_open(BOOTWIFI_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+		return -1;
+	}
+	esp_err_t err = nvs_get_blob(handle, KEY_STATION_CACHE, &g_stationCache, &size);
+	nvs_close(handle);
+	if (err != ESP_OK || size != sizeof(station_cache_t) ||
+			strncmp(g_stationCache.ssid, ssid, SSID_SIZE) != 0) {
+		ESP_LOGD(tag, "No station cache for \"%s\" (%d)", ssid, err);
+		return -1;
+	}
+	g_stationCacheValid = 1;
+	return 0;
+} // loadStationCache
+
+
+/**
+ * Remember the access point and lease we just connected with.  Only
+ * written when something changed, to spare the flash.
+ */
+static void saveStationCache(const tcpip_adapter_ip_info_t *pLease) {
+	wifi_ap_record_t apInfo;
+	connection_info_t connectionInfo;
+	station_cache_t cache;
+	if (esp_wifi_sta_get_ap_info(&apInfo) != ESP_OK || getConnectionInfo(&connectionInfo) != 0) {
+		return;
+	}
+	memset(&cache, 0, sizeof(cache));
+	memcpy(cache.ssid, connectionInfo.ssid, SSID_SIZE);
+	memcpy(cache.bssid, apInfo.bssid, sizeof(cache.bssid));
+	cache.channel = apInfo.primary;
+	if (g_usingCachedLease) {
+		// Keep the lease as DHCP gave it, so it ages.
+		cache.leaseReuses = g_stationCache.leaseReuses + 1;
+		cache.lease = g_stationCache.lease;
+		cache.dns = g_stationCache.dns;
+	} else {
+		cache.lease = *pLease;
+		cache.dns = *dns_getserver(0);
+	}
+	if (g_stationCacheValid && memcmp(&cache, &g_stationCache, sizeof(cache)) == 0) {
+		return;
+	}
+
+	nvs_handle handle;
+	if (nvs_open(BOOTWIFI_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+		return;
+	}
+	if (nvs_set_blob(handle, KEY_STATION_CACHE, &cache, sizeof(cache)) == ESP_OK &&
+			nvs_commit(handle) == ESP_OK) {
+		g_stationCache = cache;
+		g_stationCacheValid = 1;
+		ESP_LOGD(tag, "Station cache saved, channel %d", cache.channel);
+	}
+	nvs_close(handle);
+} // saveStationCache
+
+
+/**
+ * Forget the cached access point, e.g. after it failed to connect.
+ */
+static void clearStationCache() {
+	nvs_handle handle;
+	g_stationCacheValid = 0;
+	if (nvs_open(BOOTWIFI_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK) {
+		nvs_erase_key(handle, KEY_STATION_CACHE);
+		nvs_commit(handle);
+		nvs_close(handle);
+	}
+} // clearStationCache
+
+
+/**
+ * Become a station connecting to an existing access point.  With a cached
+ * access point for this SSID the connect goes straight to its BSSID and
+ * channel, skipping the scan, and may reuse the last lease.
  */
 static void becomeStation(connection_info_t *pConnectionInfo) {
 	ESP_LOGD(tag, "- Connecting to access point \"%s\" ...", pConnectionInfo->ssid);
 	assert(strlen(pConnectionInfo->ssid) > 0);
 
+	g_usingStationCache = 0;
+	g_usingCachedLease = 0;
+#if CONFIG_WIFI_FAST_RECONNECT
+	g_usingStationCache = loadStationCache(pConnectionInfo->ssid) == 0;
+#endif
+
 	// If we have a static IP address information, use that.
 	if (pConnectionInfo->ipInfo.ip.addr != 0) {
 		ESP_LOGD(tag, " - using a static IP address of " IPSTR, IP2STR(&pConnectionInfo->ipInfo.ip));
 		tcpip_adapter_dhcpc_stop(TCPIP_ADAPTER_IF_STA);
 		tcpip_adapter_set_ip_info(TCPIP_ADAPTER_IF_STA, &pConnectionInfo->ipInfo);
+#if CONFIG_WIFI_CACHE_LEASE
+	} else if (g_usingStationCache && g_stationCache.lease.ip.addr != 0 &&
+			g_stationCache.leaseReuses < CONFIG_WIFI_CACHE_LEASE_REUSES) {
+		ESP_LOGD(tag, " - reusing the lease of " IPSTR, IP2STR(&g_stationCache.lease.ip));
+		g_usingCachedLease = 1;
+		tcpip_adapter_dhcpc_stop(TCPIP_ADAPTER_IF_STA);
+		tcpip_adapter_set_ip_info(TCPIP_ADAPTER_IF_STA, &g_stationCache.lease);
+		dns_setserver(0, &g_stationCache.dns);
+#endif
 	} else {
 		tcpip_adapter_dhcpc_start(TCPIP_ADAPTER_IF_STA);
 	}
 
   ESP_ERROR_CHECK( esp_wifi_set_mode(WIFI_MODE_STA));
   wifi_config_t sta_config;
-  sta_config.sta.bssid_set = 0;
+  memset(&sta_config, 0, sizeof(sta_config));
   memcpy(sta_config.sta.ssid, pConnectionInfo->ssid, SSID_SIZE);
   memcpy(sta_config.sta.password, pConnectionInfo->password, PASSWORD_SIZE);
+  if (g_usingStationCache) {
+    ESP_LOGD(tag, " - using the cached access point on channel %d", g_stationCache.channel);
+    sta_config.sta.bssid_set = 1;
+    memcpy(sta_config.sta.bssid, g_stationCache.bssid, sizeof(sta_config.sta.bssid));
+    sta_config.sta.channel = g_stationCache.channel;
+  }
   ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &sta_config));
   ESP_ERROR_CHECK(esp_wifi_start());
+  g_timing.connect = esp_log_timestamp();
   ESP_ERROR_CHECK(esp_wifi_connect());
 } // becomeStation
 
@@ -424,6 +594,10 @@ static void becomeStation(connection_info_t *pConnectionInfo) {
  */
 static void becomeAccessPoint() {
 	ESP_LOGD(tag, "- Starting being an access point ...");
+	// Our web server needs port 80; whoever else has it must let go first.
+	if (g_apCallback) {
+		g_apCallback();
+	}
 	// We don't have connection info so be an access point!
 	ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_AP));
 	wifi_config_t apConfig = {
@@ -463,12 +637,65 @@ static void bootWiFi2() {
 } // bootWiFi2
 
 
+/**
+ * Invoke the callback the first time we are connected as a station.  Later
+ * reconnects are handled here and are not reported again.
+ */
+static void invokeCallback() {
+	bootwifi_callback_t callback = g_callback;
+	g_callback = NULL;
+	if (callback) {
+		callback(1);
+	}
+} // invokeCallback
+
+
+/**
+ * Reconnect timer expired; try the station connect again.
+ */
+static void reconnectTimerCallback(TimerHandle_t timer) {
+	ESP_LOGD(tag, "Reconnecting");
+	g_timing.connect = esp_log_timestamp();
+	esp_wifi_connect();
+} // reconnectTimerCallback
+
+
+/**
+ * Disconnect and reconnect counters, see reconnect_stats_t.
+ */
+const reconnect_stats_t *getWiFiReconnectStats() {
+	return &g_reconnect.stats;
+} // getWiFiReconnectStats
+
+
+/**
+ * Connect timings of the station, see bootwifi_timing_t.
+ */
+const bootwifi_timing_t *getWiFiTiming() {
+	return &g_timing;
+} // getWiFiTiming
+
+
+/**
+ * Have callback called before falling back to an access point, which
+ * serves the setup page on port 80.  It runs on the event loop task and
+ * must have closed anything listening there by the time it returns.
+ */
+void bootWiFiOnAccessPoint(bootwifi_ap_callback_t callback) {
+	g_apCallback = callback;
+} // bootWiFiOnAccessPoint
+
+
 /**
  * Main entry into bootWiFi
  */
 void bootWiFi(bootwifi_callback_t callback) {
 	ESP_LOGD(tag, ">> bootWiFi");
 	g_callback = callback;
+	g_timing.start = esp_log_timestamp();
+	reconnect_init(&g_reconnect, CONFIG_WIFI_RECONNECT_BASE_MS, CONFIG_WIFI_RECONNECT_MAX_MS,
+		CONFIG_WIFI_RECONNECT_JITTER, CONFIG_WIFI_AP_FALLBACK_FAILURES);
+	g_reconnectTimer = xTimerCreate("wifi_reconnect", 1, pdFALSE, NULL, reconnectTimerCallback);
 
 	tcpip_adapter_init();
 	ESP_ERROR_CHECK(esp_event_loop_init(esp32_wifi_eventHandler, NULL));
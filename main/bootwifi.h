@@ -8,7 +8,10 @@
 #ifndef MAIN_BOOTWIFI_H_
 #define MAIN_BOOTWIFI_H_
 
+#include "reconnect.h"
+
 typedef void (*bootwifi_callback_t)(int rc);
+typedef void (*bootwifi_ap_callback_t)(void);
 
 #define SSID_SIZE (32) // Maximum SSID size
 #define PASSWORD_SIZE (64) // Maximum password size
@@ -21,7 +24,22 @@ typedef struct {
 } connection_info_t;
 int getConnectionInfo(connection_info_t*);
 
+/**
+ * Milliseconds since boot at each step of the last station connect, and
+ * whether it used the cached access point and lease.
+ */
+typedef struct {
+	uint32_t start;		// bootWiFi() called
+	uint32_t connect;	// esp_wifi_connect() issued
+	uint32_t associated;	// associated with the access point
+	uint32_t gotIp;		// IP address assigned
+	int cached;
+} bootwifi_timing_t;
+const bootwifi_timing_t *getWiFiTiming();
+const reconnect_stats_t *getWiFiReconnectStats();
+
 void bootWiFi(bootwifi_callback_t);
+void bootWiFiOnAccessPoint(bootwifi_ap_callback_t);
 
 
 #endif /* MAIN_BOOTWIFI_H_ */
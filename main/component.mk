@@ -7,7 +7,9 @@
 # please read the ESP-IDF documents if you need to do this.
 #
 
-CFLAGS += -D LOG_LOCAL_LEVEL=ESP_LOG_DEBUG
+ifdef CONFIG_BUILD_PROFILE_DEBUG
+CPPFLAGS += -D LOG_LOCAL_LEVEL=ESP_LOG_DEBUG
+endif
 COMPONENT_EMBED_TXTFILES := certs/aws-root-ca.pem certs/certificate.pem.crt certs/private.pem.key certs/certificate-and-ca.pem.crt
 
 
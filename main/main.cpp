@@ -5,9 +5,12 @@
 #include <time.h>
 #include <sys/time.h>
 #include <math.h>
+#include <atomic>
 
 #include "esp_deep_sleep.h"
+#include "esp_attr.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "esp_wifi.h"
 #include "esp_system.h"
 #include "esp_event.h"
@@ -24,19 +27,105 @@ extern "C" {
 #include "bootwifi.h"
 }
 #include "IotDataMqtt.hpp"
+#include "ThermistorTable.hpp"
+#include "ProbeSampler.hpp"
+#include "SampleBatch.hpp"
+#include "SweepLog.hpp"
+#include "TelemetryCodec.hpp"
+#include "JsonWriter.hpp"
+#include "DutyCycle.hpp"
+#include "BootClock.hpp"
+#include "SampleQueue.hpp"
+#include "Metrics.hpp"
+#include "Trace.hpp"
+#include "Alarms.hpp"
+#include "History.hpp"
+#include "LocalServer.hpp"
+#include "CookEstimator.hpp"
+#include "ProbeTrend.hpp"
+#include "RateController.hpp"
 
-static const adc1_channel_t ADC_TEMP1 = ADC1_CHANNEL_7;
 static const char *TAG = "main";
 static const int MAX_LENGTH_OF_UPDATE_JSON_BUFFER = 400;
-static const double ADC_STEP = 3.3/4096;
-static const int Ro = 90000;
-static const int Rt = 14000;
-static const int B = 3850;
-static const double To = 298.15;
-static const double Ri = Ro * exp(-B/To);
+
+// Probe thermistor and divider; see ThermistorTable.hpp
+struct ProbeThermistor {
+	static constexpr double Ro = 90000;
+	static constexpr double Rt = 14000;
+	static constexpr double B = 3850;
+	static constexpr double To = 298.15;
+	static constexpr double ADC_STEP = 3.3/4096;
+};
+typedef ThermistorTable<ProbeThermistor> ProbeTable;
+
+// Probe wiring, set in sdkconfig.  Give a probe its own thermistor struct
+// and table here if it uses a different part.
+static const probe_channel_t PROBES[] = {
+	{ (adc1_channel_t)CONFIG_PROBE1_ADC_CHANNEL, &ProbeTable::interpolate },
+	{ (adc1_channel_t)CONFIG_PROBE2_ADC_CHANNEL, &ProbeTable::interpolate },
+	{ (adc1_channel_t)CONFIG_PROBE3_ADC_CHANNEL, &ProbeTable::interpolate },
+	{ (adc1_channel_t)CONFIG_PROBE4_ADC_CHANNEL, &ProbeTable::interpolate },
+};
+static const int NUM_PROBES = CONFIG_PROBE_COUNT;
+
+// Per probe noise filters, median then EMA, set in sdkconfig.
+#if CONFIG_PROBE_MEDIAN_SIZE > 1
+static MedianFilter<CONFIG_PROBE_MEDIAN_SIZE> medianFilters[MAX_PROBES];
+#endif
+#if CONFIG_PROBE_EMA_ALPHA < 100
+static EmaFilter emaFilters[MAX_PROBES] = {
+	EmaFilter(CONFIG_PROBE_EMA_ALPHA / 100.0f), EmaFilter(CONFIG_PROBE_EMA_ALPHA / 100.0f),
+	EmaFilter(CONFIG_PROBE_EMA_ALPHA / 100.0f), EmaFilter(CONFIG_PROBE_EMA_ALPHA / 100.0f),
+};
+#endif
+
+// A batch holding fewer than it flushes at would drop sweeps it still
+// counts as sent, and the backlog would consume them from the log.
+static_assert(CONFIG_BATCH_FLUSH_SAMPLES <= CONFIG_BATCH_CAPACITY, "BATCH_FLUSH_SAMPLES exceeds BATCH_CAPACITY");
+
+#if CONFIG_TELEMETRY_BATCH
+// Changed sweeps waiting to be published together, set in sdkconfig.
+static SampleBatch batch(CONFIG_BATCH_FLUSH_SAMPLES, CONFIG_BATCH_FLUSH_MS);
+#endif
+#if CONFIG_TELEMETRY_BATCH || CONFIG_STORE_FORWARD
+static char BatchDocumentBuffer[CONFIG_PUBLISH_DOC_SIZE];
+#endif
+#if CONFIG_STORE_FORWARD
+// Sweeps read back from the flash log, sent as one document.
+static SampleBatch backlog(CONFIG_BATCH_FLUSH_SAMPLES, 0);
+static probe_sweep_t backlogSweeps[CONFIG_BATCH_FLUSH_SAMPLES];
+#endif
+
+// Sweeps from sampler_task to aws_iot_task, which it wakes with a notify.
+static SampleQueue sampleQueue(
+#if CONFIG_SAMPLE_OVERFLOW_COALESCE
+	SAMPLE_OVERFLOW_COALESCE
+#else
+	SAMPLE_OVERFLOW_DROP_OLDEST
+#endif
+);
+static TaskHandle_t telemetryTask;
+
+// Sampling gets the APP CPU to itself; WiFi and the network task run on
+// the PRO CPU.
+#if CONFIG_FREERTOS_UNICORE
+static const BaseType_t SAMPLER_CORE = 0;
+#else
+static const BaseType_t SAMPLER_CORE = 1;
+#endif
+
 static const gpio_num_t CONFIG_RESET_GPIO = GPIO_NUM_0;
 static const float DELTA_TEMP = 2;
 
+#if CONFIG_DUTY_CYCLE
+static_assert(MAX_PROBES <= DUTY_CYCLE_MAX_PROBES, "duty cycle state too small");
+// Last published values etc., kept in RTC memory through deep sleep.
+static RTC_DATA_ATTR duty_cycle_state_t dutyState;
+static DutyCycle duty(&dutyState, DELTA_TEMP, CONFIG_DUTY_CYCLE_MAX_SILENCE_S * 1000);
+static probe_sweep_t dutySweep;
+static volatile bool dutyConnected = false;
+#endif
+
 
 static void initialize_sntp(void)
 {
@@ -47,23 +136,20 @@ static void initialize_sntp(void)
     sntp_init();
 }
 
-static void obtain_time(void)
+#if CONFIG_DUTY_CYCLE
+/**
+ * Wait up to 20 s for SNTP to set the clock.
+ */
+static void wait_for_time(void)
 {
-    initialize_sntp();
-
-    // wait for time to be set
-    time_t now = 0;
-    struct tm timeinfo;
     int retry = 0;
-    const int retry_count = 10;
-    timeinfo.tm_year = 0;
-    while(timeinfo.tm_year < (2016 - 1900) && ++retry < retry_count) {
-        ESP_LOGI(TAG, "Waiting for system time to be set... (%d/%d)", retry, retry_count);
-        vTaskDelay(2000 / portTICK_PERIOD_MS);
-        time(&now);
-        localtime_r(&now, &timeinfo);
+    const int retry_count = 40;
+    while(!BootClock::synced() && ++retry < retry_count) {
+        ESP_LOGD(TAG, "Waiting for system time to be set... (%d/%d)", retry, retry_count);
+        vTaskDelay(500 / portTICK_PERIOD_MS);
     }
 }
+#endif
 
 void get_mac_address(char* macAddress) {
     uint8_t mac[6];
@@ -72,16 +158,455 @@ void get_mac_address(char* macAddress) {
     sprintf(macAddress,"%02X%02X%02X%02X%02X%02X",mac[0],mac[1],mac[2],mac[3],mac[4],mac[5]);
 }
 
-float getTemperature(adc1_channel_t channel) {
-    int adc_value = adc1_get_voltage(channel);
-    double adc_voltage = adc_value * ADC_STEP;
-    double R = (Rt * adc_voltage)/(3.3 - adc_voltage);
-    float temperature = B/(log(R/Ri)) - 273.15;
-	ESP_LOGI(TAG,"%lf, %lf  R = %lf, Temp = %lf",Ri,adc_voltage,R,temperature);
-	return temperature;
+/**
+ * Completion of a queued shadow update; runs on the network task.
+ */
+static void publish_done(publish_status_t status, void* context) {
+	if (status != PUBLISH_ACCEPTED) {
+		ESP_LOGW(TAG,"Update %d not accepted: %d",(int)(intptr_t)context,status);
+		return;
+	}
+	BootClock::mark(BOOT_PUBLISH);
+	BootClock::report();
+}
+
+#if CONFIG_STORE_FORWARD
+// Log sweeps in the batch in flight, 0 if none; telemetry task only.
+static int backlogInFlight = 0;
+static uint32_t backlogDropped;
+// Its outcome, set on the network task: 1 accepted, -1 not.
+static std::atomic<int> backlogResult(0);
+
+static void drain_done(publish_status_t status, void* context) {
+	publish_done(status, context);
+	backlogResult = status == PUBLISH_ACCEPTED ? 1 : -1;
+}
+
+#if !CONFIG_TELEMETRY_BATCH
+#define LIVE_SLOTS (CONFIG_PUBLISH_QUEUE_DEPTH + CONFIG_SHADOW_INFLIGHT_WINDOW)
+
+typedef struct {
+	probe_sweep_t sweep;
+	int sample;
+} live_update_t;
+
+// Sweeps published one at a time, kept until the broker answers so one it
+// does not take can still go to the log.  Publishing fails while the queue
+// and the in-flight window are full, so a slot has been answered by the
+// time it comes round again.
+static live_update_t liveUpdates[LIVE_SLOTS];
+static uint32_t liveNext = 0;
+// Sweeps the broker did not take, from the network task to the log.
+static SpscQueue<live_update_t, 8> unsentUpdates;
+
+static void live_done(publish_status_t status, void* context) {
+	const live_update_t* update = &liveUpdates[(intptr_t)context];
+	publish_done(status, (void*)(intptr_t)update->sample);
+	if (status != PUBLISH_ACCEPTED && !unsentUpdates.push(*update)) {
+		ESP_LOGW(TAG,"Update %d dropped",update->sample);
+	}
+}
+#endif
+#endif
+
+#if CONFIG_COOK_ESTIMATOR
+#define ESTIMATOR_MEMORY_S (CONFIG_ESTIMATOR_MEMORY_MIN * 60)
+
+// Time to each probe's upper alarm limit, fitted by the telemetry task and
+// reported with the temperatures.
+static CookEstimator estimators[MAX_PROBES] = {
+	CookEstimator(CONFIG_ESTIMATOR_STRIDE_S, ESTIMATOR_MEMORY_S),
+	CookEstimator(CONFIG_ESTIMATOR_STRIDE_S, ESTIMATOR_MEMORY_S),
+	CookEstimator(CONFIG_ESTIMATOR_STRIDE_S, ESTIMATOR_MEMORY_S),
+	CookEstimator(CONFIG_ESTIMATOR_STRIDE_S, ESTIMATOR_MEMORY_S),
+};
+static float cookEta[MAX_PROBES] = { NAN, NAN, NAN, NAN };
+#endif
+
+#if CONFIG_TREND
+#define TREND_WINDOW_S (CONFIG_TREND_WINDOW_MIN * 60)
+#define TREND_STALL_SLOPE (CONFIG_TREND_STALL_SLOPE / 100.0f)
+
+// Slope, stall and drop detection on each probe, run by the telemetry task.
+static ProbeTrend trends[MAX_PROBES] = {
+	ProbeTrend(TREND_WINDOW_S, CONFIG_TREND_DROP_C, TREND_STALL_SLOPE),
+	ProbeTrend(TREND_WINDOW_S, CONFIG_TREND_DROP_C, TREND_STALL_SLOPE),
+	ProbeTrend(TREND_WINDOW_S, CONFIG_TREND_DROP_C, TREND_STALL_SLOPE),
+	ProbeTrend(TREND_WINDOW_S, CONFIG_TREND_DROP_C, TREND_STALL_SLOPE),
+};
+
+static const char* TREND_EVENT_NAMES[] = { "none", "stall", "stall end", "drop", "drop end" };
+#endif
+
+#if CONFIG_ADAPTIVE_RATE
+#if CONFIG_ALARMS
+#define RATE_NEAR_LIMIT CONFIG_RATE_NEAR_LIMIT_C
+#else
+#define RATE_NEAR_LIMIT 1
+#endif
+
+static const rate_config_t RATE_CONFIG = {
+	CONFIG_RATE_MIN_INTERVAL_MS,
+	CONFIG_RATE_MAX_INTERVAL_MS,
+	CONFIG_RATE_MIN_DELTA / 10.0f,
+	CONFIG_RATE_MAX_DELTA / 10.0f,
+	CONFIG_RATE_FAST_SLOPE / 10.0f,
+	RATE_NEAR_LIMIT,
+	CONFIG_RATE_MAX_SILENCE_S * 1000,
+	CONFIG_RATE_SETTLE_S * 1000,
+};
+
+// Run by the telemetry task, which hands the sweep interval it picks to
+// the sampler.
+static RateController rateController(&RATE_CONFIG);
+static std::atomic<uint32_t> sampleIntervalMs(CONFIG_RATE_MIN_INTERVAL_MS);
+#define SAMPLE_INTERVAL_MS (sampleIntervalMs.load())
+#else
+#define SAMPLE_INTERVAL_MS CONFIG_SAMPLE_INTERVAL_MS
+#endif
+
+#if !CONFIG_TELEMETRY_FORMAT_BINARY || CONFIG_DUTY_CYCLE
+/**
+ * Shadow update reporting one sweep.  Returns false if it does not fit.
+ */
+static bool format_sweep(char* buf, size_t size, const probe_sweep_t* sweep, const char* username,
+		const char* clientToken) {
+	METRIC_TIME(METRIC_ENCODE);
+	JsonWriter w(buf, size);
+	w.beginObject().key("state").beginObject().key("reported").beginObject();
+	w.key("username").value(username);
+	w.key("ts").value((uint32_t)sweep->timestamp);
+	w.key("t").beginArray();
+	for (int i=0;i<sweep->count;i++) {
+		w.value(sweep->temp[i]);
+	}
+	w.endArray();
+#if CONFIG_COOK_ESTIMATOR
+	// Seconds to go, null when unknown.
+	w.key("eta").beginArray();
+	for (int i=0;i<sweep->count;i++) {
+		w.value(cookEta[i], 0);
+	}
+	w.endArray();
+#endif
+	w.endObject().endObject();
+	w.key("clientToken").value(clientToken).endObject();
+	return w.ok();
+}
+#endif
+
+#if CONFIG_TELEMETRY_BATCH || CONFIG_STORE_FORWARD
+/**
+ * Queue the oldest sweeps of a batch as one document in the configured
+ * telemetry format.  Returns the number of sweeps queued.
+ */
+static int publish_batch(IotDataMqtt& data, SampleBatch& b, const char* username, const char* clientToken,
+		publish_callback_t done, void* context) {
+	METRIC_TIME(METRIC_ENCODE);
+#if CONFIG_TELEMETRY_FORMAT_BINARY
+	TelemetryEncoder encoder((uint8_t*)BatchDocumentBuffer, sizeof(BatchDocumentBuffer));
+	for (int i=0;i<b.size() && encoder.add(b.at(i));i++) {
+	}
+	int n = encoder.sweepCount();
+	if (n == 0 || data.publishBinaryAsync((uint8_t*)BatchDocumentBuffer, encoder.length(), done, context) != SUCCESS) {
+		return 0;
+	}
+#else
+	int n = b.format(BatchDocumentBuffer, sizeof(BatchDocumentBuffer), username, clientToken);
+	if (n <= 0 || data.publishAsync(BatchDocumentBuffer, done, context) != SUCCESS) {
+		return 0;
+	}
+#endif
+	return n;
+}
+#endif
+
+#if CONFIG_STORE_FORWARD
+/**
+ * Send the oldest logged sweeps as one batch document, if there are any
+ * and the publish queue takes it.  One batch is in flight at a time and
+ * its sweeps stay in the log until the broker accepts it; otherwise they
+ * are sent again.
+ */
+static void drain_log(SweepLog& log, IotDataMqtt& data, const char* username, const char* clientToken,
+		int sample) {
+	if (backlogInFlight > 0) {
+		int result = backlogResult.exchange(0);
+		if (result == 0) {
+			return;
+		}
+		if (result < 0) {
+			ESP_LOGW(TAG,"Log: %d not accepted, sending again",backlogInFlight);
+		} else if (log.getStats()->dropped != backlogDropped) {
+			// The ring wrapped under the batch; resending beats marking
+			// newer sweeps sent.
+			ESP_LOGW(TAG,"Log: wrapped while %d were in flight",backlogInFlight);
+		} else {
+			log.consume(backlogInFlight);
+			ESP_LOGI(TAG,"Log: %d sent, %u pending",backlogInFlight,log.pending());
+		}
+		backlogInFlight = 0;
+		if (log.pending() == 0) {
+			return;
+		}
+	}
+	int n = log.peek(backlogSweeps, CONFIG_BATCH_FLUSH_SAMPLES);
+	if (n == 0) {
+		return;
+	}
+	backlog.clear();
+	for (int i=0;i<n;i++) {
+		backlogSweeps[i].timestamp = BootClock::toWall(backlogSweeps[i].timestamp);
+		backlog.push(&backlogSweeps[i], 0);
+	}
+	n = publish_batch(data, backlog, username, clientToken, drain_done, (void*)(intptr_t)sample);
+	if (n > 0) {
+		backlogInFlight = n;
+		backlogDropped = log.getStats()->dropped;
+	}
+}
+#endif
+
+/**
+ * Take a sweep every SAMPLE_INTERVAL_MS and hand it to the telemetry
+ * task.  Runs at high priority and never waits on the network, so the
+ * cadence holds whatever the publishing side is doing.
+ */
+static void sampler_task(void *param) {
+    METRIC_WATCH_TASK("sampler");
+    Adc1Reader adc;
+    ProbeSampler sampler(adc, PROBES, NUM_PROBES);
+    sampler.init();
+    sampler.setOversample(CONFIG_PROBE_OVERSAMPLE_BITS);
+    for (int i=0;i<NUM_PROBES;i++) {
+#if CONFIG_PROBE_MEDIAN_SIZE > 1 && CONFIG_PROBE_EMA_ALPHA < 100
+        medianFilters[i].setNext(&emaFilters[i]);
+        sampler.setFilter(i, &medianFilters[i]);
+#elif CONFIG_PROBE_MEDIAN_SIZE > 1
+        sampler.setFilter(i, &medianFilters[i]);
+#elif CONFIG_PROBE_EMA_ALPHA < 100
+        sampler.setFilter(i, &emaFilters[i]);
+#endif
+    }
+
+    probe_sweep_t sweep;
+    TickType_t wake = xTaskGetTickCount();
+    for (;;) {
+        sampler.sweep(&sweep);
+        sampleQueue.push(&sweep);
+        xTaskNotifyGive(telemetryTask);
+        vTaskDelayUntil(&wake, SAMPLE_INTERVAL_MS / portTICK_PERIOD_MS);
+    }
+}
+
+typedef struct {
+	IotDataMqtt* data;
+	char* thingName;
+	char* username;
+} iot_connect_t;
+
+/**
+ * Sign up if needed and open the shadow connection, then hand it to the
+ * network task.  Runs next to aws_iot_task so sampling starts while the
+ * TLS handshake is still going on.
+ */
+static void iot_connect_task(void *param) {
+	iot_connect_t* c = (iot_connect_t*) param;
+	c->data->signup(c->thingName,c->username);
+	c->data->init(c->thingName);
+	c->data->start();
+	BootClock::mark(BOOT_MQTT);
+	vTaskDelete(NULL);
+}
+
+#if CONFIG_METRICS
+/**
+ * Publish the metrics as their own section of the reported state, the
+ * counters and the shadow update counts in a second update, and dump
+ * them to the log.
+ */
+static void publish_metrics(IotDataMqtt& data, const char* clientToken) {
+	static char doc[CONFIG_PUBLISH_DOC_SIZE];
+	char countersToken[SHADOW_TOKEN_SIZE];
+	Metrics::dump();
+#if CONFIG_TRACE_RING
+	Trace::dump();
+#endif
+	if (!data.isConnected()) {
+		return;
+	}
+	JsonWriter w(doc, sizeof(doc));
+	w.beginObject().key("state").beginObject().key("reported").beginObject();
+	Metrics::write(w);
+	w.endObject().endObject();
+	w.key("clientToken").value(clientToken).endObject();
+	if (!w.ok() || data.publishAsync(doc, NULL, NULL) != SUCCESS) {
+		ESP_LOGW(TAG,"Metrics not published");
+	}
+
+	snprintf(countersToken, sizeof(countersToken), "%s-c", clientToken);
+	JsonWriter c(doc, sizeof(doc));
+	c.beginObject().key("state").beginObject().key("reported").beginObject();
+	Metrics::writeCounters(c, data.getStats());
+	c.endObject().endObject();
+	c.key("clientToken").value(countersToken).endObject();
+	if (!c.ok() || data.publishAsync(doc, NULL, NULL) != SUCCESS) {
+		ESP_LOGW(TAG,"Metric counters not published");
+	}
+}
+#endif
+
+#if CONFIG_HISTORY
+// Sweep history, appended to by the telemetry task.  About 20K, so not on
+// its stack.  historyLock is held to use it, as the local server task
+// answers /api/history from it.
+static History history;
+static SemaphoreHandle_t historyLock;
+#endif
+
+#if CONFIG_LOCAL_SERVER
+// Sweeps for the local server, written by the telemetry task.
+static LiveFeed liveFeed;
+#endif
+
+#if CONFIG_ALARMS
+#define KEY_ALARM_LIMITS "alarmLimits"
+
+// Limits as changed by shadow deltas, on the network task, and handed to
+// the telemetry task, which checks every sweep against them.
+static alarm_limits_t deltaLimits;
+static SpscQueue<alarm_limits_t, 2> limitQueue;
+static Alarms alarms;
+
+static const char* ALARM_STATE_NAMES[] = { "ok", "low", "high" };
+
+/**
+ * Restore the limits applied before the last restart; a delta is only
+ * sent when the desired state changes.
+ */
+static void load_alarm_limits(alarm_limits_t* limits) {
+	nvs_handle handle;
+	size_t size = sizeof(*limits);
+	Alarms::clearLimits(limits);
+	if (nvs_open("mqtt", NVS_READONLY, &handle) != ESP_OK) {
+		return;
+	}
+	if (nvs_get_blob(handle, KEY_ALARM_LIMITS, limits, &size) != ESP_OK || size != sizeof(*limits)) {
+		Alarms::clearLimits(limits);
+	}
+	nvs_close(handle);
+}
+
+static void save_alarm_limits(const alarm_limits_t* limits) {
+	nvs_handle handle;
+	if (nvs_open("mqtt", NVS_READWRITE, &handle) != ESP_OK) {
+		return;
+	}
+	if (nvs_set_blob(handle, KEY_ALARM_LIMITS, limits, sizeof(*limits)) != ESP_OK || nvs_commit(handle) != ESP_OK) {
+		ESP_LOGE(TAG,"Alarm limits not saved");
+	}
+	nvs_close(handle);
+}
+
+/**
+ * Shadow delta for tl, tu or td: update the limits and pass them on.
+ */
+static void alarm_delta(const char* key, const char* json, size_t len, void* context) {
+	int n;
+	if (strcmp(key, "tl") == 0) {
+		n = Alarms::parseNumbers(json, len, deltaLimits.lower, MAX_PROBES);
+	} else if (strcmp(key, "tu") == 0) {
+		n = Alarms::parseNumbers(json, len, deltaLimits.upper, MAX_PROBES);
+	} else {
+		n = Alarms::parseNames(json, len, deltaLimits.name, MAX_PROBES);
+	}
+	if (n < 0) {
+		ESP_LOGW(TAG,"Bad %s in shadow delta: %.*s",key,(int)len,json);
+		return;
+	}
+	limitQueue.pushOverwrite(deltaLimits);
+}
+
+/**
+ * Report the limits in use, which also clears the delta.
+ */
+static bool publish_alarm_limits(IotDataMqtt& data, const alarm_limits_t* limits, const char* clientToken) {
+	static char doc[CONFIG_PUBLISH_DOC_SIZE];
+	JsonWriter w(doc, sizeof(doc));
+	w.beginObject().key("state").beginObject().key("reported").beginObject();
+	w.key("tl").beginArray();
+	for (int i=0;i<NUM_PROBES;i++) {
+		w.value(limits->lower[i]);
+	}
+	w.endArray().key("tu").beginArray();
+	for (int i=0;i<NUM_PROBES;i++) {
+		w.value(limits->upper[i]);
+	}
+	w.endArray().key("td").beginArray();
+	for (int i=0;i<NUM_PROBES;i++) {
+		w.value(limits->name[i]);
+	}
+	w.endArray().endObject().endObject();
+	w.key("clientToken").value(clientToken).endObject();
+	return w.ok() && data.publishAsync(doc, NULL, NULL) == SUCCESS;
+}
+
+/**
+ * Report the alarm state of every probe and the sweep that changed it,
+ * ahead of any batch.
+ */
+static bool publish_alarm(IotDataMqtt& data, const probe_sweep_t* sweep, const char* clientToken) {
+	static char doc[CONFIG_PUBLISH_DOC_SIZE];
+	JsonWriter w(doc, sizeof(doc));
+	w.beginObject().key("state").beginObject().key("reported").beginObject();
+	w.key("alarm").beginArray();
+	for (int i=0;i<sweep->count;i++) {
+		w.value(ALARM_STATE_NAMES[alarms.getState(i)]);
+	}
+	w.endArray();
+	w.key("ts").value((uint32_t)BootClock::toWall(sweep->timestamp));
+	w.key("t").beginArray();
+	for (int i=0;i<sweep->count;i++) {
+		w.value(sweep->temp[i]);
+	}
+	w.endArray().endObject().endObject();
+	w.key("clientToken").value(clientToken).endObject();
+	return w.ok() && data.publishAsync(doc, NULL, NULL) == SUCCESS;
+}
+#endif
+
+#if CONFIG_TREND
+/**
+ * Report each probe's trend, "ok", "stall" or "drop", and slope in degC
+ * per minute, as soon as one changes.
+ */
+static bool publish_trend(IotDataMqtt& data, const probe_sweep_t* sweep, const char* clientToken) {
+	static char doc[CONFIG_PUBLISH_DOC_SIZE];
+	JsonWriter w(doc, sizeof(doc));
+	w.beginObject().key("state").beginObject().key("reported").beginObject();
+	w.key("trend").beginArray();
+	for (int i=0;i<sweep->count;i++) {
+		w.value(trends[i].isDropped() ? "drop" : trends[i].isStalled() ? "stall" : "ok");
+	}
+	w.endArray();
+	w.key("slope").beginArray();
+	for (int i=0;i<sweep->count;i++) {
+		w.value(trends[i].slope(), 2);
+	}
+	w.endArray();
+	w.key("ts").value((uint32_t)BootClock::toWall(sweep->timestamp));
+	w.key("t").beginArray();
+	for (int i=0;i<sweep->count;i++) {
+		w.value(sweep->temp[i]);
+	}
+	w.endArray().endObject().endObject();
+	w.key("clientToken").value(clientToken).endObject();
+	return w.ok() && data.publishAsync(doc, NULL, NULL) == SUCCESS;
 }
+#endif
 
 void aws_iot_task(void *param) {
+    METRIC_WATCH_TASK("telemetry");
     connection_info_t connectionInfo;
     getConnectionInfo(&connectionInfo);
     ESP_LOGI(TAG,"Username: %s",connectionInfo.username);    
@@ -98,53 +623,377 @@ void aws_iot_task(void *param) {
 	sprintf(fullName,"BBQTemp_%s",macAddress);
 
     IotDataMqtt data;
+#if CONFIG_ALARMS
+    load_alarm_limits(&deltaLimits);
+    alarms.setLimits(&deltaLimits);
+    data.onDelta("tl", alarm_delta, NULL);
+    data.onDelta("tu", alarm_delta, NULL);
+    data.onDelta("td", alarm_delta, NULL);
+    bool limits_pending = false;
+    bool alarm_pending = false;
+#endif
+#if CONFIG_TREND
+    bool trend_pending = false;
+#endif
+    iot_connect_t connect = { &data, fullName, connectionInfo.username };
+    xTaskCreate(&iot_connect_task, "iot_connect_task", 10240, &connect, 5, NULL);
 
-	data.signup(fullName,connectionInfo.username);
-    data.init(fullName);
+    telemetryTask = xTaskGetCurrentTaskHandle();
+    xTaskCreatePinnedToCore(&sampler_task, "sampler_task", 4096, NULL, 10, NULL, SAMPLER_CORE);
+
+#if CONFIG_STORE_FORWARD
+    PartitionStorage logStorage(CONFIG_STORE_FORWARD_PARTITION);
+    SweepLog sweepLog(logStorage);
+    bool logMounted = logStorage.valid() && sweepLog.mount() == 0;
+    if (logMounted) {
+        // Sweeps logged before SNTP carry seconds since their boot, which
+        // this boot's offset cannot turn into wall time.
+        int stale = sweepLog.dropBefore(BOOT_CLOCK_VALID);
+        if (stale > 0) {
+            ESP_LOGW(TAG,"Log: dropped %d sweeps stamped before the clock was set",stale);
+        }
+        ESP_LOGI(TAG,"Log: %u sweeps pending",sweepLog.pending());
+    } else {
+        ESP_LOGE(TAG,"No store-and-forward log on partition %s",CONFIG_STORE_FORWARD_PARTITION);
+    }
+#endif
+
+#if CONFIG_HISTORY
+    PartitionStorage historyStorage(CONFIG_HISTORY_PARTITION);
+    if (historyStorage.valid() && historyStorage.size() < History::checkpointSize()) {
+        ESP_LOGE(TAG,"History: %u byte checkpoint does not fit partition %s (%u bytes), not saved",
+            History::checkpointSize(),CONFIG_HISTORY_PARTITION,historyStorage.size());
+    } else if (historyStorage.valid() && historyStorage.size() < 2 * History::checkpointSize()) {
+        ESP_LOGW(TAG,"History: partition %s holds one checkpoint, a reset while saving loses it",
+            CONFIG_HISTORY_PARTITION);
+    }
+    xSemaphoreTake(historyLock, portMAX_DELAY);
+    if (historyStorage.valid() && history.restore(historyStorage) == 0) {
+        ESP_LOGI(TAG,"History: restored %u sweeps from %u",history.rawSamples(),history.oldest(HISTORY_MINUTES));
+    }
+    xSemaphoreGive(historyLock);
+#if CONFIG_HISTORY_CHECKPOINT_MIN
+	uint32_t checkpoint_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+#endif
+#endif
+
+    sample_record_t record;
+    probe_sweep_t& sweep = record.sweep;
+#if !CONFIG_ADAPTIVE_RATE
+	float last_temp[MAX_PROBES] = {0,0,0,0};
+#endif
+#if CONFIG_METRICS
+	uint32_t metrics_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+#endif
+    for (;;) {
+		if (!sampleQueue.pop(&record)) {
+			ulTaskNotifyTake(pdTRUE, SAMPLE_INTERVAL_MS / portTICK_PERIOD_MS);
+			continue;
+		}
+		sample_num = record.seq % 10000;
+		uint32_t now_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+#if CONFIG_METRICS
+		if (now_ms - metrics_ms >= CONFIG_METRICS_INTERVAL_S * 1000) {
+			metrics_ms = now_ms;
+			sprintf(thing_id,"%s-%d-m",macAddress,sample_num);
+			publish_metrics(data, thing_id);
+		}
+#endif
+		METRIC_TIME(METRIC_SAMPLE);
+	    ESP_LOGD(TAG,"Sample: %d",sample_num);
+		TRACE(TRACE_SAMPLE, sample_num);
+		if (record.coalesced) {
+			ESP_LOGW(TAG,"Sample %d replaces %u",sample_num,record.coalesced);
+		}
 
-    time_t now = 0;
-    struct tm timeinfo;
+#if CONFIG_ALARMS
+		alarm_limits_t limits;
+		if (limitQueue.pop(&limits)) {
+			while (limitQueue.pop(&limits)) {
+			}
+			alarms.setLimits(&limits);
+			save_alarm_limits(&limits);
+			limits_pending = true;
+		}
+		if (limits_pending && data.isConnected()) {
+			sprintf(thing_id,"%s-%d-l",macAddress,sample_num);
+			limits_pending = !publish_alarm_limits(data, alarms.getLimits(), thing_id);
+		}
+		uint32_t alarmed = alarms.check(&sweep);
+		if (alarmed != 0) {
+			alarm_pending = true;
+			for (int i=0;i<sweep.count;i++) {
+				if (alarmed & (1u << i)) {
+					ESP_LOGW(TAG,"Probe %d alarm %s at %.1f",i,ALARM_STATE_NAMES[alarms.getState(i)],sweep.temp[i]);
+				}
+			}
+		}
+		if (alarm_pending && data.isConnected()) {
+			sprintf(thing_id,"%s-%d-a",macAddress,sample_num);
+			alarm_pending = !publish_alarm(data, &sweep, thing_id);
+		}
+#endif
 
-	float last_temp[4] = {0,0,0,0};
-	float temp[4] = {0,0,0,0};
-    for (sample_num = 0; sample_num<2; sample_num++) {
-	    ESP_LOGI(TAG,"Sample: %d",sample_num);    
-		time(&now);
-        localtime_r(&now, &timeinfo);
-		
-		temp[0] = getTemperature(ADC_TEMP1);
+#if CONFIG_LOCAL_SERVER || CONFIG_HISTORY || CONFIG_COOK_ESTIMATOR || CONFIG_TREND
+		probe_sweep_t stamped = sweep;
+		stamped.timestamp = BootClock::toWall(stamped.timestamp);
+#endif
+#if CONFIG_COOK_ESTIMATOR
+		for (int i=0;i<sweep.count;i++) {
+			estimators[i].update((uint32_t)stamped.timestamp, sweep.temp[i]);
+			cookEta[i] = estimators[i].eta(sweep.temp[i], alarms.getLimits()->upper[i]);
+		}
+#endif
+#if CONFIG_TREND
+		for (int i=0;i<sweep.count;i++) {
+			trend_event_t event = trends[i].update((uint32_t)stamped.timestamp, sweep.temp[i]);
+			if (event != TREND_NONE) {
+				ESP_LOGW(TAG,"Probe %d %s at %.1f, %.2f C/min",i,TREND_EVENT_NAMES[event],sweep.temp[i],trends[i].slope());
+				trend_pending = true;
+			}
+		}
+		if (trend_pending && data.isConnected()) {
+			sprintf(thing_id,"%s-%d-r",macAddress,sample_num);
+			trend_pending = !publish_trend(data, &sweep, thing_id);
+		}
+#endif
+#if CONFIG_LOCAL_SERVER
+		liveFeed.publish(&stamped);
+#endif
+#if CONFIG_HISTORY
+		if (BootClock::synced()) {
+			xSemaphoreTake(historyLock, portMAX_DELAY);
+			history.append(&stamped);
+			xSemaphoreGive(historyLock);
+		}
+#if CONFIG_HISTORY_CHECKPOINT_MIN
+		if (now_ms - checkpoint_ms >= CONFIG_HISTORY_CHECKPOINT_MIN * 60000) {
+			checkpoint_ms = now_ms;
+			xSemaphoreTake(historyLock, portMAX_DELAY);
+			int err = historyStorage.valid() ? history.checkpoint(historyStorage) : -1;
+			xSemaphoreGive(historyLock);
+			if (err != 0) {
+				ESP_LOGE(TAG,"History checkpoint to partition %s failed",CONFIG_HISTORY_PARTITION);
+			}
+		}
+#endif
+#endif
 
+#if CONFIG_ADAPTIVE_RATE
+		for (int i=0;i<sweep.count;i++) {
+			ESP_LOGD(TAG,"Probe %d: adc = %d, Temp = %f",i,sweep.raw[i],sweep.temp[i]);
+		}
+#if CONFIG_ALARMS
+		rate_decision_t decision = rateController.update(now_ms, &sweep, alarms.getLimits()->lower,
+			alarms.getLimits()->upper);
+#else
+		rate_decision_t decision = rateController.update(now_ms, &sweep, NULL, NULL);
+#endif
+		sampleIntervalMs = rateController.intervalMs();
+		METRIC_COUNT(decision == RATE_CHANGE ? METRIC_PUBLISH_CHANGE :
+			decision == RATE_HEARTBEAT ? METRIC_PUBLISH_HEARTBEAT : METRIC_SWEEPS_HELD);
+		METRIC_SET(METRIC_SAMPLE_INTERVAL, rateController.intervalMs());
+		METRIC_SET(METRIC_DEADBAND, (uint32_t)(rateController.getDeadband() * 100 + 0.5f));
+		METRIC_SET(METRIC_URGENCY, (uint32_t)(rateController.getUrgency() * 100 + 0.5f));
+		bool update = decision != RATE_HOLD;
+#else
 		bool update = false;
-		for (int i=0;i<4;i++) {
-			if (abs(last_temp[i]-temp[i]) > DELTA_TEMP) {
+		for (int i=0;i<sweep.count;i++) {
+			ESP_LOGD(TAG,"Probe %d: adc = %d, Temp = %f",i,sweep.raw[i],sweep.temp[i]);
+			if (abs(last_temp[i]-sweep.temp[i]) > DELTA_TEMP) {
 				update = true;
 			}
-			last_temp[i] = temp[i];
+			last_temp[i] = sweep.temp[i];
 		}
+#endif
+#if CONFIG_TELEMETRY_BATCH
 		if (update) {
-			//sprintf(thing_id,"%s-%d/%d;%d:%d",macAddress,timeinfo.tm_mon,timeinfo.tm_mday,timeinfo.tm_hour,timeinfo.tm_min);
+			batch.push(&sweep, now_ms);
+		}
+		if (batch.due(now_ms)) {
 			sprintf(thing_id,"%s-%d",macAddress,sample_num);
-			sprintf(JsonDocumentBuffer,
-				"{\"state\": {\"reported\": {\"username\":\"%s\",\"t\": [%0.1f,%0.1f,%0.1f]}}, \"clientToken\":\"%s\"}",
-				connectionInfo.username,temp[0],temp[1],temp[2],thing_id);
-
-			//TODO: add error checking
-			data.sendraw(JsonDocumentBuffer);
+			// Sweeps wait for the wall clock so they can be back-stamped.
+			// The queue copies the document, so the sweeps can go now.
+			// Restamped before logging too, so logged sweeps outlive a reboot.
+			int n = 0;
+			if (BootClock::synced()) {
+				batch.restamp(&BootClock::toWall);
+			}
+			if (data.isConnected() && BootClock::synced()) {
+				n = publish_batch(data, batch, connectionInfo.username, thing_id, publish_done, (void*)(intptr_t)sample_num);
+			}
+			if (n > 0) {
+				batch.consume(n, now_ms);
+				const batch_stats_t* stats = batch.getStats();
+				ESP_LOGI(TAG,"Batch: %d queued, %u samples in %u publishes (max %u), %u dropped",
+					n,stats->samples,stats->flushes,stats->maxPerFlush,stats->dropped);
+			}
+#if CONFIG_STORE_FORWARD
+			else if (logMounted) {
+				for (int i=0;i<batch.size();i++) {
+					sweepLog.append(batch.at(i));
+				}
+				batch.clear();
+			}
+#endif
+		}
+#else
+		if (update) {
+			// Until the wall clock is set sweeps go to the log, which is
+			// back-stamped when it drains.
+			bool ready = data.isConnected() && BootClock::synced();
+			sweep.timestamp = BootClock::toWall(sweep.timestamp);
+#if CONFIG_STORE_FORWARD
+			uint32_t slot = liveNext % LIVE_SLOTS;
+			liveUpdates[slot].sweep = sweep;
+			liveUpdates[slot].sample = sample_num;
+			publish_callback_t done = live_done;
+			void* context = (void*)(intptr_t)slot;
+#else
+			publish_callback_t done = publish_done;
+			void* context = (void*)(intptr_t)sample_num;
+#endif
+#if CONFIG_TELEMETRY_FORMAT_BINARY
+			uint8_t frame[32];
+			TelemetryEncoder encoder(frame, sizeof(frame));
+			{
+				METRIC_TIME(METRIC_ENCODE);
+				encoder.add(&sweep);
+			}
+			bool queued = ready &&
+				data.publishBinaryAsync(frame, encoder.length(), done, context) == SUCCESS;
+#else
+			sprintf(thing_id,"%s-%d",macAddress,sample_num);
+			bool queued = ready &&
+				format_sweep(JsonDocumentBuffer, sizeof(JsonDocumentBuffer), &sweep, connectionInfo.username, thing_id) &&
+				data.publishAsync(JsonDocumentBuffer, done, context) == SUCCESS;
+#endif
+			if (queued) {
+#if CONFIG_STORE_FORWARD
+				liveNext++;
+#endif
+				TRACE(TRACE_PUBLISH, sample_num);
+			} else {
+#if CONFIG_STORE_FORWARD
+				if (logMounted && sweepLog.append(&sweep) == 0) {
+					ESP_LOGW(TAG,"Update %d logged",sample_num);
+				} else
+#endif
+				ESP_LOGW(TAG,"Update %d dropped",sample_num);
+			}
+		}
+#endif
+#if CONFIG_STORE_FORWARD
+#if !CONFIG_TELEMETRY_BATCH
+		live_update_t unsent;
+		while (unsentUpdates.pop(unsent)) {
+			if (logMounted && sweepLog.append(&unsent.sweep) == 0) {
+				ESP_LOGW(TAG,"Update %d logged",unsent.sample);
+			} else {
+				ESP_LOGW(TAG,"Update %d dropped",unsent.sample);
+			}
+		}
+#endif
+		if (logMounted && sweepLog.pending() > 0 && data.isConnected() && BootClock::synced()) {
+			sprintf(thing_id,"%s-%d-log",macAddress,sample_num);
+			drain_log(sweepLog, data, connectionInfo.username, thing_id, sample_num);
 		}
+#endif
         
-		if (sample_num > 10000) {
-			sample_num = 0;
+		if (sample_num % 100 == 0) {
+			const shadow_stats_t* shadow = data.getStats();
+			ESP_LOGI(TAG,"Shadow: %u sent, %u accepted, %u rejected, %u timeouts, %u failed, in flight %u (max %u)",
+				shadow->sent,shadow->accepted,shadow->rejected,shadow->timeouts,shadow->failed,
+				shadow->inflight,shadow->maxInflight);
+			const sample_queue_stats_t* samples = sampleQueue.getStats();
+			ESP_LOGI(TAG,"Samples: %u taken, queue %u (max %u of %d), %u dropped, %u coalesced",
+				samples->pushed,sampleQueue.depth(),samples->maxDepth,SAMPLE_QUEUE_DEPTH,
+				samples->dropped,samples->coalesced);
+#if CONFIG_LOCAL_SERVER
+			const local_server_stats_t* local = LocalServer::getStats();
+			ESP_LOGI(TAG,"Local: %u requests, %u streaming (max %u), %u refused, %u frames, %u skipped",
+				local->requests,local->clients,local->maxClients,local->refused,local->frames,local->skipped);
+#endif
 		}
-		temp[1] = temp[1]+500;
+    }
+}
+
+#if CONFIG_DUTY_CYCLE
+/**
+ * End this wake and sleep until the next sweep is due.
+ */
+static void duty_cycle_sleep() {
+	duty.sleeping(xTaskGetTickCount() * portTICK_PERIOD_MS, CONFIG_DUTY_CYCLE_WAKE_S * 1000);
+	const duty_cycle_state_t* state = duty.getState();
+	ESP_LOGI(TAG,"Duty cycle: %u wakes, %u publishes, %u ms awake; sleeping %d s",
+		state->wakes,state->publishes,state->awakeMs,CONFIG_DUTY_CYCLE_WAKE_S);
+	esp_deep_sleep((uint64_t)CONFIG_DUTY_CYCLE_WAKE_S * 1000000);
+}
+
+/**
+ * Duty cycle counterpart of aws_iot_task: publish the sweep taken in
+ * app_main, wait for the ack, and go back to sleep.
+ */
+void duty_cycle_task(void *param) {
+    connection_info_t connectionInfo;
+    getConnectionInfo(&connectionInfo);
+    char macAddress[14];
+    get_mac_address(macAddress);
+    char fullName[256];
+    sprintf(fullName,"BBQTemp_%s",macAddress);
+    char thing_id[32];
+    sprintf(thing_id,"%s-%u",macAddress,duty.getState()->wakes);
+
+    IotDataMqtt data;
+    data.signup(fullName,connectionInfo.username);
+    data.init(fullName);
+    BootClock::mark(BOOT_MQTT);
+
+    // On a cold boot SNTP was started with WiFi; the sweep predates it.
+    wait_for_time();
+    dutySweep.timestamp = BootClock::toWall(dutySweep.timestamp);
+
+    char JsonDocumentBuffer[MAX_LENGTH_OF_UPDATE_JSON_BUFFER];
+    if (format_sweep(JsonDocumentBuffer, sizeof(JsonDocumentBuffer), &dutySweep, connectionInfo.username, thing_id) &&
+            data.sendraw(JsonDocumentBuffer) == PUBLISH_ACCEPTED) {
+        duty.published(dutySweep.temp, dutySweep.count);
+        BootClock::mark(BOOT_PUBLISH);
+        BootClock::report();
     }
     data.close();
-    vTaskDelete(NULL);
+    duty_cycle_sleep();
 }
+#endif
 
 void wifi_setup_done(int rc) {
     printf("Wifi setup done\n");
-    obtain_time();
+    BootClock::mark(BOOT_WIFI);
+#if CONFIG_DUTY_CYCLE
+    dutyConnected = true;
+    // The RTC keeps the time through deep sleep; only a cold boot needs SNTP.
+    if (!duty.resumed()) {
+        initialize_sntp();
+    }
+    xTaskCreate(&duty_cycle_task, "duty_cycle_task", 36*1024, NULL, 5, NULL);
+#else
+    // SNTP runs in the background. TLS does not check certificate dates
+    // (no MBEDTLS_HAVE_TIME_DATE) so it connects meanwhile, and sweeps
+    // taken before the clock is set are back-stamped.
+    initialize_sntp();
+#if CONFIG_HISTORY
+    if (!historyLock) {
+        historyLock = xSemaphoreCreateMutex();
+    }
+#endif
+#if CONFIG_LOCAL_SERVER
+#if CONFIG_HISTORY
+    LocalServer::serveHistory(&history, historyLock);
+#endif
+    LocalServer::start(&liveFeed);
+    bootWiFiOnAccessPoint(&LocalServer::stop);
+#endif
     xTaskCreate(&aws_iot_task, "aws_iot_task", 36*1024, NULL, 5, NULL);
+#endif
 }
 
 /**
@@ -163,43 +1012,81 @@ static void clearConfig() {
 
 
 
-extern "C" void app_main(void)
-{
-    // Setup IO
+/**
+ * Blink the LED, then check the reset button.  The button is GPIO0, which
+ * selects the bootloader if held at reset, so it is read only once the
+ * blinking shows the app is up.  Clearing the config restarts into AP mode.
+ */
+static void led_task(void *param) {
+    int blinks = (int)(intptr_t)param;
+
 	gpio_pad_select_gpio(CONFIG_RESET_GPIO);
 	gpio_set_direction(CONFIG_RESET_GPIO, GPIO_MODE_INPUT);
 
     gpio_set_direction(GPIO_NUM_5, GPIO_MODE_OUTPUT);
-    adc1_config_width(ADC_WIDTH_12Bit);
-    adc1_config_channel_atten(ADC_TEMP1,ADC_ATTEN_11db);
 
     // blink LED
     int level = 0;
-    for (int c=0;c<10;c++) {
+    for (int c=0;c<blinks;c++) {
         gpio_set_level(GPIO_NUM_5, level);
         level = !level;
         vTaskDelay(300 / portTICK_PERIOD_MS);
     }
     //check reset button and clear config if pushed
-	nvs_flash_init();
     if (!gpio_get_level(CONFIG_RESET_GPIO)) {
         ESP_LOGW(TAG,"Button pressed, clearing config");
         clearConfig();
+        esp_restart();
+    }
+    vTaskDelete(NULL);
+}
+
+extern "C" void app_main(void)
+{
+    int blinks = 10;
+#if CONFIG_DUTY_CYCLE
+    // No LED show on a timer wake, it is awake time on battery.
+    if (duty.resume()) {
+        blinks = 0;
     }
+#endif
+
+    BootClock::mark(BOOT_APP_MAIN);
+
+    // NVS first, WiFi needs it; the LED blinks meanwhile.
+	nvs_flash_init();
+    BootClock::mark(BOOT_NVS);
+    xTaskCreate(&led_task, "led_task", 2048, (void*)(intptr_t)blinks, 5, NULL);
+
+#if CONFIG_DUTY_CYCLE
+    // Sweep before WiFi, and skip WiFi altogether if nothing changed.
+    // Without saved WiFi settings stay up for setup in AP mode.
+    Adc1Reader adc;
+    ProbeSampler sampler(adc, PROBES, NUM_PROBES);
+    sampler.init();
+    sampler.setOversample(CONFIG_PROBE_OVERSAMPLE_BITS);
+    sampler.sweep(&dutySweep);
+    connection_info_t connectionInfo;
+    bool configured = getConnectionInfo(&connectionInfo) == 0;
+    if (configured && !duty.due(dutySweep.temp, dutySweep.count)) {
+        duty_cycle_sleep();
+    }
+#endif
     
     //Init Wifi; call callback when done
     bootWiFi(wifi_setup_done);
 
     vTaskDelay(1000 / portTICK_PERIOD_MS);
 
-    /*
-    struct timeval now;
-    gettimeofday(&now, NULL);
-    int sleep_time_ms = (now.tv_sec - sleep_enter_time.tv_sec) * 1000 + (now.tv_usec - sleep_enter_time.tv_usec) / 1000;
-    const int wakeup_time_sec = 20;
-    printf("Enabling timer wakeup, %ds\n", wakeup_time_sec);
-    esp_deep_sleep_enable_timer_wakeup(wakeup_time_sec * 1000000);
-    */
-
+#if CONFIG_DUTY_CYCLE
+    // Give up on this wake if the station does not connect in time; the
+    // next wake tries again.
+    if (configured) {
+        vTaskDelay(CONFIG_DUTY_CYCLE_CONNECT_TIMEOUT_S * 1000 / portTICK_PERIOD_MS);
+        if (!dutyConnected) {
+            ESP_LOGW(TAG,"No connection in %d s",CONFIG_DUTY_CYCLE_CONNECT_TIMEOUT_S);
+            duty_cycle_sleep();
+        }
+    }
+#endif
 }
-
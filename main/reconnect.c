@@ -0,0 +1,70 @@
+/**
+ * Station reconnect policy, see reconnect.h.
+ */
+#include <string.h>
+#include "reconnect.h"
+
+void reconnect_init(reconnect_t *r, uint32_t baseMs, uint32_t maxMs, int jitterPct, int threshold) {
+	memset(r, 0, sizeof(*r));
+	r->baseMs = baseMs > 0 ? baseMs : 1;
+	r->maxMs = maxMs > r->baseMs ? maxMs : r->baseMs;
+	r->jitterPct = jitterPct < 0 ? 0 : jitterPct > 100 ? 100 : jitterPct;
+	r->threshold = threshold;
+} // reconnect_init
+
+
+/**
+ * The station has an IP address again.
+ */
+void reconnect_up(reconnect_t *r, uint32_t nowMs) {
+	if (!r->up && r->wasUp) {
+		uint32_t ms = nowMs - r->downSinceMs;
+		r->stats.reconnects++;
+		r->stats.lastReconnectMs = ms;
+		r->stats.totalReconnectMs += ms;
+		if (ms > r->stats.maxReconnectMs) {
+			r->stats.maxReconnectMs = ms;
+		}
+	}
+	r->up = 1;
+	r->wasUp = 1;
+	r->failures = 0;
+} // reconnect_up
+
+
+/**
+ * The link went down, or a connect attempt failed.  Returns the delay in
+ * ms before the next attempt, or -1 once threshold attempts in a row have
+ * failed and the caller should fall back to access point mode.
+ */
+int32_t reconnect_down(reconnect_t *r, uint32_t nowMs, uint32_t random) {
+	if (r->up) {
+		r->up = 0;
+		r->downSinceMs = nowMs;
+		r->stats.disconnects++;
+	} else {
+		r->failures++;
+	}
+	if (r->threshold > 0 && r->failures >= r->threshold) {
+		r->failures = 0;
+		r->wasUp = 0;
+		r->stats.fallbacks++;
+		return -1;
+	}
+
+	// base * 2^failures, capped, then spread by +/- jitterPct so a room
+	// full of probes does not retry in step after the router restarts.
+	uint32_t delay = r->baseMs;
+	for (int i = 0; i < r->failures && delay < r->maxMs; i++) {
+		delay *= 2;
+	}
+	if (delay > r->maxMs) {
+		delay = r->maxMs;
+	}
+	uint32_t spread = (uint32_t)((uint64_t) delay * r->jitterPct / 100);
+	if (spread > 0) {
+		delay = delay - spread + random % (2 * spread + 1);
+	}
+	r->stats.attempts++;
+	return (int32_t) delay;
+} // reconnect_down
@@ -0,0 +1,41 @@
+/*
+ * reconnect.h
+ *
+ * Station reconnect policy: exponential backoff with jitter and a limit
+ * on consecutive failures.  Plain C with no ESP-IDF calls; the caller
+ * feeds it link events, the time and a random number, so it can be driven
+ * by a fake event source off target.
+ */
+
+#ifndef MAIN_RECONNECT_H_
+#define MAIN_RECONNECT_H_
+
+#include <stdint.h>
+
+typedef struct {
+	uint32_t disconnects;		// link lost after being up
+	uint32_t attempts;			// reconnect attempts scheduled
+	uint32_t reconnects;		// link back up after a disconnect
+	uint32_t fallbacks;			// gave up and became an access point
+	uint32_t lastReconnectMs;	// time from disconnect to IP, last outage
+	uint32_t maxReconnectMs;
+	uint32_t totalReconnectMs;
+} reconnect_stats_t;
+
+typedef struct {
+	uint32_t baseMs;	// first retry delay
+	uint32_t maxMs;		// cap on the delay
+	int jitterPct;		// +/- random spread of each delay
+	int threshold;		// consecutive failures before giving up, 0 = never
+	int failures;
+	int up;
+	int wasUp;			// has been up since the last give up
+	uint32_t downSinceMs;
+	reconnect_stats_t stats;
+} reconnect_t;
+
+void reconnect_init(reconnect_t *r, uint32_t baseMs, uint32_t maxMs, int jitterPct, int threshold);
+void reconnect_up(reconnect_t *r, uint32_t nowMs);
+int32_t reconnect_down(reconnect_t *r, uint32_t nowMs, uint32_t random);
+
+#endif /* MAIN_RECONNECT_H_ */
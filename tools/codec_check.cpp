@@ -0,0 +1,295 @@
+/**
+ * Round trip and edge case checks for the binary telemetry codec
+ * (main/TelemetryCodec.hpp), on the host.
+ *
+ *   cd tools
+ *   g++ -std=gnu++11 -O2 -Ihost -I../main -o codec_check codec_check.cpp ../main/TelemetryCodec.cpp
+ *   ./codec_check [-n frames] [-v]
+ *
+ * Random frames: n frames (default 20000) of 1 to 40 sweeps of 1 to
+ * MAX_PROBES probes, in buffers from 8 to 512 bytes.  Temperatures walk
+ * over the range the thermistor table produces (-273.1 to 1134.7 degC)
+ * with an occasional jump across all of it, timestamps step forward by
+ * 0 to 600 s and now and then back, or across the 32 bit wrap.  Every
+ * sweep the encoder takes must decode to its timestamp and its
+ * temperatures to within 0.05 degC, in order, and nothing more.
+ *
+ * Edge cases: named checks of empty, unknown version, bad probe count,
+ * truncated and over-long frames, a probe count change, a full buffer,
+ * and the extremes of each field.  A frame cut at any byte must decode to
+ * a prefix of its sweeps and never to anything else.  -v lists every
+ * check.  Exits non-zero on any failure.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "TelemetryCodec.hpp"
+
+static const float MIN_TEMP = -273.1f;
+static const float MAX_TEMP = 1134.7f;
+static const int MAX_SWEEPS = 40;
+
+static bool verbose;
+static int checks, failures;
+
+static void check(const char* name, bool ok) {
+	checks++;
+	if (!ok) {
+		failures++;
+	}
+	if (verbose || !ok) {
+		printf("  %-48s %s\n", name, ok ? "ok" : "FAILED");
+	}
+}
+
+static float uniform(float lo, float hi) {
+	return lo + (hi - lo) * (rand() / (float) RAND_MAX);
+}
+
+static probe_sweep_t make_sweep(uint32_t ts, int count, float t0, float t1 = 0, float t2 = 0, float t3 = 0) {
+	probe_sweep_t sweep;
+	memset(&sweep, 0, sizeof(sweep));
+	sweep.timestamp = ts;
+	sweep.count = count;
+	float t[] = { t0, t1, t2, t3 };
+	for (int i = 0; i < count && i < MAX_PROBES; i++) {
+		sweep.temp[i] = t[i];
+	}
+	return sweep;
+}
+
+static bool same(const probe_sweep_t& a, const probe_sweep_t& b) {
+	if ((uint32_t) a.timestamp != (uint32_t) b.timestamp || a.count != b.count) {
+		return false;
+	}
+	for (int i = 0; i < a.count; i++) {
+		if (fabsf(a.temp[i] - b.temp[i]) > 0.05f + 1e-3f) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Every sweep in a frame.  Returns false if it is not valid.
+static bool decode(const uint8_t* buf, size_t len, std::vector<probe_sweep_t>& out) {
+	out.clear();
+	TelemetryDecoder decoder(buf, len);
+	if (!decoder.valid()) {
+		return false;
+	}
+	probe_sweep_t sweep;
+	while (decoder.next(&sweep)) {
+		out.push_back(sweep);
+	}
+	return true;
+}
+
+static bool decodes_to(const uint8_t* buf, size_t len, const std::vector<probe_sweep_t>& want, size_t n) {
+	std::vector<probe_sweep_t> got;
+	decode(buf, len, got);
+	if (got.size() != n) {
+		return false;
+	}
+	for (size_t i = 0; i < n; i++) {
+		if (!same(got[i], want[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Whether every cut of the frame decodes to a prefix of its sweeps.
+static bool cuts_ok(const uint8_t* buf, size_t len, const std::vector<probe_sweep_t>& sweeps) {
+	for (size_t cut = 0; cut < len; cut++) {
+		std::vector<uint8_t> copy(buf, buf + cut);
+		std::vector<probe_sweep_t> got;
+		decode(copy.empty() ? NULL : &copy[0], cut, got);
+		if (got.size() > sweeps.size()) {
+			return false;
+		}
+		for (size_t i = 0; i < got.size(); i++) {
+			if (!same(got[i], sweeps[i])) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static void edge_cases() {
+	uint8_t buf[256] = {};
+	std::vector<probe_sweep_t> got;
+
+	check("empty frame is not valid", !decode(buf, 0, got));
+	buf[0] = (TELEMETRY_CODEC_VERSION + 1) << 4 | 4;
+	buf[1] = 0;
+	check("unknown version is not valid", !decode(buf, 2, got));
+	buf[0] = TELEMETRY_CODEC_VERSION << 4;
+	check("zero probes is not valid", !decode(buf, 2, got));
+	buf[0] = TELEMETRY_CODEC_VERSION << 4 | (MAX_PROBES + 1);
+	check("more than MAX_PROBES is not valid", !decode(buf, 2, got));
+	buf[0] = TELEMETRY_CODEC_VERSION << 4 | 1;
+	check("header alone has no sweeps", decode(buf, 1, got) && got.empty());
+
+	// A timestamp varint that never ends.
+	buf[0] = TELEMETRY_CODEC_VERSION << 4 | 1;
+	memset(buf + 1, 0x80, 6);
+	buf[7] = 0;
+	check("over-long varint is rejected", decode(buf, 9, got) && got.empty());
+
+	{
+		TelemetryEncoder encoder(buf, sizeof(buf));
+		probe_sweep_t a = make_sweep(100, 2, 20, 21), b = make_sweep(101, 3, 20, 21, 22);
+		encoder.add(&a);
+		size_t len = encoder.length();
+		check("probe count change is refused", !encoder.add(&b) && encoder.length() == len &&
+			encoder.sweepCount() == 1);
+	}
+	{
+		std::vector<probe_sweep_t> sweeps;
+		TelemetryEncoder encoder(buf, 12);
+		int refused = 0;
+		for (uint32_t ts = 0; ts < 10; ts++) {
+			probe_sweep_t s = make_sweep(1700000000 + ts * 60, 4, 20.5f * ts, -5, 300, 1000);
+			size_t len = encoder.length();
+			if (encoder.add(&s)) {
+				sweeps.push_back(s);
+			} else {
+				refused += encoder.length() == len;
+			}
+		}
+		check("full buffer refuses and leaves the frame", refused > 0 && encoder.length() <= 12 &&
+			decodes_to(buf, encoder.length(), sweeps, sweeps.size()));
+	}
+	{
+		TelemetryEncoder encoder(buf, 4);
+		probe_sweep_t s = make_sweep(1700000000, 4, 20, 20, 20, 20);
+		check("first sweep too big for the buffer is refused", !encoder.add(&s) && encoder.length() == 0);
+	}
+
+	// Field extremes, each as the first sweep and as a delta.
+	std::vector<probe_sweep_t> sweeps;
+	sweeps.push_back(make_sweep(0, 4, MIN_TEMP, MAX_TEMP, 0, -0.04f));
+	sweeps.push_back(make_sweep(0xFFFFFFFF, 4, MAX_TEMP, MIN_TEMP, 0.05f, 0.04f));
+	sweeps.push_back(make_sweep(5, 4, MIN_TEMP, MAX_TEMP, -0.05f, 3276.7f));
+	sweeps.push_back(make_sweep(4, 4, -3276.8f, 3276.7f, 99.95f, -3276.8f));
+	sweeps.push_back(make_sweep(0x80000000, 4, 3276.7f, -3276.8f, 0, 0));
+	sweeps.push_back(make_sweep(0, 4, 0, 0, 0, 0));
+	TelemetryEncoder encoder(buf, sizeof(buf));
+	bool all = true;
+	for (size_t i = 0; i < sweeps.size(); i++) {
+		all = all && encoder.add(&sweeps[i]);
+	}
+	check("field extremes and timestamp wraps round trip", all &&
+		decodes_to(buf, encoder.length(), sweeps, sweeps.size()));
+	check("field extremes: every cut decodes to a prefix", cuts_ok(buf, encoder.length(), sweeps));
+
+	{
+		probe_sweep_t a = make_sweep(1700000000, 1, 21.04f), b = make_sweep(1700000001, 1, 21.06f);
+		probe_sweep_t c = make_sweep(1700000002, 1, -21.06f);
+		TelemetryEncoder e(buf, sizeof(buf));
+		e.add(&a);
+		e.add(&b);
+		e.add(&c);
+		decode(buf, e.length(), got);
+		check("temperatures round to 0.1 degC", got.size() == 3 && fabsf(got[0].temp[0] - 21.0f) < 1e-4f &&
+			fabsf(got[1].temp[0] - 21.1f) < 1e-4f && fabsf(got[2].temp[0] + 21.1f) < 1e-4f);
+	}
+	{
+		// A steady sweep should cost a byte per value.
+		TelemetryEncoder e(buf, sizeof(buf));
+		probe_sweep_t a = make_sweep(1700000000, 4, 110, 112.5f, 65, 70);
+		e.add(&a);
+		size_t first = e.length();
+		a.timestamp += 1;
+		a.temp[0] += 0.1f;
+		e.add(&a);
+		check("slowly changing sweep is 1 byte per value", e.length() - first == 1 + 4);
+	}
+}
+
+// A random frame: returns the sweeps the encoder took.
+static std::vector<probe_sweep_t> random_frame(uint8_t* buf, size_t size, size_t* len) {
+	std::vector<probe_sweep_t> taken;
+	TelemetryEncoder encoder(buf, size);
+	int count = 1 + rand() % MAX_PROBES;
+	int n = 1 + rand() % MAX_SWEEPS;
+	uint32_t ts = rand() % 4 == 0 ? 0xFFFFFFFF - rand() % 3600 : 1700000000 + rand() % 100000;
+	float t[MAX_PROBES];
+	for (int i = 0; i < MAX_PROBES; i++) {
+		t[i] = uniform(-20, 300);
+	}
+	for (int s = 0; s < n; s++) {
+		ts += rand() % 20 == 0 ? -(uint32_t) (rand() % 600) : rand() % 601;
+		for (int i = 0; i < count; i++) {
+			t[i] = rand() % 50 == 0 ? uniform(MIN_TEMP, MAX_TEMP) : t[i] + uniform(-3, 3);
+			t[i] = t[i] < MIN_TEMP ? MIN_TEMP : t[i] > MAX_TEMP ? MAX_TEMP : t[i];
+		}
+		probe_sweep_t sweep = make_sweep(ts, count, t[0], t[1], t[2], t[3]);
+		size_t before = encoder.length();
+		if (encoder.add(&sweep)) {
+			taken.push_back(sweep);
+		} else if (encoder.length() != before) {
+			taken.clear();
+			break;
+		}
+	}
+	*len = encoder.length();
+	return taken;
+}
+
+static void usage(const char* name) {
+	fprintf(stderr, "usage: %s [-n frames] [-v]\n", name);
+	exit(2);
+}
+
+int main(int argc, char** argv) {
+	int frames = 20000;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:v")) != -1) {
+		switch (opt) {
+		case 'n': frames = atoi(optarg); break;
+		case 'v': verbose = true; break;
+		default: usage(argv[0]);
+		}
+	}
+	if (frames < 1 || optind != argc) {
+		usage(argv[0]);
+	}
+
+	printf("edge cases:\n");
+	edge_cases();
+
+	srand(1);
+	int bad = 0, badCuts = 0;
+	uint64_t sweeps = 0, values = 0, bytes = 0;
+	for (int f = 0; f < frames; f++) {
+		size_t size = 8 + rand() % 505;
+		std::vector<uint8_t> buf(size);
+		size_t len;
+		std::vector<probe_sweep_t> taken = random_frame(&buf[0], size, &len);
+		// A buffer too small for the first sweep leaves the frame empty.
+		bool ok = len <= size && (taken.empty() ? len == 0 : decodes_to(&buf[0], len, taken, taken.size()));
+		bad += !ok;
+		// Every cut costs a decode per byte; a sample is plenty.
+		if (f % 20 == 0 && !cuts_ok(&buf[0], len, taken)) {
+			badCuts++;
+		}
+		if (!taken.empty()) {
+			sweeps += taken.size();
+			values += taken.size() * (1 + taken[0].count);
+			bytes += len;
+		}
+	}
+	checks += 2;
+	failures += (bad > 0) + (badCuts > 0);
+	printf("random frames: %d frames, %llu sweeps, %.2f bytes per value, %d mismatched, %d bad cuts of %d\n",
+		frames, (unsigned long long) sweeps, (double) bytes / values, bad, badCuts, (frames + 19) / 20);
+	printf("%d checks, %d failed\n", checks, failures);
+	return failures ? 1 : 0;
+}
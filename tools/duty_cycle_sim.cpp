@@ -0,0 +1,125 @@
+/**
+ * Host simulator for the deep sleep duty cycle (main/DutyCycle.hpp).
+ *
+ * Replays a recorded cook trace through the same wake/publish decision the
+ * firmware makes and reports wake and publish counts and the projected
+ * charge used, against staying awake with WiFi connected.
+ *
+ *   g++ -std=gnu++11 -I../main -o duty_cycle_sim duty_cycle_sim.cpp ../main/DutyCycle.cpp
+ *   ./duty_cycle_sim trace.csv [wake_s [max_silence_s [delta]]]
+ *
+ * The trace has one sweep per line, "seconds,t1,t2,...", in degrees C and
+ * ascending time; lines that do not parse are skipped.  The current and
+ * duration figures below are typical ESP32 values; adjust them for the
+ * board being measured.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "DutyCycle.hpp"
+
+static const double SLEEP_MA = 0.01;		// deep sleep, RTC memory kept
+static const double SAMPLE_MA = 40;			// wake from deep sleep and sweep
+static const uint32_t SAMPLE_MS = 150;
+static const double PUBLISH_MA = 120;		// WiFi, TLS, shadow update and ack
+static const uint32_t PUBLISH_MS = 4000;
+static const double ALWAYS_ON_MA = 110;		// station connected, no sleep
+static const double BATTERY_MAH = 2000;
+
+typedef struct {
+	uint32_t seconds;
+	int count;
+	float temp[DUTY_CYCLE_MAX_PROBES];
+} trace_row_t;
+
+static int parseRow(char* line, trace_row_t* row) {
+	char* end;
+	row->seconds = strtoul(line, &end, 10);
+	if (end == line) {
+		return -1;
+	}
+	row->count = 0;
+	while (*end == ',' && row->count < DUTY_CYCLE_MAX_PROBES) {
+		char* p = end + 1;
+		row->temp[row->count] = strtof(p, &end);
+		if (end == p) {
+			return -1;
+		}
+		row->count++;
+	}
+	return row->count > 0 ? 0 : -1;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s trace.csv [wake_s [max_silence_s [delta]]]\n", argv[0]);
+		return 2;
+	}
+	FILE* f = fopen(argv[1], "r");
+	if (f == NULL) {
+		perror(argv[1]);
+		return 1;
+	}
+	uint32_t wakeS = argc > 2 ? atoi(argv[2]) : 30;
+	uint32_t maxSilenceS = argc > 3 ? atoi(argv[3]) : 600;
+	float delta = argc > 4 ? atof(argv[4]) : 2;
+	if (wakeS == 0) {
+		fprintf(stderr, "wake interval must be at least 1 s\n");
+		return 2;
+	}
+
+	duty_cycle_state_t state;
+	memset(&state, 0, sizeof(state));
+	DutyCycle duty(&state, delta, maxSilenceS * 1000);
+
+	char line[256];
+	trace_row_t row, current;
+	bool haveRow = false;
+	uint32_t start = 0, nextWake = 0;
+	double mAs = 0;
+	while (fgets(line, sizeof(line), f)) {
+		if (parseRow(line, &row) != 0) {
+			continue;
+		}
+		if (!haveRow) {
+			start = nextWake = row.seconds;
+			haveRow = true;
+		}
+		// Wakes before this row see the previous one.
+		while (nextWake < row.seconds) {
+			duty.resume();
+			uint32_t awakeMs = SAMPLE_MS;
+			mAs += SAMPLE_MA * SAMPLE_MS / 1000.0;
+			if (duty.due(current.temp, current.count)) {
+				duty.published(current.temp, current.count);
+				awakeMs += PUBLISH_MS;
+				mAs += PUBLISH_MA * PUBLISH_MS / 1000.0;
+			}
+			duty.sleeping(awakeMs, wakeS * 1000);
+			mAs += SLEEP_MA * wakeS;
+			nextWake += wakeS;
+		}
+		current = row;
+	}
+	fclose(f);
+
+	uint32_t last = current.seconds;
+	if (!haveRow || last == start) {
+		fprintf(stderr, "trace needs at least two rows\n");
+		return 1;
+	}
+	double hours = (last - start) / 3600.0;
+	double mAh = mAs / 3600;
+	double alwaysOnMAh = ALWAYS_ON_MA * hours;
+	printf("trace       %.2f h, wake every %u s, silence %u s, delta %.1f\n", hours, wakeS, maxSilenceS, delta);
+	printf("wakes       %u\n", state.wakes);
+	printf("publishes   %u (%.1f%% of wakes)\n", state.publishes,
+		state.wakes ? 100.0 * state.publishes / state.wakes : 0);
+	printf("awake       %.1f s\n", state.awakeMs / 1000.0);
+	printf("charge      %.2f mAh, average %.2f mA\n", mAh, mAh / hours);
+	printf("always on   %.2f mAh, average %.2f mA\n", alwaysOnMAh, ALWAYS_ON_MA);
+	printf("%.0f mAh    %.1f days duty cycled, %.1f days always on\n", BATTERY_MAH,
+		BATTERY_MAH / (mAh / hours) / 24, BATTERY_MAH / ALWAYS_ON_MA / 24);
+	return 0;
+}
@@ -0,0 +1,148 @@
+/**
+ * Replays cooks through the cook estimator (main/CookEstimator.hpp) on the
+ * host and reports how good its finish time estimates were.
+ *
+ *   cd tools
+ *   g++ -std=gnu++11 -O2 -Ihost -I../main -o eta_replay eta_replay.cpp ../main/CookEstimator.cpp
+ *   ./eta_replay [-g targets] [-s stride_s] [-m memory_s] [-n] [-w out.csv] [cook.csv]
+ *
+ * cook.csv is as described in host/SimCook.hpp.  Without one, a synthetic
+ * overnight cook is generated: a pit at 110 with the lid opened every 30
+ * minutes, a brisket and a pork shoulder that stall in the high 60s (not
+ * with -n), and a chicken.  -w writes the cook replayed, so it can be
+ * edited or compared.  targets is a comma separated list per probe, "-"
+ * for none (default -,95,93,74).
+ *
+ * For each probe with a target, the estimate of the finish time (ts +
+ * eta) is compared with when the probe actually got there, at a quarter,
+ * half, three quarters and 90% of the way through the cook and on
+ * average over the whole cook, next to a straight line extrapolation of
+ * the current slope.  Also reports CPU per update.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "CookEstimator.hpp"
+#include "SimCook.hpp"
+
+static const float DEFAULT_TARGETS[MAX_COLUMNS] = { NAN, 95, 93, 74, NAN, NAN, NAN, NAN };
+static const float CHECKPOINTS[] = { 0.25f, 0.5f, 0.75f, 0.9f };
+static const int NUM_CHECKPOINTS = sizeof(CHECKPOINTS) / sizeof(CHECKPOINTS[0]);
+
+static void usage(const char* name) {
+	fprintf(stderr, "usage: %s [-g targets] [-s stride_s] [-m memory_s] [-n] [-w out.csv] [cook.csv]\n", name);
+	exit(2);
+}
+
+int main(int argc, char** argv) {
+	float targets[MAX_COLUMNS];
+	memcpy(targets, DEFAULT_TARGETS, sizeof(targets));
+	uint32_t strideS = 30;
+	uint32_t memoryS = 1800;
+	const char* out = NULL;
+	bool stalls = true;
+	int opt;
+	while ((opt = getopt(argc, argv, "g:s:m:nw:")) != -1) {
+		switch (opt) {
+		case 'g': {
+			char* p = optarg;
+			for (int c = 0; c < MAX_COLUMNS && *p; c++) {
+				targets[c] = *p == '-' ? NAN : strtof(p, NULL);
+				p = strchr(p, ',');
+				if (!p) {
+					for (c++; c < MAX_COLUMNS; c++) {
+						targets[c] = NAN;
+					}
+					break;
+				}
+				p++;
+			}
+			break;
+		}
+		case 's': strideS = atoi(optarg); break;
+		case 'm': memoryS = atoi(optarg); break;
+		case 'n': stalls = false; break;
+		case 'w': out = optarg; break;
+		default: usage(argv[0]);
+		}
+	}
+	if (strideS < 1 || memoryS <= strideS || optind < argc - 1) {
+		usage(argv[0]);
+	}
+	srand(1);
+	std::vector<cook_row_t> rows;
+	int columns = optind < argc ? read_cook(argv[optind], rows) : synthetic_cook(rows, stalls);
+	if (rows.empty()) {
+		fprintf(stderr, "no sweeps\n");
+		return 1;
+	}
+	if (out) {
+		write_cook(out, rows, columns);
+	}
+
+	std::vector<CookEstimator> estimators(columns, CookEstimator(strideS, memoryS));
+	std::vector<std::vector<float> > etas(columns, std::vector<float>(rows.size()));
+	std::vector<std::vector<float> > lines(columns, std::vector<float>(rows.size()));
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < rows.size(); i++) {
+		for (int c = 0; c < columns; c++) {
+			estimators[c].update(rows[i].ts, rows[i].t[c]);
+			etas[c][i] = estimators[c].eta(rows[i].t[c], targets[c]);
+			float slope = estimators[c].rate();
+			lines[c][i] = slope > 0 && rows[i].t[c] < targets[c] ? (targets[c] - rows[i].t[c]) / slope * 60 : NAN;
+		}
+	}
+	double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() /
+		(rows.size() * columns);
+
+	printf("%u sweeps of %d probes over %.1f hours, stride %u s, memory %u s\n",
+		(unsigned) rows.size(), columns, (rows.back().ts - rows[0].ts) / 3600.0, strideS, memoryS);
+	printf("finish time error, minutes (estimator / straight line):\n");
+	printf("  probe target   done    25%%          50%%          75%%          90%%          mean       known\n");
+	for (int c = 0; c < columns; c++) {
+		if (isnan(targets[c])) {
+			continue;
+		}
+		size_t done = 0;
+		while (done < rows.size() && rows[done].t[c] < targets[c]) {
+			done++;
+		}
+		if (done == rows.size()) {
+			printf("  t%-4d %6.1f  never reached\n", c + 1, targets[c]);
+			continue;
+		}
+		uint32_t finish = rows[done].ts;
+		printf("  t%-4d %6.1f  %5.1fh", c + 1, targets[c], (finish - rows[0].ts) / 3600.0);
+		for (int k = 0; k < NUM_CHECKPOINTS; k++) {
+			size_t i = (size_t) (CHECKPOINTS[k] * done);
+			printf(" %5.0f/%-6.0f", (rows[i].ts + etas[c][i] - finish) / 60.0, (rows[i].ts + lines[c][i] - finish) / 60.0);
+		}
+		double sum = 0, lineSum = 0;
+		size_t known = 0, lineKnown = 0;
+		for (size_t i = 0; i < done; i++) {
+			if (!isnan(etas[c][i])) {
+				sum += fabs(rows[i].ts + etas[c][i] - finish);
+				known++;
+			}
+			if (!isnan(lines[c][i])) {
+				lineSum += fabs(rows[i].ts + lines[c][i] - finish);
+				lineKnown++;
+			}
+		}
+		printf(" %5.0f/%-6.0f %3.0f%%/%.0f%%\n", known ? sum / known / 60 : NAN, lineKnown ? lineSum / lineKnown / 60 : NAN,
+			100.0 * known / done, 100.0 * lineKnown / done);
+	}
+	for (int c = 0; c < columns; c++) {
+		printf("  t%d: %u slopes fitted, %u rejected, heading for %.1f\n", c + 1,
+			estimators[c].getFits(), estimators[c].getRejected(), estimators[c].ambient());
+	}
+	printf("update + eta: %.0f ns per probe (host)\n", ns);
+	return 0;
+}
@@ -0,0 +1,263 @@
+/**
+ * Replays noisy ADC traces through the probe sampler and filters
+ * (main/ProbeSampler.hpp, main/ProbeFilter.hpp) on the host and counts
+ * the publishes the DELTA_TEMP check lets through, with and without each
+ * filter stage.
+ *
+ *   cd tools
+ *   g++ -std=gnu++11 -O2 -Ihost -I../main -o filter_replay filter_replay.cpp \
+ *       ../main/ProbeSampler.cpp ../main/BootClock.cpp
+ *   ./filter_replay [-s sigma] [-p spike_rate] [-n] [-w out.csv] [trace.csv]
+ *
+ * trace.csv is raw ADC reads, "ts,code1,code2,..." a line per read of
+ * every probe; the lines with the same ts (seconds) are one sweep's
+ * burst, reused from the start if a configuration reads more of them.
+ * Without one a trace is made from the generated cook (host/SimCook.hpp,
+ * -n without its stalls): 2^MAX_OVERSAMPLE_BITS reads per probe per sweep
+ * with gaussian noise of sigma codes (default 3) and, at spike_rate per
+ * read (default 0.002), a spike of up to 200 codes.  -w writes the trace.
+ *
+ * Each configuration runs the same sweeps: a single read, oversampling
+ * alone, then a median of TRY_MEDIAN and an EMA of TRY_EMA_ALPHA added as
+ * the firmware chains them, and last the sdkconfig filters.  For
+ * generated traces the publishes the noise caused are those where no
+ * probe really moved more than DELTA_TEMP / 2 in the last MOVE_WINDOW
+ * sweeps, which is longer than the filters lag, and the error is against
+ * the true temperature.  The largest error is the lag behind a lid drop
+ * once the median is in.  Exits non-zero if the sdkconfig filters
+ * publish more than oversampling alone, or are further out at worst.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "ProbeSampler.hpp"
+#include "SimDevices.hpp"
+#include "SimCook.hpp"
+
+static const float DELTA_TEMP = 2;
+static const int SPIKE_CODES = 200;
+static const size_t MOVE_WINDOW = 30;
+
+static uint32_t simMs;
+int host_log_verbose;
+
+extern "C" uint32_t esp_log_timestamp(void) {
+	return simMs;
+}
+
+/**
+ * Plays one sweep's burst of recorded reads back per channel.
+ */
+class TraceAdc : public AdcReader {
+	const std::vector<cook_row_t>* reads;
+	size_t first, count;
+	size_t next[MAX_PROBES];
+
+	public:
+	TraceAdc(const std::vector<cook_row_t>* reads) : reads(reads), first(0), count(0) {}
+	void burst(size_t from, size_t n) {
+		first = from;
+		count = n;
+		memset(next, 0, sizeof(next));
+	}
+	virtual void configure(adc1_channel_t) {}
+	virtual int read(adc1_channel_t channel) {
+		int probe = 0;
+		for (int i = 0; i < MAX_PROBES; i++) {
+			if (PROBES[i].channel == channel) {
+				probe = i;
+			}
+		}
+		const cook_row_t* row = &(*reads)[first + next[probe]++ % count];
+		return (int) row->t[probe];
+	}
+};
+
+// The stages tried on top of oversampling, the defaults before they were
+// measured here.
+static const int TRY_MEDIAN = 5;
+static const int TRY_EMA_ALPHA = 30;
+
+typedef struct {
+	const char* name;
+	int bits;
+	int median;		// window, 1 for none
+	int emaAlpha;	// percent, 100 for none
+} filter_config_t;
+
+static const filter_config_t CONFIGS[] = {
+	{ "single read", 0, 1, 100 },
+	{ "oversample", CONFIG_PROBE_OVERSAMPLE_BITS, 1, 100 },
+	{ "+ median", CONFIG_PROBE_OVERSAMPLE_BITS, TRY_MEDIAN, 100 },
+	{ "+ median + EMA", CONFIG_PROBE_OVERSAMPLE_BITS, TRY_MEDIAN, TRY_EMA_ALPHA },
+	{ "sdkconfig", CONFIG_PROBE_OVERSAMPLE_BITS, CONFIG_PROBE_MEDIAN_SIZE, CONFIG_PROBE_EMA_ALPHA },
+};
+static const int NUM_CONFIGS = sizeof(CONFIGS) / sizeof(CONFIGS[0]);
+static const int OVERSAMPLE = 1;
+static const int SDKCONFIG = NUM_CONFIGS - 1;
+
+static int code_for(double t) {
+	double r = ProbeThermistor::Ro * exp(ProbeThermistor::B * (1 / (t + 273.15) - 1 / ProbeThermistor::To));
+	return (int) (4096 * r / (ProbeThermistor::Rt + r) + 0.5);
+}
+
+static void usage(const char* name) {
+	fprintf(stderr, "usage: %s [-s sigma] [-p spike_rate] [-n] [-w out.csv] [trace.csv]\n", name);
+	exit(2);
+}
+
+int main(int argc, char** argv) {
+	double sigma = 3;
+	double spikeRate = 0.002;
+	bool stalls = true;
+	const char* out = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "s:p:nw:")) != -1) {
+		switch (opt) {
+		case 's': sigma = atof(optarg); break;
+		case 'p': spikeRate = atof(optarg); break;
+		case 'n': stalls = false; break;
+		case 'w': out = optarg; break;
+		default: usage(argv[0]);
+		}
+	}
+	if (sigma < 0 || spikeRate < 0 || spikeRate > 1 || optind < argc - 1) {
+		usage(argv[0]);
+	}
+	srand(1);
+
+	// Reads, and for generated traces the temperature of each sweep.
+	std::vector<cook_row_t> reads;
+	std::vector<cook_row_t> truth;
+	int probes;
+	bool generated = optind == argc;
+	if (generated) {
+		probes = std::min(synthetic_cook(truth, stalls), MAX_PROBES);
+		for (size_t i = 0; i < truth.size(); i++) {
+			for (int n = 0; n < (1 << MAX_OVERSAMPLE_BITS); n++) {
+				cook_row_t read;
+				read.ts = truth[i].ts;
+				for (int c = 0; c < probes; c++) {
+					int code = code_for(truth[i].t[c]) + (int) lround(sigma * gauss());
+					if (rand() < spikeRate * RAND_MAX) {
+						code += rand() % (2 * SPIKE_CODES + 1) - SPIKE_CODES;
+					}
+					read.t[c] = code < 0 ? 0 : code > 4095 ? 4095 : code;
+				}
+				reads.push_back(read);
+			}
+		}
+	} else {
+		probes = std::min(read_cook(argv[optind], reads), MAX_PROBES);
+	}
+	if (reads.empty()) {
+		fprintf(stderr, "no reads\n");
+		return 1;
+	}
+	if (out) {
+		write_cook(out, reads, probes);
+	}
+
+	// Bursts: the reads sharing a timestamp.
+	std::vector<std::pair<size_t, size_t> > sweeps;
+	for (size_t i = 0; i < reads.size(); ) {
+		size_t j = i;
+		while (j < reads.size() && reads[j].ts == reads[i].ts) {
+			j++;
+		}
+		sweeps.push_back(std::make_pair(i, j - i));
+		i = j;
+	}
+
+	printf("%u sweeps of %d probes over %.1f hours, %.1f reads per probe per sweep\n",
+		(unsigned) sweeps.size(), probes, (reads.back().ts - reads[0].ts) / 3600.0,
+		(double) reads.size() / sweeps.size());
+	if (generated) {
+		printf("noise sigma %.1f codes, spikes %.3f%% of reads\n", sigma, spikeRate * 100);
+	}
+	printf("  %-16s %9s", "filters", "publishes");
+	if (generated) {
+		printf(" %9s %11s %11s", "by noise", "mean error", "max error");
+	}
+	printf("\n");
+
+	uint32_t baseline = 0;
+	uint32_t published[NUM_CONFIGS];
+	double worst[NUM_CONFIGS];
+	for (int k = 0; k < NUM_CONFIGS; k++) {
+		const filter_config_t* config = &CONFIGS[k];
+		TraceAdc adc(&reads);
+		ProbeSampler sampler(adc, PROBES, probes);
+		sampler.init();
+		sampler.setOversample(config->bits);
+		MedianFilter<TRY_MEDIAN> tryMedians[MAX_PROBES];
+		MedianFilter<CONFIG_PROBE_MEDIAN_SIZE> sdkMedians[MAX_PROBES];
+		float alpha = config->emaAlpha / 100.0f;
+		EmaFilter emas[MAX_PROBES] = { EmaFilter(alpha), EmaFilter(alpha), EmaFilter(alpha), EmaFilter(alpha) };
+		for (int c = 0; c < probes; c++) {
+			ProbeFilter* median = NULL;
+			if (config->median > 1) {
+				median = k == SDKCONFIG ? (ProbeFilter*) &sdkMedians[c] : (ProbeFilter*) &tryMedians[c];
+			}
+			ProbeFilter* ema = config->emaAlpha < 100 ? &emas[c] : NULL;
+			if (median) {
+				median->setNext(ema);
+				sampler.setFilter(c, median);
+			} else {
+				sampler.setFilter(c, ema);
+			}
+		}
+
+		float last[MAX_PROBES] = { 0, 0, 0, 0 };
+		uint32_t publishes = 0, byNoise = 0;
+		double sumError = 0, maxError = 0;
+		for (size_t s = 0; s < sweeps.size(); s++) {
+			simMs = (uint32_t) ((reads[sweeps[s].first].ts - reads[0].ts) * 1000);
+			adc.burst(sweeps[s].first, sweeps[s].second);
+			probe_sweep_t sweep;
+			sampler.sweep(&sweep);
+			bool update = false, moved = false;
+			for (int c = 0; c < probes; c++) {
+				if (fabsf(last[c] - sweep.temp[c]) > DELTA_TEMP) {
+					update = true;
+				}
+				last[c] = sweep.temp[c];
+				if (generated) {
+					for (size_t w = s > MOVE_WINDOW ? s - MOVE_WINDOW : 0; w < s; w++) {
+						if (fabsf(truth[w + 1].t[c] - truth[w].t[c]) > DELTA_TEMP / 2) {
+							moved = true;
+						}
+					}
+					double e = fabs(sweep.temp[c] - truth[s].t[c]);
+					sumError += e;
+					maxError = std::max(maxError, e);
+				}
+			}
+			publishes += update;
+			byNoise += update && !moved && s > 0;
+		}
+		if (k == 0) {
+			baseline = publishes;
+		}
+		published[k] = publishes;
+		worst[k] = maxError;
+		printf("  %-16s %9u", config->name, publishes);
+		if (generated) {
+			printf(" %9u %11.3f %11.2f", byNoise, sumError / (sweeps.size() * probes), maxError);
+		}
+		printf("   %.1f%% suppressed\n", baseline ? 100.0 * (baseline - publishes) / baseline : 0);
+	}
+
+	// The filters in sdkconfig have to earn their lag.
+	bool ok = published[SDKCONFIG] <= published[OVERSAMPLE] && worst[SDKCONFIG] <= worst[OVERSAMPLE];
+	printf("sdkconfig (median %d, EMA %d%%) against oversampling alone: %s\n", CONFIG_PROBE_MEDIAN_SIZE,
+		CONFIG_PROBE_EMA_ALPHA, ok ? "no worse" : "more publishes or a larger error, FAILED");
+	return ok ? 0 : 1;
+}
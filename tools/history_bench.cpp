@@ -0,0 +1,188 @@
+/**
+ * Benchmark for the sweep history store (main/History.hpp), on the host.
+ *
+ *   cd tools
+ *   g++ -std=gnu++11 -O2 -Ihost -I../main -o history_bench history_bench.cpp \
+ *       ../main/History.cpp ../main/ProbeSampler.cpp ../main/BootClock.cpp
+ *   ./history_bench [-i interval_ms] [-t hours] [-n noise]
+ *
+ * Feeds a cook (host/SimDevices.hpp, lid opening every 30 minutes) through
+ * the sampler and filters into the store, then reports host CPU time per
+ * append, per query and per point returned, the compressed size of the
+ * raw tier per sweep against the sweep log's 20 byte records, how far
+ * back each tier reaches, the largest quantisation error read back, and a
+ * checkpoint and restore through RAM flash.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <vector>
+
+#include "esp_log.h"
+#include "ProbeSampler.hpp"
+#include "History.hpp"
+#include "SimDevices.hpp"
+
+static const uint32_t WALL_START = 1500000000;
+static const uint32_t LID_EVERY_S = 1800;
+static const int QUERY_ITERATIONS = 200;
+
+static uint32_t simMs;
+int host_log_verbose;
+
+extern "C" uint32_t esp_log_timestamp(void) {
+	return simMs;
+}
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double elapsed_ns(bench_clock::time_point start, int n) {
+	return std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / n;
+}
+
+static bool count_points(const history_point_t*, void* context) {
+	++*(int*) context;
+	return true;
+}
+
+typedef struct {
+	const std::vector<probe_sweep_t>* sweeps;
+	size_t next;
+	float maxError;
+} check_context_t;
+
+// Raw points come back in order; match them to the sweeps appended.
+static bool check_point(const history_point_t* point, void* context) {
+	check_context_t* check = (check_context_t*) context;
+	const std::vector<probe_sweep_t>& sweeps = *check->sweeps;
+	while (check->next < sweeps.size() && (uint32_t) sweeps[check->next].timestamp < point->ts) {
+		check->next++;
+	}
+	if (check->next == sweeps.size()) {
+		return false;
+	}
+	const probe_sweep_t* s = &sweeps[check->next++];
+	for (int i = 0; i < point->probes; i++) {
+		float e = fabsf(point->avg[i] - s->temp[i]);
+		if (e > check->maxError) {
+			check->maxError = e;
+		}
+	}
+	return true;
+}
+
+static void bench_query(History& history, const char* name, history_tier_t tier, uint32_t from, uint32_t to) {
+	int points = 0;
+	bench_clock::time_point start = bench_clock::now();
+	for (int i = 0; i < QUERY_ITERATIONS; i++) {
+		points = 0;
+		history.query(tier, from, to, count_points, &points);
+	}
+	double ns = elapsed_ns(start, QUERY_ITERATIONS);
+	printf("  %-24s %5d points %10.0f ns  %6.1f ns/point\n", name, points, ns, points ? ns / points : 0);
+}
+
+static void usage(const char* name) {
+	fprintf(stderr, "usage: %s [-i interval_ms] [-t hours] [-n noise]\n", name);
+	exit(2);
+}
+
+int main(int argc, char** argv) {
+	uint32_t intervalMs = CONFIG_SAMPLE_INTERVAL_MS;
+	uint32_t hours = 12;
+	int noise = 2;
+	int opt;
+	while ((opt = getopt(argc, argv, "i:t:n:")) != -1) {
+		switch (opt) {
+		case 'i': intervalMs = atoi(optarg); break;
+		case 't': hours = atoi(optarg); break;
+		case 'n': noise = atoi(optarg); break;
+		default: usage(argv[0]);
+		}
+	}
+	if (intervalMs < 1 || hours < 1) {
+		usage(argv[0]);
+	}
+	srand(1);
+
+	FakeAdc adc(COOK_PROFILES, noise, LID_EVERY_S);
+	ProbeSampler sampler(adc, PROBES, CONFIG_PROBE_COUNT);
+	sampler.init();
+	sampler.setOversample(CONFIG_PROBE_OVERSAMPLE_BITS);
+	static MedianFilter<CONFIG_PROBE_MEDIAN_SIZE> medianFilters[MAX_PROBES];
+	static EmaFilter emaFilters[MAX_PROBES] = {
+		EmaFilter(CONFIG_PROBE_EMA_ALPHA / 100.0f), EmaFilter(CONFIG_PROBE_EMA_ALPHA / 100.0f),
+		EmaFilter(CONFIG_PROBE_EMA_ALPHA / 100.0f), EmaFilter(CONFIG_PROBE_EMA_ALPHA / 100.0f),
+	};
+	for (int i = 0; i < CONFIG_PROBE_COUNT; i++) {
+		medianFilters[i].setNext(&emaFilters[i]);
+		sampler.setFilter(i, &medianFilters[i]);
+	}
+
+	size_t n = (size_t) hours * 3600 * 1000 / intervalMs;
+	std::vector<probe_sweep_t> sweeps(n);
+	for (size_t i = 0; i < n; i++) {
+		simMs = (uint32_t) (i * intervalMs);
+		sampler.sweep(&sweeps[i]);
+		sweeps[i].timestamp = WALL_START + simMs / 1000;
+	}
+	uint32_t first = WALL_START;
+	uint32_t last = (uint32_t) sweeps[n - 1].timestamp;
+
+	static History history;
+	bench_clock::time_point start = bench_clock::now();
+	for (size_t i = 0; i < n; i++) {
+		history.append(&sweeps[i]);
+	}
+	double appendNs = elapsed_ns(start, n);
+
+	printf("history: %u sweeps of %d probes every %u ms, %u hours, arena %u bytes\n",
+		(unsigned) n, CONFIG_PROBE_COUNT, intervalMs, hours, (unsigned) sizeof(history_state_t));
+	printf("  append                   %10.0f ns\n", appendNs);
+	uint32_t samples = history.rawSamples();
+	size_t bytes = history.rawBytes();
+	printf("  raw tier                 %u sweeps in %u bytes, %.2f bytes/sweep (sweep log 20)\n",
+		samples, (unsigned) bytes, (double) bytes / samples);
+	const char* names[HISTORY_TIERS] = { "raw", "1 minute", "10 minute" };
+	for (int tier = 0; tier < HISTORY_TIERS; tier++) {
+		uint32_t oldest = history.oldest((history_tier_t) tier);
+		printf("  %-24s back %.1f hours\n", names[tier], (last - oldest) / 3600.0);
+	}
+	const history_stats_t* stats = history.getStats();
+	printf("  %u appended, %u rejected, %u blocks recycled\n", stats->appended, stats->rejected, stats->recycled);
+
+	check_context_t check = { &sweeps, 0, 0 };
+	history.query(HISTORY_RAW, first, last + 1, check_point, &check);
+	printf("  max raw error            %.3f degC\n", check.maxError);
+
+	printf("queries (host CPU per call):\n");
+	bench_query(history, "raw, last 10 minutes", HISTORY_RAW, last - 600, last + 1);
+	bench_query(history, "raw, all", HISTORY_RAW, 0, last + 1);
+	bench_query(history, "1 minute, last 4 hours", HISTORY_MINUTES, last - 4 * 3600, last + 1);
+	bench_query(history, "10 minute, all", HISTORY_TEN_MINUTES, 0, last + 1);
+	start = bench_clock::now();
+	volatile int tier = 0;
+	for (int i = 0; i < QUERY_ITERATIONS; i++) {
+		tier = history.tierFor(last - 3 * 3600);
+	}
+	printf("  %-24s %-12s %10.0f ns\n", "tierFor, 3 hours ago", names[tier], elapsed_ns(start, QUERY_ITERATIONS));
+
+	RamStorage flash(64 * 1024);
+	start = bench_clock::now();
+	int rc = history.checkpoint(flash);
+	double checkpointNs = elapsed_ns(start, 1);
+	static History restored;
+	start = bench_clock::now();
+	int rrc = restored.restore(flash);
+	double restoreNs = elapsed_ns(start, 1);
+	int before = 0, after = 0;
+	history.query(HISTORY_RAW, 0, last + 1, count_points, &before);
+	restored.query(HISTORY_RAW, 0, last + 1, count_points, &after);
+	printf("checkpoint %s in %.0f us, restore %s in %.0f us, %d of %d raw points back\n",
+		rc == 0 ? "ok" : "failed", checkpointNs / 1000, rrc == 0 ? "ok" : "failed", restoreNs / 1000, after, before);
+	return 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * NOR flash in a file, for running the sweep log off-device across
+ * restarts.  A power cut can be armed: the write or erase that reaches
+ * it only gets its first bytes through and then throws PowerCut, which
+ * leaves the file as a reset in the middle of that operation would.
+ */
+#ifndef HOST_FILESTORAGE_H_
+#define HOST_FILESTORAGE_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "LogStorage.hpp"
+
+struct PowerCut {};
+
+class FileStorage : public LogStorage {
+	FILE* file;
+	size_t bytes;
+	bool armed;
+	uint64_t budget;	// bytes still written before the cut
+
+	// Write through len bytes, or as many as the budget allows.
+	size_t allowed(size_t len) {
+		if (!armed) {
+			return len;
+		}
+		if (budget >= len) {
+			budget -= len;
+			return len;
+		}
+		return (size_t) budget;
+	}
+
+	public:
+	uint64_t written;	// bytes written or erased since opened
+	bool cutInErase;	// the power cut hit an erase rather than a write
+
+	// Opens path, creating it erased if it is not already size bytes.
+	FileStorage(const char* path, size_t size) : bytes(size), armed(false), budget(0), written(0),
+			cutInErase(false) {
+		file = fopen(path, "r+b");
+		if (file) {
+			fseek(file, 0, SEEK_END);
+			if ((size_t) ftell(file) != size) {
+				fclose(file);
+				file = NULL;
+			}
+		}
+		if (!file) {
+			file = fopen(path, "w+b");
+			if (!file) {
+				perror(path);
+				exit(1);
+			}
+			std::vector<uint8_t> erased(size, 0xFF);
+			fwrite(&erased[0], 1, size, file);
+		}
+		fflush(file);
+	}
+	virtual ~FileStorage() {
+		fclose(file);
+	}
+
+	// Cut the power once another budget bytes have been written.
+	void arm(uint64_t bytes) {
+		armed = true;
+		budget = bytes;
+	}
+
+	virtual int read(uint32_t offset, void* buf, size_t len) {
+		if (offset + len > bytes) {
+			return -1;
+		}
+		fseek(file, offset, SEEK_SET);
+		return fread(buf, 1, len, file) == len ? 0 : -1;
+	}
+	virtual int write(uint32_t offset, const void* buf, size_t len) {
+		if (offset + len > bytes) {
+			return -1;
+		}
+		std::vector<uint8_t> cell(len);
+		read(offset, &cell[0], len);
+		const uint8_t* p = (const uint8_t*) buf;
+		for (size_t i = 0; i < len; i++) {
+			cell[i] &= p[i];
+		}
+		size_t n = allowed(len);
+		fseek(file, offset, SEEK_SET);
+		fwrite(&cell[0], 1, n, file);
+		fflush(file);
+		written += n;
+		if (n < len) {
+			cutInErase = false;
+			throw PowerCut();
+		}
+		return 0;
+	}
+	virtual int erase(uint32_t offset, size_t len) {
+		if (offset + len > bytes) {
+			return -1;
+		}
+		std::vector<uint8_t> erased(len, 0xFF);
+		size_t n = allowed(len);
+		fseek(file, offset, SEEK_SET);
+		fwrite(&erased[0], 1, n, file);
+		fflush(file);
+		written += n;
+		if (n < len) {
+			cutInErase = true;
+			throw PowerCut();
+		}
+		return 0;
+	}
+	virtual size_t size() { return bytes; }
+};
+
+#endif
@@ -0,0 +1,135 @@
+/*
+ * Cooks for the host tools: a generated overnight cook and CSV files of
+ * recorded ones.  A CSV has a line per sweep, "ts,t1,t2,..." with ts in
+ * seconds and temperatures in degC; lines that do not start with a
+ * number are skipped.
+ */
+#ifndef SIMCOOK_H_
+#define SIMCOOK_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <vector>
+
+#define MAX_COLUMNS 8
+
+// The generated cook: a pit at COOK_PIT whose lid opens every
+// COOK_LID_EVERY_S, then a brisket, a pork shoulder and a chicken.
+static const uint32_t COOK_START_TS = 1500000000;
+static const uint32_t COOK_HOURS = 16;
+static const double COOK_PIT = 110;
+static const uint32_t COOK_LID_EVERY_S = 1800;
+static const uint32_t COOK_LID_OPEN_S = 60;
+static const double COOK_LID_DROP = 25;
+static const double COOK_STALL_FROM = 63;
+static const double COOK_STALL_TO = 74;
+
+typedef struct {
+	uint32_t ts;
+	float t[MAX_COLUMNS];
+} cook_row_t;
+
+typedef struct {
+	double start;
+	double tauS;
+	bool stalls;
+} meat_t;
+
+static inline double gauss() {
+	double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+	double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+	return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+/**
+ * An overnight cook at one sweep a second: Newton heating towards the pit,
+ * slowed to an eighth between COOK_STALL_FROM and COOK_STALL_TO for the
+ * stalling cuts, with sensor noise and 0.1 degC quantisation.
+ */
+static inline int synthetic_cook(std::vector<cook_row_t>& rows, bool stalls) {
+	const meat_t meats[] = {
+		{ 5, 3.0 * 3600, true },	// brisket
+		{ 5, 2.4 * 3600, true },	// pork shoulder
+		{ 5, 0.9 * 3600, false },	// chicken
+	};
+	const int n = sizeof(meats) / sizeof(meats[0]);
+	double t[n];
+	for (int i = 0; i < n; i++) {
+		t[i] = meats[i].start;
+	}
+	for (uint32_t s = 0; s < COOK_HOURS * 3600; s++) {
+		cook_row_t row;
+		row.ts = COOK_START_TS + s;
+		double pit = COOK_PIT + 2 * sin(s / 600.0);
+		if (s >= COOK_LID_EVERY_S && s % COOK_LID_EVERY_S < COOK_LID_OPEN_S) {
+			pit -= COOK_LID_DROP;
+		}
+		row.t[0] = roundf((pit + 0.1 * gauss()) * 10) / 10;
+		for (int i = 0; i < n; i++) {
+			double rate = (COOK_PIT - t[i]) / meats[i].tauS;
+			if (stalls && meats[i].stalls && t[i] > COOK_STALL_FROM && t[i] < COOK_STALL_TO) {
+				rate /= 8;
+			}
+			t[i] += rate;
+			row.t[1 + i] = roundf((t[i] + 0.05 * gauss()) * 10) / 10;
+		}
+		rows.push_back(row);
+	}
+	return 1 + n;
+}
+
+static inline int read_cook(const char* path, std::vector<cook_row_t>& rows) {
+	FILE* f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+	char line[512];
+	int columns = 0;
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] < '0' || line[0] > '9') {
+			continue;
+		}
+		cook_row_t row;
+		char* p = line;
+		row.ts = (uint32_t) strtoul(p, &p, 10);
+		int c = 0;
+		while (*p == ',' && c < MAX_COLUMNS) {
+			row.t[c++] = strtof(p + 1, &p);
+		}
+		if (columns == 0) {
+			columns = c;
+		}
+		if (c == columns) {
+			rows.push_back(row);
+		}
+	}
+	fclose(f);
+	return columns;
+}
+
+static inline void write_cook(const char* path, const std::vector<cook_row_t>& rows, int columns) {
+	FILE* f = fopen(path, "w");
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+	fprintf(f, "ts");
+	for (int c = 0; c < columns; c++) {
+		fprintf(f, ",t%d", c + 1);
+	}
+	fprintf(f, "\n");
+	for (size_t i = 0; i < rows.size(); i++) {
+		fprintf(f, "%u", rows[i].ts);
+		for (int c = 0; c < columns; c++) {
+			fprintf(f, ",%.1f", rows[i].t[c]);
+		}
+		fprintf(f, "\n");
+	}
+	fclose(f);
+}
+
+#endif
@@ -0,0 +1,200 @@
+/*
+ * Stand-ins for the devices around the firmware's pipeline code, shared
+ * by the host tools: the probes on the ADC, the flash partition under the
+ * sweep log and the broker end of the shadow.  Time is esp_log_timestamp(),
+ * which the tool drives.
+ */
+#ifndef HOST_SIMDEVICES_H_
+#define HOST_SIMDEVICES_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <vector>
+
+#include "esp_log.h"
+#include "ThermistorTable.hpp"
+#include "ProbeSampler.hpp"
+#include "LogStorage.hpp"
+#include "ShadowWindow.hpp"
+
+static const uint32_t ACK_TIMEOUT_MS = 4000;	// as passed to aws_iot_shadow_update()
+
+// Same probe as main.cpp.
+struct ProbeThermistor {
+	static constexpr double Ro = 90000;
+	static constexpr double Rt = 14000;
+	static constexpr double B = 3850;
+	static constexpr double To = 298.15;
+	static constexpr double ADC_STEP = 3.3/4096;
+};
+typedef ThermistorTable<ProbeThermistor> ProbeTable;
+
+static const probe_channel_t PROBES[] = {
+	{ ADC1_CHANNEL_7, &ProbeTable::interpolate },
+	{ ADC1_CHANNEL_6, &ProbeTable::interpolate },
+	{ ADC1_CHANNEL_5, &ProbeTable::interpolate },
+	{ ADC1_CHANNEL_4, &ProbeTable::interpolate },
+};
+
+/**
+ * A probe heading for a target temperature with a first order response,
+ * like a pit coming up to heat or meat in it.
+ */
+typedef struct {
+	double start;
+	double target;
+	double tauS;
+	double swing;		// plus a triangle wave of this amplitude,
+	double periodS;		// and period, if not 0
+} probe_profile_t;
+
+static const probe_profile_t COOK_PROFILES[MAX_PROBES] = {
+	{ 20, 110, 600, 0, 0 },	// pit
+	{ 5, 95, 7200, 0, 0 },	// brisket
+	{ 5, 90, 5400, 0, 0 },	// pork shoulder
+	{ 20, 20, 1, 0, 0 },	// ambient
+};
+
+static const uint32_t LID_OPEN_S = 60;
+static const double LID_DROP = 25;
+
+/**
+ * ADC returning the code a probe on the divider would give at its
+ * profile temperature, plus uniform noise of +/- noise codes.  Every
+ * lidEveryS the pit lid opens for LID_OPEN_S, dropping the first probe
+ * by LID_DROP.
+ */
+class FakeAdc : public AdcReader {
+	const probe_profile_t* profiles;
+	int noise;
+	uint32_t lidEveryS;
+
+	public:
+	uint32_t reads;
+
+	FakeAdc(const probe_profile_t* profiles, int noise, uint32_t lidEveryS) :
+		profiles(profiles), noise(noise), lidEveryS(lidEveryS), reads(0) {}
+	virtual void configure(adc1_channel_t) {}
+	virtual int read(adc1_channel_t channel) {
+		reads++;
+		int probe = 0;
+		for (int i = 0; i < MAX_PROBES; i++) {
+			if (PROBES[i].channel == channel) {
+				probe = i;
+			}
+		}
+		const probe_profile_t* p = &profiles[probe];
+		double now = esp_log_timestamp() / 1000.0;
+		double t = p->target - (p->target - p->start) * exp(-now / p->tauS);
+		if (p->periodS > 0) {
+			double phase = fmod(now / p->periodS, 1.0);
+			t += p->swing * (phase < 0.5 ? 4 * phase - 1 : 3 - 4 * phase);
+		}
+		uint32_t s = (uint32_t) now;
+		if (probe == 0 && lidEveryS > 0 && s >= lidEveryS && s % lidEveryS < LID_OPEN_S) {
+			t -= LID_DROP;
+		}
+		double r = ProbeThermistor::Ro * exp(ProbeThermistor::B * (1 / (t + 273.15) - 1 / ProbeThermistor::To));
+		int code = (int) (4096 * r / (ProbeThermistor::Rt + r) + 0.5);
+		if (noise > 0) {
+			code += rand() % (2 * noise + 1) - noise;
+		}
+		return code < 0 ? 0 : code > 4095 ? 4095 : code;
+	}
+};
+
+/**
+ * NOR flash in RAM for the sweep log.
+ */
+class RamStorage : public LogStorage {
+	std::vector<uint8_t> flash;
+
+	public:
+	RamStorage(size_t size) : flash(size, 0xFF) {}
+	virtual int read(uint32_t offset, void* buf, size_t len) {
+		memcpy(buf, &flash[offset], len);
+		return 0;
+	}
+	virtual int write(uint32_t offset, const void* buf, size_t len) {
+		const uint8_t* p = (const uint8_t*) buf;
+		for (size_t i = 0; i < len; i++) {
+			flash[offset + i] &= p[i];
+		}
+		return 0;
+	}
+	virtual int erase(uint32_t offset, size_t len) {
+		memset(&flash[offset], 0xFF, len);
+		return 0;
+	}
+	virtual size_t size() { return flash.size(); }
+};
+
+typedef struct {
+	shadow_request_t* request;
+	uint32_t dueMs;
+	publish_status_t status;
+} pending_ack_t;
+
+/**
+ * The broker end of the shadow: acks updates after rttMs +/- 50%, or
+ * never for lossPct of them, which then time out.
+ */
+class FakeBroker {
+	ShadowWindow& window;
+	uint32_t rttMs;
+	int lossPct;
+	std::vector<pending_ack_t> acks;
+
+	public:
+	FakeBroker(ShadowWindow& window, uint32_t rttMs, int lossPct) :
+		window(window), rttMs(rttMs), lossPct(lossPct) {}
+
+	void update(const char* doc, publish_callback_t callback, void* context) {
+		const char* token = strstr(doc, "\"clientToken\":\"");
+		char buf[SHADOW_TOKEN_SIZE] = "";
+		if (token) {
+			token += strlen("\"clientToken\":\"");
+			size_t n = strcspn(token, "\"");
+			if (n >= sizeof(buf)) {
+				n = sizeof(buf) - 1;
+			}
+			memcpy(buf, token, n);
+			buf[n] = 0;
+		}
+		pending_ack_t ack;
+		ack.request = window.acquire(buf, callback, context);
+		if (rand() % 100 < lossPct) {
+			ack.dueMs = esp_log_timestamp() + ACK_TIMEOUT_MS;
+			ack.status = PUBLISH_TIMEOUT;
+		} else {
+			ack.dueMs = esp_log_timestamp() + rttMs / 2 + (rttMs ? rand() % rttMs : 0);
+			ack.status = PUBLISH_ACCEPTED;
+		}
+		acks.push_back(ack);
+	}
+
+	/**
+	 * The link went down: nothing in flight will be acked.
+	 */
+	void disconnect() {
+		for (size_t i = 0; i < acks.size(); i++) {
+			acks[i].dueMs = acks[i].request->sentMs + ACK_TIMEOUT_MS;
+			acks[i].status = PUBLISH_TIMEOUT;
+		}
+	}
+
+	void step() {
+		for (size_t i = 0; i < acks.size();) {
+			if ((int32_t)(esp_log_timestamp() - acks[i].dueMs) >= 0) {
+				window.complete(acks[i].request, acks[i].status);
+				acks.erase(acks.begin() + i);
+			} else {
+				i++;
+			}
+		}
+	}
+};
+
+#endif
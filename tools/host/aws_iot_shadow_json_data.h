@@ -0,0 +1,9 @@
+/*
+ * Host stand-in for the AWS IoT SDK header IotData.hpp includes.
+ */
+#ifndef HOST_AWS_IOT_SHADOW_JSON_DATA_H_
+#define HOST_AWS_IOT_SHADOW_JSON_DATA_H_
+
+typedef struct jsonStruct jsonStruct_t;
+
+#endif
@@ -0,0 +1,20 @@
+/*
+ * Host stand-in for driver/adc.h: the types AdcReader uses.  Tools
+ * supply their own AdcReader rather than calling the driver.
+ */
+#ifndef HOST_DRIVER_ADC_H_
+#define HOST_DRIVER_ADC_H_
+
+typedef enum {
+	ADC1_CHANNEL_0 = 0,
+	ADC1_CHANNEL_1,
+	ADC1_CHANNEL_2,
+	ADC1_CHANNEL_3,
+	ADC1_CHANNEL_4,
+	ADC1_CHANNEL_5,
+	ADC1_CHANNEL_6,
+	ADC1_CHANNEL_7,
+	ADC1_CHANNEL_MAX
+} adc1_channel_t;
+
+#endif
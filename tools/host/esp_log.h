@@ -0,0 +1,32 @@
+/*
+ * Host stand-in for esp_log.h.  The tool defines esp_log_timestamp(),
+ * normally from a simulated clock, and host_log_verbose.
+ */
+#ifndef HOST_ESP_LOG_H_
+#define HOST_ESP_LOG_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+uint32_t esp_log_timestamp(void);
+extern int host_log_verbose;
+#ifdef __cplusplus
+}
+#endif
+
+#define HOST_LOG(level, tag, format, ...) do { \
+		if (host_log_verbose) { \
+			printf("%c (%u) %s: " format "\n", level, esp_log_timestamp(), tag, ##__VA_ARGS__); \
+		} \
+	} while (0)
+
+#define ESP_LOGE(tag, format, ...) HOST_LOG('E', tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) HOST_LOG('W', tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) HOST_LOG('I', tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...)
+#define ESP_LOGV(tag, format, ...)
+
+#endif
@@ -0,0 +1,10 @@
+/*
+ * Host stand-in for esp_partition.h, enough for LogStorage.hpp.  Tools
+ * use their own LogStorage rather than PartitionStorage.
+ */
+#ifndef HOST_ESP_PARTITION_H_
+#define HOST_ESP_PARTITION_H_
+
+typedef struct esp_partition_t esp_partition_t;
+
+#endif
@@ -0,0 +1,38 @@
+/*
+ * Host build configuration for the tools in tools/.  Mirrors the project
+ * sdkconfig for the modules they compile; FreeRTOS-only features (metrics,
+ * trace ring) are off.
+ */
+#ifndef HOST_SDKCONFIG_H_
+#define HOST_SDKCONFIG_H_
+
+#define CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ 240
+#define CONFIG_PROBE_COUNT 4
+#define CONFIG_PROBE_OVERSAMPLE_BITS 4
+#define CONFIG_PROBE_MEDIAN_SIZE 1
+#define CONFIG_PROBE_EMA_ALPHA 100
+#define CONFIG_SAMPLE_INTERVAL_MS 1000
+#define CONFIG_SAMPLE_QUEUE_DEPTH 16
+#define CONFIG_BATCH_CAPACITY 32
+#define CONFIG_BATCH_FLUSH_SAMPLES 8
+#define CONFIG_BATCH_FLUSH_MS 10000
+#define CONFIG_PUBLISH_DOC_SIZE 480
+#define CONFIG_PUBLISH_QUEUE_DEPTH 4
+#define CONFIG_SHADOW_INFLIGHT_WINDOW 4
+#define CONFIG_HISTORY_RAW_BYTES 8192
+#define CONFIG_HISTORY_MINUTE_SLOTS 240
+#define CONFIG_HISTORY_TEN_MINUTE_SLOTS 144
+#define CONFIG_RATE_MIN_INTERVAL_MS 1000
+#define CONFIG_RATE_MAX_INTERVAL_MS 10000
+#define CONFIG_RATE_MIN_DELTA 5
+#define CONFIG_RATE_MAX_DELTA 45
+#define CONFIG_RATE_FAST_SLOPE 20
+#define CONFIG_RATE_NEAR_LIMIT_C 5
+#define CONFIG_RATE_MAX_SILENCE_S 0
+#define CONFIG_RATE_SETTLE_S 120
+#define CONFIG_WIFI_RECONNECT_BASE_MS 500
+#define CONFIG_WIFI_RECONNECT_MAX_MS 30000
+#define CONFIG_WIFI_RECONNECT_JITTER 20
+#define CONFIG_WIFI_AP_FALLBACK_FAILURES 10
+
+#endif
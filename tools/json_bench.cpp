@@ -0,0 +1,172 @@
+/**
+ * Encode cost of the shadow documents with sprintf, as the firmware built
+ * them before JsonWriter (main/JsonWriter.hpp), and with JsonWriter, on
+ * the host.
+ *
+ *   cd tools
+ *   g++ -std=gnu++11 -O2 -Ihost -I../main -o json_bench json_bench.cpp ../main/JsonWriter.cpp
+ *   ./json_bench [-i iterations]
+ *
+ * Documents: the live update of one sweep (username, timestamp, four
+ * temperatures to 0.1 degC, client token) and the signup seed document.
+ * Both ways must produce the same bytes for every input, which is checked
+ * first over temperatures from -273.1 to 1134.7 degC, so only the encode
+ * is compared.  Reports host CPU per document, and what each does with a
+ * buffer too small for the document: snprintf truncates it into something
+ * that is not JSON, JsonWriter reports the overflow.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include <chrono>
+
+#include "JsonWriter.hpp"
+
+static const char* USERNAME = "someone@example.com";
+static const char* THING = "BBQTemp_240AC4123456";
+static const char* TOKEN = "240AC4123456-1234";
+static const int PROBES = 4;
+
+typedef struct {
+	uint32_t ts;
+	float t[PROBES];
+} sweep_t;
+
+static int sprintf_update(char* buf, size_t size, const sweep_t* s) {
+	return snprintf(buf, size,
+		"{\"state\":{\"reported\":{\"username\":\"%s\",\"ts\":%u,\"t\":[%0.1f,%0.1f,%0.1f,%0.1f]}},\"clientToken\":\"%s\"}",
+		USERNAME, s->ts, s->t[0], s->t[1], s->t[2], s->t[3], TOKEN);
+}
+
+// As format_sweep() in main.cpp, without the ETA.
+static bool writer_update(char* buf, size_t size, const sweep_t* s) {
+	JsonWriter w(buf, size);
+	w.beginObject().key("state").beginObject().key("reported").beginObject();
+	w.key("username").value(USERNAME);
+	w.key("ts").value(s->ts);
+	w.key("t").beginArray();
+	for (int i = 0; i < PROBES; i++) {
+		w.value(s->t[i]);
+	}
+	w.endArray();
+	w.endObject().endObject();
+	w.key("clientToken").value(TOKEN).endObject();
+	return w.ok();
+}
+
+static int sprintf_seed(char* buf, size_t size) {
+	return snprintf(buf, size,
+		"{\"state\":{\"reported\":{\"thingname\":\"%s\",\"username\":\"%s\",\"td\":[\"Temp 1\",\"Temp 2\",\"Temp 3\"],"
+		"\"t\":[0,0,0],\"tl\":[0,0,0],\"tu\":[100,100,100]}},\"clientToken\":\"%s-100\"}",
+		THING, USERNAME, THING);
+}
+
+// As IotDataMqtt::signup().
+static bool writer_seed(char* buf, size_t size) {
+	char clientToken[64];
+	snprintf(clientToken, sizeof(clientToken), "%s-100", THING);
+	JsonWriter w(buf, size);
+	w.beginObject().key("state").beginObject().key("reported").beginObject();
+	w.key("thingname").value(THING);
+	w.key("username").value(USERNAME);
+	w.key("td").beginArray().value("Temp 1").value("Temp 2").value("Temp 3").endArray();
+	const int32_t t = 0, tl = 0, tu = 100;
+	w.key("t").beginArray().value(t).value(t).value(t).endArray();
+	w.key("tl").beginArray().value(tl).value(tl).value(tl).endArray();
+	w.key("tu").beginArray().value(tu).value(tu).value(tu).endArray();
+	w.endObject().endObject();
+	w.key("clientToken").value(clientToken).endObject();
+	return w.ok();
+}
+
+static float temp_for(int i, int probe) {
+	return (((i * 7919 + probe * 104729) % 14079) - 2731) / 10.0f + (i % 3) * 0.01f;
+}
+
+typedef std::chrono::steady_clock bench_clock;
+
+template<typename F>
+static double time_ns(int iterations, F encode) {
+	volatile size_t sink = 0;
+	bench_clock::time_point start = bench_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		sink = sink + encode(i);
+	}
+	return std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / iterations;
+}
+
+static char buf[400];
+
+static size_t time_sprintf_update(int i) {
+	sweep_t s = { 1700000000u + i, { temp_for(i, 0), temp_for(i, 1), temp_for(i, 2), temp_for(i, 3) } };
+	return sprintf_update(buf, sizeof(buf), &s);
+}
+
+static size_t time_writer_update(int i) {
+	sweep_t s = { 1700000000u + i, { temp_for(i, 0), temp_for(i, 1), temp_for(i, 2), temp_for(i, 3) } };
+	return writer_update(buf, sizeof(buf), &s);
+}
+
+static size_t time_sprintf_seed(int) { return sprintf_seed(buf, sizeof(buf)); }
+static size_t time_writer_seed(int) { return writer_seed(buf, sizeof(buf)); }
+
+static void usage(const char* name) {
+	fprintf(stderr, "usage: %s [-i iterations]\n", name);
+	exit(2);
+}
+
+int main(int argc, char** argv) {
+	int iterations = 1000000;
+	int opt;
+	while ((opt = getopt(argc, argv, "i:")) != -1) {
+		switch (opt) {
+		case 'i': iterations = atoi(optarg); break;
+		default: usage(argv[0]);
+		}
+	}
+	if (iterations < 1 || optind != argc) {
+		usage(argv[0]);
+	}
+
+	// Same output first, or the timings compare different work.
+	char a[400], b[400];
+	int differ = 0;
+	size_t updateLen = 0;
+	for (int i = 0; i < 100000; i++) {
+		sweep_t s = { 1700000000u + i, { temp_for(i, 0), temp_for(i, 1), temp_for(i, 2), temp_for(i, 3) } };
+		updateLen = sprintf_update(a, sizeof(a), &s);
+		if (!writer_update(b, sizeof(b), &s) || strcmp(a, b) != 0) {
+			if (differ++ == 0) {
+				printf("differ:\n  %s\n  %s\n", a, b);
+			}
+		}
+	}
+	size_t seedLen = sprintf_seed(a, sizeof(a));
+	if (!writer_seed(b, sizeof(b)) || strcmp(a, b) != 0) {
+		printf("seed differs:\n  %s\n  %s\n", a, b);
+		differ++;
+	}
+	printf("100000 updates and the seed document: %d differ\n", differ);
+
+	printf("encode (host CPU, %d iterations):\n", iterations);
+	double su = time_ns(iterations, time_sprintf_update);
+	double wu = time_ns(iterations, time_writer_update);
+	double ss = time_ns(iterations, time_sprintf_seed);
+	double ws = time_ns(iterations, time_writer_seed);
+	printf("  %-16s %5u bytes  sprintf %6.0f ns  JsonWriter %6.0f ns  %.1fx\n", "update", (unsigned) updateLen, su,
+		wu, su / wu);
+	printf("  %-16s %5u bytes  sprintf %6.0f ns  JsonWriter %6.0f ns  %.1fx\n", "signup seed", (unsigned) seedLen, ss,
+		ws, ss / ws);
+
+	// A buffer 20 bytes short of the update.
+	sweep_t s = { 1700000000u, { 110.5f, 225.3f, 64.9f, 70.1f } };
+	size_t small = updateLen - 20;
+	int n = sprintf_update(a, small, &s);
+	bool ok = writer_update(b, small, &s);
+	printf("in %u bytes:\n  snprintf   returns %d, keeps \"...%s\"\n  JsonWriter ok() %s\n", (unsigned) small, n,
+		a + strlen(a) - 12, ok ? "true" : "false");
+	return differ ? 1 : 0;
+}
@@ -0,0 +1,285 @@
+/**
+ * Load test for the device's local server (main/LocalServer.hpp), run on a
+ * host on the same LAN.
+ *
+ *   cd tools
+ *   g++ -std=gnu++11 -O2 -o local_load local_load.cpp
+ *   ./local_load [-p port] [-c clients] [-r requests_per_s] [-t seconds] host
+ *
+ * Opens clients WebSocket connections to /api/stream at once and, in
+ * parallel, polls /api/temps at requests_per_s.  Reports how many streams
+ * were accepted or refused, frames and sequence gaps per stream, how far
+ * apart the streams received the same sweep, and p50/p99 HTTP request
+ * latency.  Ask for more clients than CONFIG_LOCAL_SERVER_MAX_CLIENTS to
+ * check the cap.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock load_clock;
+
+static double now_ms() {
+	return std::chrono::duration<double, std::milli>(load_clock::now().time_since_epoch()).count();
+}
+
+static int connect_to(const char* host, const char* port) {
+	struct addrinfo hints, *res;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host, port, &hints, &res) != 0) {
+		return -1;
+	}
+	int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+	if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+	return fd;
+}
+
+typedef enum {
+	STREAM_HANDSHAKE,
+	STREAM_OPEN,
+	STREAM_REFUSED,
+	STREAM_CLOSED
+} stream_state_t;
+
+typedef struct {
+	int fd;
+	stream_state_t state;
+	std::string in;
+	uint32_t frames;
+	uint32_t gaps;		// sweeps missed
+	uint32_t lastSeq;
+} stream_t;
+
+// Pull the "seq" value out of a frame.
+static uint32_t frame_seq(const std::string& text) {
+	size_t p = text.find("\"seq\":");
+	return p == std::string::npos ? 0 : (uint32_t) strtoul(text.c_str() + p + 6, NULL, 10);
+}
+
+// Sweep seq -> first and last time a stream received it.
+static std::map<uint32_t, std::pair<double, double> > arrivals;
+
+/**
+ * Consume what has arrived on a stream: the handshake response, then
+ * unmasked server frames.
+ */
+static void stream_input(stream_t* s) {
+	if (s->state == STREAM_HANDSHAKE) {
+		size_t end = s->in.find("\r\n\r\n");
+		if (end == std::string::npos) {
+			return;
+		}
+		s->state = s->in.compare(0, 12, "HTTP/1.1 101") == 0 ? STREAM_OPEN : STREAM_REFUSED;
+		s->in.erase(0, end + 4);
+	}
+	while (s->state == STREAM_OPEN && s->in.size() >= 2) {
+		const uint8_t* b = (const uint8_t*) s->in.data();
+		uint64_t len = b[1] & 0x7f;
+		size_t header = 2;
+		if (len == 126) {
+			if (s->in.size() < 4) {
+				return;
+			}
+			len = (b[2] << 8) | b[3];
+			header = 4;
+		} else if (len == 127) {
+			s->state = STREAM_CLOSED;	// not sent by the device
+			return;
+		}
+		if (s->in.size() < header + len) {
+			return;
+		}
+		int op = b[0] & 0x0f;
+		std::string text = s->in.substr(header, len);
+		s->in.erase(0, header + len);
+		if (op == 8) {
+			s->state = STREAM_CLOSED;
+		} else if (op == 1) {
+			uint32_t seq = frame_seq(text);
+			if (s->frames > 0 && seq > s->lastSeq + 1) {
+				s->gaps += seq - s->lastSeq - 1;
+			}
+			s->lastSeq = seq;
+			s->frames++;
+			double t = now_ms();
+			std::map<uint32_t, std::pair<double, double> >::iterator a = arrivals.find(seq);
+			if (a == arrivals.end()) {
+				arrivals[seq] = std::make_pair(t, t);
+			} else {
+				a->second.second = t;
+			}
+		}
+	}
+}
+
+/**
+ * One GET /api/temps.  Returns the latency in ms, or a negative value.
+ */
+static double http_get(const char* host, const char* port) {
+	double start = now_ms();
+	int fd = connect_to(host, port);
+	if (fd < 0) {
+		return -1;
+	}
+	char req[256];
+	int n = snprintf(req, sizeof(req), "GET /api/temps HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n", host);
+	if (write(fd, req, n) != n) {
+		close(fd);
+		return -1;
+	}
+	std::string resp;
+	char buf[512];
+	ssize_t r;
+	while ((r = read(fd, buf, sizeof(buf))) > 0) {
+		resp.append(buf, r);
+	}
+	close(fd);
+	if (resp.compare(0, 12, "HTTP/1.1 200") != 0) {
+		return -1;
+	}
+	return now_ms() - start;
+}
+
+static double percentile(std::vector<double>& v, double p) {
+	if (v.empty()) {
+		return 0;
+	}
+	std::sort(v.begin(), v.end());
+	return v[std::min(v.size() - 1, (size_t) (p * v.size()))];
+}
+
+static void usage(const char* name) {
+	fprintf(stderr, "usage: %s [-p port] [-c clients] [-r requests_per_s] [-t seconds] host\n", name);
+	exit(2);
+}
+
+int main(int argc, char** argv) {
+	const char* port = "80";
+	int clients = 4;
+	int rate = 5;
+	int seconds = 30;
+	int opt;
+	while ((opt = getopt(argc, argv, "p:c:r:t:")) != -1) {
+		switch (opt) {
+		case 'p': port = optarg; break;
+		case 'c': clients = atoi(optarg); break;
+		case 'r': rate = atoi(optarg); break;
+		case 't': seconds = atoi(optarg); break;
+		default: usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || clients < 0 || rate < 0 || seconds < 1) {
+		usage(argv[0]);
+	}
+	const char* host = argv[optind];
+
+	std::vector<stream_t> streams(clients);
+	for (int i = 0; i < clients; i++) {
+		stream_t* s = &streams[i];
+		s->fd = connect_to(host, port);
+		s->state = STREAM_HANDSHAKE;
+		s->frames = s->gaps = s->lastSeq = 0;
+		if (s->fd < 0) {
+			s->state = STREAM_CLOSED;
+			continue;
+		}
+		char req[256];
+		int n = snprintf(req, sizeof(req),
+			"GET /api/stream HTTP/1.1\r\nHost: %s\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+			"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n", host);
+		if (write(s->fd, req, n) != n) {
+			s->state = STREAM_CLOSED;
+		}
+		fcntl(s->fd, F_SETFL, O_NONBLOCK);
+	}
+
+	std::vector<double> latencies;
+	int failed = 0;
+	double end = now_ms() + seconds * 1000.0;
+	double nextGet = now_ms();
+	while (now_ms() < end) {
+		std::vector<struct pollfd> fds;
+		std::vector<int> which;
+		for (int i = 0; i < clients; i++) {
+			if (streams[i].state == STREAM_HANDSHAKE || streams[i].state == STREAM_OPEN) {
+				struct pollfd p = { streams[i].fd, POLLIN, 0 };
+				fds.push_back(p);
+				which.push_back(i);
+			}
+		}
+		int wait = rate > 0 ? std::max(0, (int) (nextGet - now_ms())) : 100;
+		poll(fds.empty() ? NULL : &fds[0], fds.size(), std::min(wait, 100));
+		for (size_t k = 0; k < fds.size(); k++) {
+			if (!(fds[k].revents & (POLLIN | POLLHUP | POLLERR))) {
+				continue;
+			}
+			stream_t* s = &streams[which[k]];
+			char buf[1024];
+			ssize_t r = read(s->fd, buf, sizeof(buf));
+			if (r > 0) {
+				s->in.append(buf, r);
+				stream_input(s);
+			} else if (r == 0 || errno != EAGAIN) {
+				stream_input(s);
+				if (s->state == STREAM_HANDSHAKE) {
+					s->state = STREAM_REFUSED;
+				} else if (s->state == STREAM_OPEN) {
+					s->state = STREAM_CLOSED;
+				}
+			}
+		}
+		// The GETs block; at a few per second that only delays frames
+		// by a request's latency, which the skew below shows.
+		if (rate > 0 && now_ms() >= nextGet) {
+			double ms = http_get(host, port);
+			if (ms < 0) {
+				failed++;
+			} else {
+				latencies.push_back(ms);
+			}
+			nextGet += 1000.0 / rate;
+		}
+	}
+
+	int open = 0, refused = 0, closed = 0;
+	printf("streams:\n");
+	for (int i = 0; i < clients; i++) {
+		stream_t* s = &streams[i];
+		const char* state = s->state == STREAM_OPEN ? "open" : s->state == STREAM_REFUSED ? "refused" :
+			s->state == STREAM_CLOSED ? "closed" : "no handshake";
+		printf("  %2d %-12s %6u frames %4u missed\n", i, state, s->frames, s->gaps);
+		open += s->state == STREAM_OPEN;
+		refused += s->state == STREAM_REFUSED;
+		closed += s->state == STREAM_CLOSED;
+		if (s->fd >= 0) {
+			close(s->fd);
+		}
+	}
+	std::vector<double> skews;
+	for (std::map<uint32_t, std::pair<double, double> >::iterator a = arrivals.begin(); a != arrivals.end(); ++a) {
+		skews.push_back(a->second.second - a->second.first);
+	}
+	printf("  %d open, %d refused, %d closed; %u sweeps, skew between streams p50 %.1f ms p99 %.1f ms\n",
+		open, refused, closed, (unsigned) skews.size(), percentile(skews, 0.5), percentile(skews, 0.99));
+	printf("/api/temps: %u ok, %d failed, latency p50 %.1f ms p99 %.1f ms\n",
+		(unsigned) latencies.size(), failed, percentile(latencies, 0.5), percentile(latencies, 0.99));
+	return 0;
+}
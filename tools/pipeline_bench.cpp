@@ -0,0 +1,321 @@
+/**
+ * Benchmarks for the telemetry pipeline, on the host.
+ *
+ *   cd tools
+ *   g++ -std=gnu++11 -O2 -Ihost -I../main -o pipeline_bench pipeline_bench.cpp \
+ *       ../main/ProbeSampler.cpp ../main/BootClock.cpp ../main/SampleQueue.cpp \
+ *       ../main/SampleBatch.cpp ../main/JsonWriter.cpp ../main/ShadowWindow.cpp \
+ *       ../main/TelemetryCodec.cpp
+ *   ./pipeline_bench [-i interval_ms] [-r rtt_ms] [-b batch] [-t seconds]
+ *
+ * Stages: host CPU time per call of each step a sample goes through, and
+ * the size of what the encoders produce.  The ADC returns recorded codes
+ * so only the firmware's code is timed.  These are host numbers, useful
+ * to compare changes; the same stages are timed on the device by the
+ * metrics timers (Metrics.hpp).
+ *
+ * End to end: sweeps every interval_ms with the pit probe swinging fast
+ * enough that nearly every sweep passes the delta check, published through the
+ * publish queue and shadow window to a broker acking after about rtt_ms
+ * (host/SimDevices.hpp), on a simulated clock.  Reports the updates per
+ * second sustained, what was dropped, and p50/p99 sample to ack latency.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "esp_log.h"
+#include "ProbeSampler.hpp"
+#include "SampleQueue.hpp"
+#include "SampleBatch.hpp"
+#include "ShadowWindow.hpp"
+#include "TelemetryCodec.hpp"
+#include "SimDevices.hpp"
+
+static const float DELTA_TEMP = 2;		// as in main.cpp
+static const int STAGE_ITERATIONS = 200000;
+static const uint32_t TICK_MS = 1;
+
+static uint32_t simMs;
+int host_log_verbose;
+
+extern "C" uint32_t esp_log_timestamp(void) {
+	return simMs;
+}
+
+// Pit swinging +/- 40 degC around 110; the period is set so it moves
+// 3 * DELTA_TEMP per sweep and nearly every sweep is a change.
+static probe_profile_t SWING_PROFILES[MAX_PROBES] = {
+	{ 110, 110, 1, 40, 20 },
+	{ 5, 95, 7200, 0, 0 },
+	{ 5, 90, 5400, 0, 0 },
+	{ 20, 20, 1, 0, 0 },
+};
+
+/**
+ * ADC replaying codes recorded from a FakeAdc, so timing the sampler
+ * does not time the thermistor model.
+ */
+class ReplayAdc : public AdcReader {
+	std::vector<uint16_t> codes;
+	size_t next;
+
+	public:
+	ReplayAdc(AdcReader& source, size_t n) : next(0) {
+		for (size_t i = 0; i < n; i++) {
+			simMs = i;
+			codes.push_back(source.read(PROBES[i % MAX_PROBES].channel));
+		}
+		simMs = 0;
+	}
+	virtual void configure(adc1_channel_t) {}
+	virtual int read(adc1_channel_t) {
+		int code = codes[next];
+		next = (next + 1) % codes.size();
+		return code;
+	}
+};
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double elapsed_ns(bench_clock::time_point start, int n) {
+	return std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / n;
+}
+
+static void report_stage(const char* name, double ns, size_t bytes) {
+	if (bytes) {
+		printf("  %-22s %9.0f ns  %5u bytes\n", name, ns, (unsigned) bytes);
+	} else {
+		printf("  %-22s %9.0f ns\n", name, ns);
+	}
+}
+
+static void bench_stages() {
+	FakeAdc model(SWING_PROFILES, 2, 0);
+	ReplayAdc adc(model, 4096);
+	ProbeSampler sampler(adc, PROBES, CONFIG_PROBE_COUNT);
+	sampler.init();
+	sampler.setOversample(CONFIG_PROBE_OVERSAMPLE_BITS);
+	static MedianFilter<CONFIG_PROBE_MEDIAN_SIZE> medianFilters[MAX_PROBES];
+	static EmaFilter emaFilters[MAX_PROBES] = {
+		EmaFilter(CONFIG_PROBE_EMA_ALPHA / 100.0f), EmaFilter(CONFIG_PROBE_EMA_ALPHA / 100.0f),
+		EmaFilter(CONFIG_PROBE_EMA_ALPHA / 100.0f), EmaFilter(CONFIG_PROBE_EMA_ALPHA / 100.0f),
+	};
+	for (int i = 0; i < CONFIG_PROBE_COUNT; i++) {
+		medianFilters[i].setNext(&emaFilters[i]);
+		sampler.setFilter(i, &medianFilters[i]);
+	}
+
+	printf("stages (host CPU per call, %d probes, %d bit oversampling):\n",
+		CONFIG_PROBE_COUNT, CONFIG_PROBE_OVERSAMPLE_BITS);
+
+	std::vector<probe_sweep_t> sweeps(BATCH_CAPACITY);
+	bench_clock::time_point start = bench_clock::now();
+	for (int i = 0; i < STAGE_ITERATIONS; i++) {
+		sampler.sweep(&sweeps[i % BATCH_CAPACITY]);
+	}
+	report_stage("sweep (read+convert)", elapsed_ns(start, STAGE_ITERATIONS), 0);
+
+	float last[MAX_PROBES] = {0, 0, 0, 0};
+	volatile int changed = 0;
+	start = bench_clock::now();
+	for (int i = 0; i < STAGE_ITERATIONS; i++) {
+		const probe_sweep_t* s = &sweeps[i % BATCH_CAPACITY];
+		bool update = false;
+		for (int p = 0; p < s->count; p++) {
+			if (fabsf(last[p] - s->temp[p]) > DELTA_TEMP) {
+				update = true;
+			}
+			last[p] = s->temp[p];
+		}
+		changed += update;
+	}
+	report_stage("delta check", elapsed_ns(start, STAGE_ITERATIONS), 0);
+
+	SampleQueue queue(SAMPLE_OVERFLOW_DROP_OLDEST);
+	sample_record_t record;
+	start = bench_clock::now();
+	for (int i = 0; i < STAGE_ITERATIONS; i++) {
+		queue.push(&sweeps[i % BATCH_CAPACITY]);
+		queue.pop(&record);
+	}
+	report_stage("sample queue push+pop", elapsed_ns(start, STAGE_ITERATIONS), 0);
+
+	char doc[CONFIG_PUBLISH_DOC_SIZE];
+	const int sizes[] = { 1, CONFIG_BATCH_FLUSH_SAMPLES };
+	for (int k = 0; k < 2; k++) {
+		int n = sizes[k];
+		SampleBatch batch(n, 0);
+		for (int i = 0; i < n; i++) {
+			batch.push(&sweeps[i], 0);
+		}
+		int sent = 0;
+		start = bench_clock::now();
+		for (int i = 0; i < STAGE_ITERATIONS / 10; i++) {
+			sent = batch.format(doc, sizeof(doc), "bench", "AABBCCDDEEFF-1234");
+		}
+		char name[32];
+		snprintf(name, sizeof(name), "JSON, %d of %d sweeps", sent, n);
+		report_stage(name, elapsed_ns(start, STAGE_ITERATIONS / 10), strlen(doc));
+
+		uint8_t frame[CONFIG_PUBLISH_DOC_SIZE];
+		size_t len = 0;
+		start = bench_clock::now();
+		for (int i = 0; i < STAGE_ITERATIONS / 10; i++) {
+			TelemetryEncoder encoder(frame, sizeof(frame));
+			for (int j = 0; j < n && encoder.add(&sweeps[j]); j++) {
+			}
+			len = encoder.length();
+		}
+		snprintf(name, sizeof(name), "binary, %d sweeps", n);
+		report_stage(name, elapsed_ns(start, STAGE_ITERATIONS / 10), len);
+	}
+
+	ShadowWindow window;
+	start = bench_clock::now();
+	for (int i = 0; i < STAGE_ITERATIONS; i++) {
+		window.complete(window.acquire("AABBCCDDEEFF-1234", NULL, NULL), PUBLISH_ACCEPTED);
+	}
+	report_stage("shadow window", elapsed_ns(start, STAGE_ITERATIONS), 0);
+}
+
+typedef struct {
+	std::vector<uint32_t> takenMs;
+} doc_context_t;
+
+static std::vector<uint32_t> latencies;
+static uint32_t acked;
+
+static void publish_done(publish_status_t status, void* context) {
+	doc_context_t* doc = (doc_context_t*) context;
+	if (status == PUBLISH_ACCEPTED) {
+		acked++;
+		for (size_t i = 0; i < doc->takenMs.size(); i++) {
+			latencies.push_back(simMs - doc->takenMs[i]);
+		}
+	}
+	delete doc;
+}
+
+static uint32_t percentile(int pct) {
+	if (latencies.empty()) {
+		return 0;
+	}
+	size_t i = (latencies.size() - 1) * pct / 100;
+	std::nth_element(latencies.begin(), latencies.begin() + i, latencies.end());
+	return latencies[i];
+}
+
+static void bench_end_to_end(uint32_t intervalMs, uint32_t rttMs, int batchSamples, uint32_t durationS) {
+	SWING_PROFILES[0].periodS = 4 * SWING_PROFILES[0].swing / (3 * DELTA_TEMP) * intervalMs / 1000.0;
+	FakeAdc adc(SWING_PROFILES, 2, 0);
+	ProbeSampler sampler(adc, PROBES, CONFIG_PROBE_COUNT);
+	sampler.init();
+	sampler.setOversample(CONFIG_PROBE_OVERSAMPLE_BITS);
+	SampleQueue sampleQueue(SAMPLE_OVERFLOW_DROP_OLDEST);
+	SampleBatch batch(batchSamples, batchSamples > 1 ? CONFIG_BATCH_FLUSH_MS : 0);
+	std::deque<uint32_t> batchTaken;
+	ShadowWindow window;
+	FakeBroker broker(window, rttMs, 0);
+	std::deque<std::pair<std::string, doc_context_t*> > publishQueue;
+	char doc[CONFIG_PUBLISH_DOC_SIZE];
+	float last[MAX_PROBES] = {0, 0, 0, 0};
+	uint32_t changes = 0, docs = 0, dropped = 0;
+	uint64_t bytes = 0;
+
+	for (simMs = 0; simMs < durationS * 1000; simMs += TICK_MS) {
+		if (simMs % intervalMs == 0) {
+			probe_sweep_t sweep;
+			sampler.sweep(&sweep);
+			sampleQueue.push(&sweep);
+		}
+		sample_record_t record;
+		while (sampleQueue.pop(&record)) {
+			probe_sweep_t& sweep = record.sweep;
+			bool update = false;
+			for (int i = 0; i < sweep.count; i++) {
+				if (fabsf(last[i] - sweep.temp[i]) > DELTA_TEMP) {
+					update = true;
+				}
+				last[i] = sweep.temp[i];
+			}
+			if (!update) {
+				continue;
+			}
+			changes++;
+			batch.push(&sweep, simMs);
+			batchTaken.push_back(simMs);
+			if (!batch.due(simMs)) {
+				continue;
+			}
+			char token[32];
+			snprintf(token, sizeof(token), "BENCH-%u", record.seq);
+			int n = batch.format(doc, sizeof(doc), "bench", token);
+			if (n > 0 && publishQueue.size() < CONFIG_PUBLISH_QUEUE_DEPTH) {
+				doc_context_t* context = new doc_context_t;
+				context->takenMs.assign(batchTaken.begin(), batchTaken.begin() + n);
+				publishQueue.push_back(std::make_pair(std::string(doc), context));
+				bytes += strlen(doc);
+				docs++;
+			} else {
+				// main.cpp would log these; here they count as dropped.
+				dropped += n > 0 ? n : batch.size();
+				n = batch.size();
+			}
+			batchTaken.erase(batchTaken.begin(), batchTaken.begin() + n);
+			batch.consume(n, simMs);
+		}
+		broker.step();
+		while (!window.full() && !publishQueue.empty()) {
+			broker.update(publishQueue.front().first.c_str(), publish_done, publishQueue.front().second);
+			publishQueue.pop_front();
+		}
+	}
+
+	const shadow_stats_t* shadow = window.getStats();
+	printf("end to end (%u s simulated, sweep every %u ms, rtt %u ms, %d sweeps per update, window %d):\n",
+		durationS, intervalMs, rttMs, batchSamples, SHADOW_WINDOW);
+	printf("  %u changed sweeps, %u updates queued, %u sweeps dropped, max in flight %u\n",
+		changes, docs, dropped, shadow->maxInflight);
+	printf("  %.1f updates/s, %.1f sweeps/s acked, %.0f bytes per update\n",
+		(double) acked / durationS, (double) latencies.size() / durationS,
+		docs ? (double) bytes / docs : 0);
+	printf("  sample to ack p50 %u ms, p99 %u ms\n", percentile(50), percentile(99));
+}
+
+static void usage(const char* name) {
+	fprintf(stderr, "usage: %s [-i interval_ms] [-r rtt_ms] [-b batch] [-t seconds]\n", name);
+	exit(2);
+}
+
+int main(int argc, char** argv) {
+	uint32_t intervalMs = CONFIG_SAMPLE_INTERVAL_MS;
+	uint32_t rttMs = 150;
+	int batchSamples = 1;
+	uint32_t durationS = 600;
+	int opt;
+	while ((opt = getopt(argc, argv, "i:r:b:t:")) != -1) {
+		switch (opt) {
+		case 'i': intervalMs = atoi(optarg); break;
+		case 'r': rttMs = atoi(optarg); break;
+		case 'b': batchSamples = atoi(optarg); break;
+		case 't': durationS = atoi(optarg); break;
+		default: usage(argv[0]);
+		}
+	}
+	if (intervalMs < 1 || batchSamples < 1 || batchSamples > BATCH_CAPACITY) {
+		usage(argv[0]);
+	}
+	srand(1);
+	bench_stages();
+	bench_end_to_end(intervalMs, rttMs, batchSamples, durationS);
+	return 0;
+}
@@ -0,0 +1,362 @@
+/**
+ * Host simulation of the telemetry pipeline: the firmware's sampling,
+ * queueing, filtering, batching, store-and-forward and shadow window code
+ * run against a fake ADC, a RAM flash partition and a broker stand-in
+ * (host/SimDevices.hpp), on a simulated clock.
+ *
+ *   cd tools
+ *   g++ -std=gnu++11 -O2 -Ihost -I../main -o pipeline_sim pipeline_sim.cpp \
+ *       ../main/ProbeSampler.cpp ../main/BootClock.cpp ../main/SampleQueue.cpp \
+ *       ../main/SampleBatch.cpp ../main/JsonWriter.cpp ../main/ShadowWindow.cpp \
+ *       ../main/SweepLog.cpp -x c ../main/reconnect.c
+ *   ./pipeline_sim [-t seconds] [-b batch] [-r rtt_ms] [-l loss_pct]
+ *       [-o every_s:length_s] [-k lid_every_s] [-n noise] [-s seed] [-v]
+ *
+ * The tasks of main.cpp become steps of one loop: every sample interval
+ * the sampler sweeps into the sample queue and the telemetry step drains
+ * it, and every tick the network step fills the shadow window from the
+ * publish queue the way IotDataMqtt::drain() does.  The broker acks each
+ * update after about rtt_ms, loses loss_pct of them (they time out), and
+ * is unreachable for length_s out of every every_s, during which the
+ * station reconnect policy (reconnect.c) schedules the retries.
+ *
+ * The probes follow slow first order curves, which alone never move a
+ * sweep by DELTA_TEMP from the one before, so the pit lid is also opened
+ * for LID_OPEN_S every lid_every_s, dropping the pit probe by LID_DROP.
+ *
+ * The AWS IoT SDK, IotDataMqtt itself, WiFi and NVS are not built; the
+ * pieces of them that hold policy (ShadowWindow, reconnect) are.  With
+ * -v the firmware's own logs are printed against simulated time.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "esp_log.h"
+#include "ProbeSampler.hpp"
+#include "SampleQueue.hpp"
+#include "SampleBatch.hpp"
+#include "ShadowWindow.hpp"
+#include "SweepLog.hpp"
+#include "SimDevices.hpp"
+extern "C" {
+#include "reconnect.h"
+}
+
+static const char* TAG = "sim";
+
+static const uint32_t TICK_MS = 10;
+static const float DELTA_TEMP = 2;				// as in main.cpp
+static const size_t LOG_SEGMENTS = 16;
+
+static uint32_t simMs;
+int host_log_verbose;
+
+extern "C" uint32_t esp_log_timestamp(void) {
+	return simMs;
+}
+
+/**
+ * What a queued document carries, for the report: when each of its
+ * sweeps was taken, and its size.
+ */
+typedef struct {
+	std::vector<uint32_t> takenMs;
+	size_t bytes;
+	bool fromLog;
+} doc_context_t;
+
+typedef struct {
+	uint32_t docs;
+	uint32_t sweeps;
+	uint64_t bytes;
+	uint32_t accepted;
+	uint32_t lost;
+	uint64_t totalLatencyMs;
+	uint32_t maxLatencyMs;
+	std::vector<uint32_t> latencyMs;	// sample taken to ack, per sweep
+} sim_stats_t;
+
+static sim_stats_t simStats;
+
+// Log sweeps in the document in flight and its outcome, as drain_log().
+static int logInFlight;
+static int logResult;
+
+static void publish_done(publish_status_t status, void* context) {
+	doc_context_t* doc = (doc_context_t*) context;
+	if (status == PUBLISH_ACCEPTED) {
+		simStats.accepted++;
+		for (size_t i = 0; i < doc->takenMs.size(); i++) {
+			uint32_t latency = simMs - doc->takenMs[i];
+			simStats.latencyMs.push_back(latency);
+			simStats.totalLatencyMs += latency;
+			if (latency > simStats.maxLatencyMs) {
+				simStats.maxLatencyMs = latency;
+			}
+		}
+	} else {
+		if (!doc->fromLog) {
+			simStats.lost += doc->takenMs.size();
+		}
+		ESP_LOGW(TAG, "Update of %u sweeps not accepted: %d", (unsigned) doc->takenMs.size(), status);
+	}
+	if (doc->fromLog) {
+		logResult = status == PUBLISH_ACCEPTED ? 1 : -1;
+	}
+	delete doc;
+}
+
+/**
+ * Link availability: down for lengthS out of every everyS.
+ */
+static bool link_available(uint32_t everyS, uint32_t lengthS) {
+	uint32_t s = simMs / 1000;
+	return everyS == 0 || s < everyS || s % everyS >= lengthS;
+}
+
+static int percentile(std::vector<uint32_t>& v, int pct) {
+	if (v.empty()) {
+		return 0;
+	}
+	size_t i = (v.size() - 1) * pct / 100;
+	std::nth_element(v.begin(), v.begin() + i, v.end());
+	return v[i];
+}
+
+static void usage(const char* name) {
+	fprintf(stderr, "usage: %s [-t seconds] [-b batch] [-r rtt_ms] [-l loss_pct] "
+		"[-o every_s:length_s] [-k lid_every_s] [-n noise] [-s seed] [-v]\n", name);
+	exit(2);
+}
+
+int main(int argc, char** argv) {
+	uint32_t durationS = 4 * 3600;
+	int batchSamples = 1;
+	uint32_t rttMs = 150;
+	int lossPct = 0;
+	uint32_t outageEveryS = 0, outageLengthS = 0;
+	uint32_t lidEveryS = 900;
+	int noise = 2;
+	unsigned seed = 1;
+	int opt;
+	while ((opt = getopt(argc, argv, "t:b:r:l:o:k:n:s:v")) != -1) {
+		switch (opt) {
+		case 't': durationS = atoi(optarg); break;
+		case 'b': batchSamples = atoi(optarg); break;
+		case 'r': rttMs = atoi(optarg); break;
+		case 'l': lossPct = atoi(optarg); break;
+		case 'o':
+			if (sscanf(optarg, "%u:%u", &outageEveryS, &outageLengthS) != 2) {
+				usage(argv[0]);
+			}
+			break;
+		case 'k': lidEveryS = atoi(optarg); break;
+		case 'n': noise = atoi(optarg); break;
+		case 's': seed = atoi(optarg); break;
+		case 'v': host_log_verbose = 1; break;
+		default: usage(argv[0]);
+		}
+	}
+	if (batchSamples < 1 || batchSamples > BATCH_CAPACITY) {
+		usage(argv[0]);
+	}
+	srand(seed);
+
+	// Sampler, as set up by sampler_task.
+	FakeAdc adc(COOK_PROFILES, noise, lidEveryS);
+	ProbeSampler sampler(adc, PROBES, CONFIG_PROBE_COUNT);
+	sampler.init();
+	sampler.setOversample(CONFIG_PROBE_OVERSAMPLE_BITS);
+	static MedianFilter<CONFIG_PROBE_MEDIAN_SIZE> medianFilters[MAX_PROBES];
+	static EmaFilter emaFilters[MAX_PROBES] = {
+		EmaFilter(CONFIG_PROBE_EMA_ALPHA / 100.0f), EmaFilter(CONFIG_PROBE_EMA_ALPHA / 100.0f),
+		EmaFilter(CONFIG_PROBE_EMA_ALPHA / 100.0f), EmaFilter(CONFIG_PROBE_EMA_ALPHA / 100.0f),
+	};
+	for (int i = 0; i < CONFIG_PROBE_COUNT; i++) {
+		medianFilters[i].setNext(&emaFilters[i]);
+		sampler.setFilter(i, &medianFilters[i]);
+	}
+	SampleQueue sampleQueue(SAMPLE_OVERFLOW_DROP_OLDEST);
+
+	// Telemetry, as in aws_iot_task with store-and-forward.
+	SampleBatch batch(batchSamples, batchSamples > 1 ? CONFIG_BATCH_FLUSH_MS : 0);
+	SampleBatch backlog(CONFIG_BATCH_FLUSH_SAMPLES, 0);
+	probe_sweep_t backlogSweeps[CONFIG_BATCH_FLUSH_SAMPLES];
+	RamStorage storage(LOG_SEGMENTS * LOG_SEGMENT_SIZE);
+	SweepLog sweepLog(storage);
+	if (sweepLog.mount() != 0) {
+		fprintf(stderr, "sweep log mount failed\n");
+		return 1;
+	}
+	std::deque<uint32_t> batchTaken, logTaken;
+	uint32_t logDropped = 0;
+	char doc[CONFIG_PUBLISH_DOC_SIZE];
+	float lastTemp[MAX_PROBES] = {0, 0, 0, 0};
+
+	// Network, as in IotDataMqtt and bootwifi.
+	ShadowWindow window;
+	FakeBroker broker(window, rttMs, lossPct);
+	std::deque<std::pair<std::string, doc_context_t*> > publishQueue;
+	reconnect_t reconnect;
+	reconnect_init(&reconnect, CONFIG_WIFI_RECONNECT_BASE_MS, CONFIG_WIFI_RECONNECT_MAX_MS,
+		CONFIG_WIFI_RECONNECT_JITTER, CONFIG_WIFI_AP_FALLBACK_FAILURES);
+	reconnect_up(&reconnect, 0);
+	// After an AP fallback the firmware waits for setup; here it just
+	// keeps retrying at the longest interval.
+	bool connected = true;
+	uint32_t retryMs = 0;
+	uint32_t sweeps = 0;
+
+	clock_t cpuStart = clock();
+	for (simMs = 0; simMs < durationS * 1000; simMs += TICK_MS) {
+		// Station link and reconnect policy.
+		bool available = link_available(outageEveryS, outageLengthS);
+		if (connected && !available) {
+			connected = false;
+			broker.disconnect();
+			int32_t delay = reconnect_down(&reconnect, simMs, rand());
+			retryMs = simMs + (delay < 0 ? CONFIG_WIFI_RECONNECT_MAX_MS : delay);
+			ESP_LOGW(TAG, "Link down, retry in %d ms", delay);
+		} else if (!connected && (int32_t)(simMs - retryMs) >= 0) {
+			if (available) {
+				connected = true;
+				reconnect_up(&reconnect, simMs);
+				ESP_LOGI(TAG, "Link up");
+			} else {
+				int32_t delay = reconnect_down(&reconnect, simMs, rand());
+				retryMs = simMs + (delay < 0 ? CONFIG_WIFI_RECONNECT_MAX_MS : delay);
+			}
+		}
+
+		// sampler_task
+		if (simMs % CONFIG_SAMPLE_INTERVAL_MS == 0) {
+			probe_sweep_t sweep;
+			sampler.sweep(&sweep);
+			sampleQueue.push(&sweep);
+			sweeps++;
+		}
+
+		// aws_iot_task
+		sample_record_t record;
+		while (sampleQueue.pop(&record)) {
+			probe_sweep_t& sweep = record.sweep;
+			bool update = false;
+			for (int i = 0; i < sweep.count; i++) {
+				if (fabsf(lastTemp[i] - sweep.temp[i]) > DELTA_TEMP) {
+					update = true;
+				}
+				lastTemp[i] = sweep.temp[i];
+			}
+			if (update) {
+				batch.push(&sweep, simMs);
+				batchTaken.push_back(simMs);
+				while (batchTaken.size() > (size_t) batch.size()) {
+					batchTaken.pop_front();
+				}
+			}
+			if (batch.due(simMs)) {
+				int n = 0;
+				if (connected && publishQueue.size() < CONFIG_PUBLISH_QUEUE_DEPTH) {
+					char token[32];
+					snprintf(token, sizeof(token), "SIM-%u", record.seq);
+					n = batch.format(doc, sizeof(doc), "sim", token);
+				}
+				if (n > 0) {
+					doc_context_t* context = new doc_context_t;
+					context->takenMs.assign(batchTaken.begin(), batchTaken.begin() + n);
+					context->bytes = strlen(doc);
+					context->fromLog = false;
+					publishQueue.push_back(std::make_pair(std::string(doc), context));
+					batchTaken.erase(batchTaken.begin(), batchTaken.begin() + n);
+					batch.consume(n, simMs);
+					simStats.docs++;
+					simStats.sweeps += n;
+					simStats.bytes += context->bytes;
+				} else {
+					for (int i = 0; i < batch.size(); i++) {
+						sweepLog.append(batch.at(i));
+						logTaken.push_back(batchTaken[i]);
+					}
+					while (logTaken.size() > sweepLog.pending()) {
+						logTaken.pop_front();
+					}
+					batch.clear();
+					batchTaken.clear();
+				}
+			}
+			// Logged sweeps stay in the log until their document is acked.
+			if (logInFlight > 0 && logResult != 0) {
+				if (logResult > 0 && sweepLog.getStats()->dropped == logDropped) {
+					sweepLog.consume(logInFlight);
+					logTaken.erase(logTaken.begin(), logTaken.begin() + std::min((size_t) logInFlight, logTaken.size()));
+				}
+				logInFlight = 0;
+				logResult = 0;
+			}
+			if (logInFlight == 0 && sweepLog.pending() > 0 && connected &&
+					publishQueue.size() < CONFIG_PUBLISH_QUEUE_DEPTH) {
+				int n = sweepLog.peek(backlogSweeps, CONFIG_BATCH_FLUSH_SAMPLES);
+				backlog.clear();
+				for (int i = 0; i < n; i++) {
+					backlog.push(&backlogSweeps[i], 0);
+				}
+				char token[32];
+				snprintf(token, sizeof(token), "SIM-%u-log", record.seq);
+				n = n > 0 ? backlog.format(doc, sizeof(doc), "sim", token) : 0;
+				if (n > 0) {
+					doc_context_t* context = new doc_context_t;
+					context->takenMs.assign(logTaken.begin(), logTaken.begin() + n);
+					context->bytes = strlen(doc);
+					context->fromLog = true;
+					publishQueue.push_back(std::make_pair(std::string(doc), context));
+					logInFlight = n;
+					logDropped = sweepLog.getStats()->dropped;
+					simStats.docs++;
+					simStats.sweeps += n;
+					simStats.bytes += context->bytes;
+				}
+			}
+		}
+
+		// IotDataMqtt::drain()
+		broker.step();
+		while (connected && !window.full() && !publishQueue.empty()) {
+			broker.update(publishQueue.front().first.c_str(), publish_done, publishQueue.front().second);
+			publishQueue.pop_front();
+		}
+	}
+	double cpuS = (double) (clock() - cpuStart) / CLOCKS_PER_SEC;
+
+	const sample_queue_stats_t* queue = sampleQueue.getStats();
+	const batch_stats_t* batched = batch.getStats();
+	const sweep_log_stats_t* logged = sweepLog.getStats();
+	const shadow_stats_t* shadow = window.getStats();
+	const reconnect_stats_t* link = &reconnect.stats;
+	printf("simulated %u s in %.2f s CPU (%.0fx), %u sweeps, %u ADC reads\n",
+		durationS, cpuS, cpuS > 0 ? durationS / cpuS : 0, sweeps, adc.reads);
+	printf("sample queue: %u pushed, %u dropped, max depth %u\n",
+		queue->pushed, queue->dropped, queue->maxDepth);
+	printf("telemetry:    %u sweeps in %u documents, %llu bytes (%.0f per document), %u dropped from batch\n",
+		simStats.sweeps, simStats.docs, (unsigned long long) simStats.bytes,
+		simStats.docs ? (double) simStats.bytes / simStats.docs : 0, batched->dropped);
+	printf("sweep log:    %u appended, %u drained, %u dropped, %u pending, %u erases\n",
+		logged->appended, logged->drained, logged->dropped, logged->pending, logged->erases);
+	printf("shadow:       %u sent, %u accepted, %u timeouts, max in flight %u\n",
+		shadow->sent, shadow->accepted, shadow->timeouts, shadow->maxInflight);
+	printf("link:         %u disconnects, %u attempts, %u reconnects, %u AP fallbacks, max outage %u ms\n",
+		link->disconnects, link->attempts, link->reconnects, link->fallbacks, link->maxReconnectMs);
+	printf("latency:      %u sweeps acked, %u lost; sample to ack avg %.0f ms, p50 %d, p99 %d, max %u ms\n",
+		(unsigned) simStats.latencyMs.size(), simStats.lost,
+		simStats.latencyMs.empty() ? 0 : (double) simStats.totalLatencyMs / simStats.latencyMs.size(),
+		percentile(simStats.latencyMs, 50), percentile(simStats.latencyMs, 99), simStats.maxLatencyMs);
+	return 0;
+}
@@ -0,0 +1,298 @@
+/**
+ * Simulates the adaptive sample and publish rates (main/RateController.hpp)
+ * on the host against the fixed threshold they replace.
+ *
+ *   cd tools
+ *   g++ -std=gnu++11 -O2 -Ihost -I../main -o rate_sim rate_sim.cpp ../main/RateController.cpp
+ *   ./rate_sim [-i min_ms] [-I max_ms] [-d min_delta] [-D max_delta] [-f fast_slope]
+ *       [-l near_c] [-s silence_s] [-S settle_s] [-n] [cook.csv]
+ *
+ * cook.csv is as described in host/SimCook.hpp; without one the generated
+ * cook is used (-n without its stalls).  Defaults are the sdkconfig ones,
+ * deltas in degC and fast_slope in degC/min.  The pit has limits of 95
+ * and 125 degC, which the lid openings cross, and the meats upper limits
+ * of 95, 93 and 74.
+ *
+ * Three policies are run over the cook:
+ *
+ *   fixed     sweep every CONFIG_SAMPLE_INTERVAL_MS, publish when a probe
+ *             moved 2 degC since the previous sweep (the firmware before)
+ *   deadband  the same, but 2 degC since the value last published
+ *   adaptive  RateController
+ *
+ * and for each the sweeps taken, messages published and how many of those
+ * on a plateau (see find_steady()), the largest and mean difference
+ * between the true temperature and what was last published, the time any
+ * probe was more than 2 degC out, and how long after a probe crossed a
+ * limit a sweep saw it.  A sudden drop is out by all of it until the next
+ * sweep or publish, so the largest error on the pit is the lid drop for
+ * any policy that lets it settle.  Also reports CPU per update.
+ *
+ * The adaptive policy is then checked against fixed: fewer messages, in
+ * all and on the plateaus, no larger an error, worst or mean, and every
+ * limit crossing seen.  Exits non-zero if any check fails.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "sdkconfig.h"
+#include "RateController.hpp"
+#include "SimCook.hpp"
+
+static const float DELTA_TEMP = 2;
+static const size_t STEADY_S = 600;
+static const float STEADY_C = 3;
+static const float NEAR_C = 5;
+static const float LOWER[MAX_PROBES] = { 95, NAN, NAN, NAN };
+static const float UPPER[MAX_PROBES] = { 125, 95, 93, 74 };
+
+typedef enum {
+	POLICY_FIXED,
+	POLICY_DEADBAND,
+	POLICY_ADAPTIVE,
+	POLICIES
+} policy_t;
+
+static const char* POLICY_NAMES[POLICIES] = { "fixed", "deadband", "adaptive" };
+
+typedef struct {
+	uint32_t sweeps;
+	uint32_t messages;
+	uint32_t heartbeats;
+	uint32_t steadyMessages;	// published while steady
+	float maxError[MAX_PROBES];
+	double sumError[MAX_PROBES];
+	uint32_t secondsOut;	// any probe more than DELTA_TEMP out
+	uint32_t crossings;
+	uint32_t missed;		// back inside before a sweep saw it
+	double sumDelayS;
+	uint32_t maxDelayS;
+	float worstError;		// over the probes
+	double meanError;
+	double ns;
+} policy_result_t;
+
+static bool outside(int probe, float t) {
+	return t < LOWER[probe] || t > UPPER[probe];
+}
+
+/**
+ * Which rows are on a plateau: every probe within STEADY_C of where it
+ * was STEADY_S before, and more than NEAR_C from its limits.  A lid
+ * opened and closed again in between is on the plateau.
+ */
+static void find_steady(const std::vector<cook_row_t>& rows, int probes, std::vector<bool>& steady) {
+	steady.assign(rows.size(), false);
+	for (size_t i = STEADY_S; i < rows.size(); i++) {
+		bool s = true;
+		for (int c = 0; c < probes && s; c++) {
+			float t = rows[i].t[c];
+			s = fabsf(t - rows[i - STEADY_S].t[c]) < STEADY_C && !(fabsf(t - LOWER[c]) < NEAR_C) &&
+				!(fabsf(t - UPPER[c]) < NEAR_C);
+		}
+		steady[i] = s;
+	}
+}
+
+// Prints the check, and returns 1 if it failed.
+static int check(const char* name, bool ok) {
+	printf("  %-50s %s\n", name, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+static void usage(const char* name) {
+	fprintf(stderr, "usage: %s [-i min_ms] [-I max_ms] [-d min_delta] [-D max_delta] [-f fast_slope]\n"
+		"    [-l near_c] [-s silence_s] [-S settle_s] [-n] [cook.csv]\n", name);
+	exit(2);
+}
+
+static void run(policy_t policy, const rate_config_t* config, const std::vector<cook_row_t>& rows,
+		const std::vector<bool>& steady, int probes, policy_result_t* r) {
+	memset(r, 0, sizeof(*r));
+	RateController controller(config);
+	float previous[MAX_PROBES];
+	float published[MAX_PROBES];
+	bool havePublished = false;
+	bool sawOutside[MAX_PROBES];
+	size_t crossedAt[MAX_PROBES];
+	bool pending[MAX_PROBES];
+	for (int c = 0; c < probes; c++) {
+		previous[c] = published[c] = 0;
+		sawOutside[c] = pending[c] = false;
+		crossedAt[c] = 0;
+	}
+	uint64_t nextMs = 0;
+	uint32_t intervalMs = CONFIG_SAMPLE_INTERVAL_MS;
+	std::chrono::steady_clock::duration spent(0);
+
+	for (size_t i = 0; i < rows.size(); i++) {
+		const cook_row_t* row = &rows[i];
+		uint64_t nowMs = (uint64_t) (row->ts - rows[0].ts) * 1000;
+
+		// A limit crossing starts the clock until a sweep sees it.
+		for (int c = 0; c < probes; c++) {
+			bool out = outside(c, row->t[c]);
+			if (out && !sawOutside[c] && !pending[c]) {
+				pending[c] = true;
+				crossedAt[c] = i;
+				r->crossings++;
+			} else if (!out && pending[c]) {
+				pending[c] = false;
+				r->missed++;
+			}
+			if (!out) {
+				sawOutside[c] = false;
+			}
+		}
+
+		if (nowMs >= nextMs) {
+			probe_sweep_t sweep;
+			memset(&sweep, 0, sizeof(sweep));
+			sweep.count = probes;
+			for (int c = 0; c < probes; c++) {
+				sweep.temp[c] = row->t[c];
+			}
+			r->sweeps++;
+			bool publish = false;
+			if (policy == POLICY_ADAPTIVE) {
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				rate_decision_t d = controller.update((uint32_t) nowMs, &sweep, LOWER, UPPER);
+				spent += std::chrono::steady_clock::now() - start;
+				publish = d != RATE_HOLD;
+				r->heartbeats += d == RATE_HEARTBEAT;
+				intervalMs = controller.intervalMs();
+			} else {
+				for (int c = 0; c < probes; c++) {
+					float from = policy == POLICY_FIXED ? previous[c] : published[c];
+					if (!havePublished || fabsf(sweep.temp[c] - from) > DELTA_TEMP) {
+						publish = true;
+					}
+					previous[c] = sweep.temp[c];
+				}
+			}
+			if (publish) {
+				r->messages++;
+				r->steadyMessages += steady[i];
+				havePublished = true;
+				memcpy(published, sweep.temp, sizeof(float) * probes);
+			}
+			for (int c = 0; c < probes; c++) {
+				if (pending[c] && outside(c, sweep.temp[c])) {
+					uint32_t delayS = row->ts - rows[crossedAt[c]].ts;
+					r->sumDelayS += delayS;
+					r->maxDelayS = std::max(r->maxDelayS, delayS);
+					pending[c] = false;
+					sawOutside[c] = true;
+				}
+			}
+			nextMs += intervalMs;
+			if (nextMs < nowMs) {
+				nextMs = nowMs;
+			}
+		}
+
+		bool out = false;
+		for (int c = 0; c < probes && havePublished; c++) {
+			float e = fabsf(row->t[c] - published[c]);
+			r->maxError[c] = std::max(r->maxError[c], e);
+			r->sumError[c] += e;
+			out = out || e > DELTA_TEMP;
+		}
+		r->secondsOut += out;
+	}
+	r->ns = r->sweeps ? std::chrono::duration<double, std::nano>(spent).count() / r->sweeps : 0;
+}
+
+int main(int argc, char** argv) {
+	rate_config_t config = {
+		CONFIG_RATE_MIN_INTERVAL_MS,
+		CONFIG_RATE_MAX_INTERVAL_MS,
+		CONFIG_RATE_MIN_DELTA / 10.0f,
+		CONFIG_RATE_MAX_DELTA / 10.0f,
+		CONFIG_RATE_FAST_SLOPE / 10.0f,
+		CONFIG_RATE_NEAR_LIMIT_C,
+		CONFIG_RATE_MAX_SILENCE_S * 1000,
+		CONFIG_RATE_SETTLE_S * 1000,
+	};
+	bool stalls = true;
+	int opt;
+	while ((opt = getopt(argc, argv, "i:I:d:D:f:l:s:S:n")) != -1) {
+		switch (opt) {
+		case 'i': config.minIntervalMs = atoi(optarg); break;
+		case 'I': config.maxIntervalMs = atoi(optarg); break;
+		case 'd': config.minDeadband = atof(optarg); break;
+		case 'D': config.maxDeadband = atof(optarg); break;
+		case 'f': config.fastSlope = atof(optarg); break;
+		case 'l': config.nearLimit = atof(optarg); break;
+		case 's': config.maxSilenceMs = atoi(optarg) * 1000; break;
+		case 'S': config.settleMs = atoi(optarg) * 1000; break;
+		case 'n': stalls = false; break;
+		default: usage(argv[0]);
+		}
+	}
+	if (config.minIntervalMs < 1 || config.maxIntervalMs < config.minIntervalMs || config.minDeadband <= 0 ||
+			config.maxDeadband < config.minDeadband || config.fastSlope <= 0 || config.nearLimit <= 0 ||
+			optind < argc - 1) {
+		usage(argv[0]);
+	}
+	srand(1);
+	std::vector<cook_row_t> rows;
+	int columns = optind < argc ? read_cook(argv[optind], rows) : synthetic_cook(rows, stalls);
+	if (rows.empty()) {
+		fprintf(stderr, "no sweeps\n");
+		return 1;
+	}
+	int probes = std::min(columns, MAX_PROBES);
+	std::vector<bool> steady;
+	find_steady(rows, probes, steady);
+	uint32_t steadyRows = std::count(steady.begin(), steady.end(), true);
+
+	printf("%u seconds of %d probes over %.1f hours; adaptive %u-%u ms, deadband %.1f-%.1f degC, "
+		"fast %.1f degC/min, near %.0f degC, settle %u s, silence %u s\n",
+		(unsigned) rows.size(), probes, (rows.back().ts - rows[0].ts) / 3600.0, config.minIntervalMs,
+		config.maxIntervalMs, config.minDeadband, config.maxDeadband, config.fastSlope, config.nearLimit,
+		config.settleMs / 1000, config.maxSilenceMs / 1000);
+	printf("steady for %.1f hours (no probe moving %.0f degC in %u s, none within %.0f degC of a limit)\n",
+		steadyRows / 3600.0, STEADY_C, (unsigned) STEADY_S, NEAR_C);
+	printf("  policy      sweeps messages steady  max error (degC) per probe      mean   >2 (s)  limits seen after (s)\n");
+	policy_result_t results[POLICIES];
+	for (int p = 0; p < POLICIES; p++) {
+		policy_result_t* r = &results[p];
+		run((policy_t) p, &config, rows, steady, probes, r);
+		printf("  %-10s %7u %8u %6u ", POLICY_NAMES[p], r->sweeps, r->messages, r->steadyMessages);
+		for (int c = 0; c < MAX_PROBES; c++) {
+			if (c < probes) {
+				printf(" %6.1f", r->maxError[c]);
+				r->worstError = std::max(r->worstError, r->maxError[c]);
+				r->meanError += r->sumError[c] / rows.size() / probes;
+			} else {
+				printf("       ");
+			}
+		}
+		uint32_t seen = r->crossings - r->missed;
+		printf("  %6.2f %7u   %u of %u, avg %.1f max %u\n", r->meanError, r->secondsOut, seen, r->crossings,
+			seen ? r->sumDelayS / seen : 0, r->maxDelayS);
+	}
+	const policy_result_t* a = &results[POLICY_ADAPTIVE];
+	printf("adaptive: %u heartbeats; messages %.0f%% of fixed, %.0f%% of deadband, %u while steady against %u; "
+		"sweeps %.0f%% of fixed\n", a->heartbeats, 100.0 * a->messages / std::max(1u, results[POLICY_FIXED].messages),
+		100.0 * a->messages / std::max(1u, results[POLICY_DEADBAND].messages), a->steadyMessages,
+		results[POLICY_FIXED].steadyMessages, 100.0 * a->sweeps / std::max(1u, results[POLICY_FIXED].sweeps));
+	printf("update: %.0f ns per sweep (host)\n", a->ns);
+
+	const policy_result_t* f = &results[POLICY_FIXED];
+	int failures = 0;
+	failures += check("fewer messages than fixed", a->messages < f->messages);
+	failures += check("fewer messages on the plateaus than fixed", a->steadyMessages < f->steadyMessages);
+	failures += check("no worse an error than fixed, largest or mean",
+		a->worstError <= f->worstError && a->meanError <= f->meanError);
+	failures += check("every limit crossing seen", a->missed == 0);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,241 @@
+/**
+ * Crash and recovery test for the sweep log (main/SweepLog.hpp) on the
+ * host, with the log in a file (host/FileStorage.hpp).
+ *
+ *   cd tools
+ *   g++ -std=gnu++11 -O2 -Ihost -I../main -o sweeplog_crash sweeplog_crash.cpp ../main/SweepLog.cpp
+ *   ./sweeplog_crash [-r runs] [-o ops] [-s segments] [-f file] [-v]
+ *
+ * Each run starts from an erased file and appends and drains sweeps at
+ * random, enough to wrap the ring several times, with the power cut at a
+ * random byte of the flash writes and erases.  The file is then mounted
+ * again and what is pending compared with what should be: every sweep
+ * appended and not yet drained or dropped by a wrap, in order, with its
+ * temperatures, give or take the operation the cut hit (a torn append may
+ * or may not have landed, a torn drain may have marked some of its
+ * sweeps).  The run then carries on from the recovered log and drains it
+ * to the end, which must return exactly the sweeps still expected.  -v
+ * lists every run.  Exits non-zero on any mismatch.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include <deque>
+#include <vector>
+
+#include "SweepLog.hpp"
+#include "FileStorage.hpp"
+
+static const int MAX_DRAIN = 8;
+
+typedef enum {
+	CUT_APPEND,
+	CUT_ROTATE,		// append, erasing the next segment
+	CUT_CONSUME,
+	CUT_NONE,
+	CUTS
+} cut_t;
+
+static const char* CUT_NAMES[CUTS] = { "append", "rotate", "drain", "none" };
+
+// The temperatures logged with a sweep, from its id, to 0.1 degC.
+static float temp_for(uint32_t id, int probe) {
+	return ((id * 37 + probe * 101) % 3000) / 10.0f - 20;
+}
+
+static void make_sweep(uint32_t id, probe_sweep_t* sweep) {
+	memset(sweep, 0, sizeof(*sweep));
+	sweep->timestamp = id;
+	sweep->count = MAX_PROBES;
+	for (int i = 0; i < MAX_PROBES; i++) {
+		sweep->temp[i] = temp_for(id, i);
+	}
+}
+
+// Everything pending in the log, oldest first.
+static bool pending_ids(SweepLog& log, std::vector<uint32_t>& ids) {
+	std::vector<probe_sweep_t> sweeps(log.pending() + 1);
+	int n = log.peek(&sweeps[0], (int) sweeps.size());
+	ids.clear();
+	bool ok = n == (int) log.pending();
+	for (int i = 0; i < n; i++) {
+		ids.push_back((uint32_t) sweeps[i].timestamp);
+		for (int p = 0; p < MAX_PROBES; p++) {
+			ok = ok && sweeps[i].count == MAX_PROBES &&
+				fabsf(sweeps[i].temp[p] - temp_for((uint32_t) sweeps[i].timestamp, p)) < 0.01f;
+		}
+	}
+	return ok;
+}
+
+/**
+ * Random appends and drains, keeping expected up to date.  Returns the
+ * cut the operation in progress took, CUT_NONE if ops ran out first.
+ */
+static cut_t run_ops(SweepLog& log, FileStorage& storage, int ops, uint32_t* nextId,
+		std::deque<uint32_t>& expected, uint32_t* lastId, int* lastN) {
+	for (int i = 0; i < ops; i++) {
+		uint32_t droppedBefore = log.getStats()->dropped;
+		bool append = expected.empty() || rand() % 10 < 7;
+		int n = 1 + rand() % MAX_DRAIN;
+		*lastId = *nextId;
+		*lastN = n;
+		try {
+			if (append) {
+				probe_sweep_t sweep;
+				make_sweep(*nextId, &sweep);
+				if (log.append(&sweep) != 0) {
+					fprintf(stderr, "append failed\n");
+					exit(1);
+				}
+				expected.push_back((*nextId)++);
+			} else {
+				log.consume(n);
+				for (int k = 0; k < n && !expected.empty(); k++) {
+					expected.pop_front();
+				}
+			}
+		} catch (PowerCut&) {
+			for (uint32_t k = droppedBefore; k < log.getStats()->dropped && !expected.empty(); k++) {
+				expected.pop_front();
+			}
+			return !append ? CUT_CONSUME : storage.cutInErase ? CUT_ROTATE : CUT_APPEND;
+		}
+		for (uint32_t k = droppedBefore; k < log.getStats()->dropped && !expected.empty(); k++) {
+			expected.pop_front();
+		}
+	}
+	return CUT_NONE;
+}
+
+/**
+ * Whether what came back matches what was expected, allowing for the
+ * operation the cut hit.
+ */
+static bool recovered_ok(cut_t cut, const std::vector<uint32_t>& got, const std::deque<uint32_t>& expected,
+		uint32_t lastId, int lastN) {
+	std::vector<uint32_t> want(expected.begin(), expected.end());
+	if (got == want) {
+		return true;
+	}
+	if (cut == CUT_APPEND || cut == CUT_ROTATE) {
+		want.push_back(lastId);
+		return got == want;
+	}
+	if (cut == CUT_CONSUME) {
+		for (int k = 1; k <= lastN && k <= (int) want.size(); k++) {
+			if (got == std::vector<uint32_t>(want.begin() + k, want.end())) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+static void usage(const char* name) {
+	fprintf(stderr, "usage: %s [-r runs] [-o ops] [-s segments] [-f file] [-v]\n", name);
+	exit(2);
+}
+
+int main(int argc, char** argv) {
+	int runs = 500;
+	int ops = 3000;
+	int segments = 4;
+	const char* path = "/tmp/sweeplog_crash.bin";
+	bool verbose = false;
+	int opt;
+	while ((opt = getopt(argc, argv, "r:o:s:f:v")) != -1) {
+		switch (opt) {
+		case 'r': runs = atoi(optarg); break;
+		case 'o': ops = atoi(optarg); break;
+		case 's': segments = atoi(optarg); break;
+		case 'f': path = optarg; break;
+		case 'v': verbose = true; break;
+		default: usage(argv[0]);
+		}
+	}
+	if (runs < 1 || ops < 1 || segments < 2 || optind != argc) {
+		usage(argv[0]);
+	}
+	size_t size = (size_t) segments * LOG_SEGMENT_SIZE;
+
+	// How much one run writes, to spread the cuts over.
+	uint64_t total;
+	{
+		remove(path);
+		FileStorage storage(path, size);
+		SweepLog log(storage);
+		log.mount();
+		srand(1);
+		std::deque<uint32_t> expected;
+		uint32_t nextId = 1, lastId;
+		int lastN;
+		run_ops(log, storage, ops, &nextId, expected, &lastId, &lastN);
+		total = storage.written;
+	}
+
+	int cuts[CUTS] = { 0, 0, 0, 0 };
+	int failed[CUTS] = { 0, 0, 0, 0 };
+	for (int r = 0; r < runs; r++) {
+		remove(path);
+		srand(1000 + r);
+		uint64_t budget = ((uint64_t) rand() * RAND_MAX + rand()) % total;
+		std::deque<uint32_t> expected;
+		uint32_t nextId = 1, lastId = 0;
+		int lastN = 0;
+		cut_t cut;
+		{
+			FileStorage storage(path, size);
+			SweepLog log(storage);
+			log.mount();
+			storage.arm(budget);
+			cut = run_ops(log, storage, ops, &nextId, expected, &lastId, &lastN);
+		}
+		cuts[cut]++;
+
+		// Power back on.
+		FileStorage storage(path, size);
+		SweepLog log(storage);
+		std::vector<uint32_t> got;
+		bool ok = log.mount() == 0 && pending_ids(log, got);
+		ok = ok && recovered_ok(cut, got, expected, lastId, lastN);
+		size_t recovered = got.size();
+
+		// Carry on, then drain it all.
+		expected.assign(got.begin(), got.end());
+		if (ok) {
+			nextId = std::max(nextId, lastId + 1);
+			run_ops(log, storage, ops / 4, &nextId, expected, &lastId, &lastN);
+			std::vector<uint32_t> drained;
+			probe_sweep_t sweeps[MAX_DRAIN];
+			int n;
+			while ((n = log.peek(sweeps, MAX_DRAIN)) > 0) {
+				for (int i = 0; i < n; i++) {
+					drained.push_back((uint32_t) sweeps[i].timestamp);
+				}
+				log.consume(n);
+			}
+			ok = drained == std::vector<uint32_t>(expected.begin(), expected.end()) && log.pending() == 0;
+		}
+		if (!ok) {
+			failed[cut]++;
+		}
+		if (verbose || !ok) {
+			printf("  run %4d: cut in %-6s after %8llu of %llu bytes, %4u recovered%s\n", r, CUT_NAMES[cut],
+				(unsigned long long) budget, (unsigned long long) total, (unsigned) recovered, ok ? "" : "  MISMATCH");
+		}
+	}
+	remove(path);
+
+	int bad = 0;
+	printf("%d runs of %d operations on %d segments (%u records each), %llu bytes written per run\n", runs, ops,
+		segments, (unsigned) ((LOG_SEGMENT_SIZE - 16) / 20), (unsigned long long) total);
+	for (int c = 0; c < CUTS; c++) {
+		printf("  cut in %-6s %5d runs, %d mismatched\n", CUT_NAMES[c], cuts[c], failed[c]);
+		bad += failed[c];
+	}
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,182 @@
+/**
+ * Accuracy and speed of the compile-time thermistor tables
+ * (main/ThermistorTable.hpp) against the Beta equation they replace, on
+ * the host.
+ *
+ *   cd tools
+ *   g++ -std=gnu++11 -O2 -I../main -o thermistor_check thermistor_check.cpp
+ *   ./thermistor_check [-f frac_bits]
+ *
+ * For every ADC code the table entries are compared with the runtime
+ * equation, B / ln(R / Ri) - 273.15, in double: the full float table, the
+ * 0.1 degC fixed point table, and a 256 entry float table interpolated at
+ * every code and at every 1/2^frac_bits of a code (oversampled reads,
+ * default 4), over the codes it covers; beyond them it clamps to its end
+ * entries.  The largest error is reported per temperature band, since
+ * the coarse tables are worst where the curve bends hardest, at the hot
+ * end.  Also reports host CPU per conversion for each.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+
+#include <chrono>
+
+#include "ThermistorTable.hpp"
+
+// Same probe as main.cpp.
+struct ProbeThermistor {
+	static constexpr double Ro = 90000;
+	static constexpr double Rt = 14000;
+	static constexpr double B = 3850;
+	static constexpr double To = 298.15;
+	static constexpr double ADC_STEP = 3.3/4096;
+};
+
+typedef ThermistorTable<ProbeThermistor> FloatTable;
+typedef ThermistorTable<ProbeThermistor, ThermistorFixed> FixedTable;
+typedef ThermistorTable<ProbeThermistor, float, 8> SmallTable;
+
+static const int CODES = 1 << thermistor::ADC_BITS;
+static const int ITERATIONS = 200;
+
+typedef struct {
+	const char* name;
+	double below;	// degC
+} band_t;
+
+static const band_t BANDS[] = {
+	{ "below 0", 0 },
+	{ "0-150", 150 },
+	{ "150-250", 250 },
+	{ "250-350", 350 },
+	{ "above 350", INFINITY },
+};
+static const int NUM_BANDS = sizeof(BANDS) / sizeof(BANDS[0]);
+
+// What getTemperature() computed before the tables.
+static double beta(double code) {
+	const double Ri = ProbeThermistor::Ro * exp(-ProbeThermistor::B / ProbeThermistor::To);
+	double v = code * ProbeThermistor::ADC_STEP;
+	double r = (ProbeThermistor::Rt * v) / (3.3 - v);
+	return ProbeThermistor::B / log(r / Ri) - thermistor::KELVIN;
+}
+
+static int band(double t) {
+	int b = 0;
+	while (t >= BANDS[b].below) {
+		b++;
+	}
+	return b;
+}
+
+typedef struct {
+	double maxError[NUM_BANDS];
+	double worstAt[NUM_BANDS];
+} errors_t;
+
+static void note(errors_t* e, double reference, double t) {
+	int b = band(reference);
+	double d = fabs(t - reference);
+	if (d > e->maxError[b]) {
+		e->maxError[b] = d;
+		e->worstAt[b] = reference;
+	}
+}
+
+static void print(const char* name, const errors_t* e) {
+	printf("  %-24s", name);
+	for (int b = 0; b < NUM_BANDS; b++) {
+		printf(" %9.3f", e->maxError[b]);
+	}
+	printf("\n");
+}
+
+typedef std::chrono::steady_clock check_clock;
+
+template<typename F>
+static double time_ns(F convert) {
+	volatile float sink = 0;
+	check_clock::time_point start = check_clock::now();
+	for (int i = 0; i < ITERATIONS; i++) {
+		for (int code = 1; code < CODES - 1; code++) {
+			sink = sink + convert(code);
+		}
+	}
+	return std::chrono::duration<double, std::nano>(check_clock::now() - start).count() /
+		((double) ITERATIONS * (CODES - 2));
+}
+
+static float runtime(uint32_t code) { return (float) beta(code); }
+static float floatLookup(uint32_t code) { return FloatTable::lookup(code); }
+static float fixedLookup(uint32_t code) { return FixedTable::toFloat(FixedTable::lookup(code)); }
+static float smallInterpolate(uint32_t code) { return SmallTable::interpolate(code); }
+
+static void usage(const char* name) {
+	fprintf(stderr, "usage: %s [-f frac_bits]\n", name);
+	exit(2);
+}
+
+int main(int argc, char** argv) {
+	int fracBits = 4;
+	int opt;
+	while ((opt = getopt(argc, argv, "f:")) != -1) {
+		switch (opt) {
+		case 'f': fracBits = atoi(optarg); break;
+		default: usage(argv[0]);
+		}
+	}
+	if (fracBits < 0 || fracBits > 8 || optind != argc) {
+		usage(argv[0]);
+	}
+
+	errors_t full = {}, fixed = {}, small = {}, oversampled = {};
+	// Code 0 is R = 0 and the top code is past the divider's range.
+	for (int code = 1; code < CODES - 1; code++) {
+		double reference = beta(code);
+		note(&full, reference, FloatTable::lookup(code));
+		note(&fixed, reference, FixedTable::toFloat(FixedTable::lookup(code)));
+		// Outside the 256 entry table interpolate() clamps, see below.
+		if (code < (int) SmallTable::FIRST_CODE || code > (int) SmallTable::LAST_CODE) {
+			continue;
+		}
+		note(&small, reference, SmallTable::interpolate(code));
+		for (int f = 0; f < (1 << fracBits) && code + f / (double) (1 << fracBits) <= SmallTable::LAST_CODE; f++) {
+			double c = code + f / (double) (1 << fracBits);
+			note(&oversampled, beta(c), SmallTable::interpolate(((uint32_t) code << fracBits) + f, fracBits));
+		}
+	}
+
+	printf("codes 1-%d, %.1f to %.1f degC; largest error (degC) by band:\n", CODES - 2, beta(1), beta(CODES - 2));
+	printf("  %-24s", "table");
+	for (int b = 0; b < NUM_BANDS; b++) {
+		printf(" %9s", BANDS[b].name);
+	}
+	printf("\n");
+	print("float, 4096", &full);
+	print("fixed 0.1, 4096", &fixed);
+	print("float, 256 interpolated", &small);
+	char name[32];
+	snprintf(name, sizeof(name), "  and at 1/%d codes", 1 << fracBits);
+	print(name, &oversampled);
+	printf("256 entries: cover %.1f to %.1f degC (codes %u-%u) and clamp beyond; worst %.3f degC at %.1f degC below 350\n",
+		beta(SmallTable::FIRST_CODE), beta(SmallTable::LAST_CODE), SmallTable::FIRST_CODE, SmallTable::LAST_CODE,
+		small.maxError[3], small.worstAt[3]);
+	// Widest run of codes around the middle of the scale within 1 degC.
+	int hot = CODES / 2, cold = CODES / 2;
+	while (hot > (int) SmallTable::FIRST_CODE && fabs(SmallTable::interpolate(hot - 1) - beta(hot - 1)) <= 1) {
+		hot--;
+	}
+	while (cold < (int) SmallTable::LAST_CODE && fabs(SmallTable::interpolate(cold + 1) - beta(cold + 1)) <= 1) {
+		cold++;
+	}
+	printf("256 entries: within 1 degC from %.1f down to %.1f degC\n", beta(hot), beta(cold));
+
+	printf("conversion (host CPU):\n");
+	printf("  %-24s %6.1f ns\n", "Beta equation", time_ns(runtime));
+	printf("  %-24s %6.1f ns\n", "float lookup", time_ns(floatLookup));
+	printf("  %-24s %6.1f ns\n", "fixed lookup", time_ns(fixedLookup));
+	printf("  %-24s %6.1f ns\n", "256 interpolated", time_ns(smallInterpolate));
+	return 0;
+}
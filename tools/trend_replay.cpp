@@ -0,0 +1,162 @@
+/**
+ * Replays cooks through the trend detector (main/ProbeTrend.hpp) on the
+ * host and lists the events it raised.
+ *
+ *   cd tools
+ *   g++ -std=gnu++11 -O2 -Ihost -I../main -o trend_replay trend_replay.cpp ../main/ProbeTrend.cpp
+ *   ./trend_replay [-w window_s] [-d drop_c] [-s stall_slope] [-n] [-v] [cook.csv]
+ *
+ * cook.csv is as described in host/SimCook.hpp; without one the generated
+ * cook is used (-n without its stalls).  For the generated cook the events
+ * are also checked against what happened: lid openings found on the pit
+ * probe, and when the brisket and pork shoulder stalls were reported
+ * against when they entered and left the stall.  -v lists every event.
+ * Also reports CPU per update.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <vector>
+
+#include "ProbeTrend.hpp"
+#include "SimCook.hpp"
+
+static const char* EVENT_NAMES[] = { "none", "stall", "stall end", "drop", "drop end" };
+
+typedef struct {
+	uint32_t ts;
+	int probe;
+	trend_event_t event;
+	float t;
+	float slope;
+} logged_event_t;
+
+static void usage(const char* name) {
+	fprintf(stderr, "usage: %s [-w window_s] [-d drop_c] [-s stall_slope] [-n] [-v] [cook.csv]\n", name);
+	exit(2);
+}
+
+// First sweep at or after from where probe is above t, or rows.size().
+static size_t first_above(const std::vector<cook_row_t>& rows, int probe, float t, size_t from) {
+	while (from < rows.size() && rows[from].t[probe] <= t) {
+		from++;
+	}
+	return from;
+}
+
+int main(int argc, char** argv) {
+	uint32_t windowS = 600;
+	float dropC = 10;
+	float stallSlope = 0.08f;
+	bool stalls = true;
+	bool verbose = false;
+	int opt;
+	while ((opt = getopt(argc, argv, "w:d:s:nv")) != -1) {
+		switch (opt) {
+		case 'w': windowS = atoi(optarg); break;
+		case 'd': dropC = atof(optarg); break;
+		case 's': stallSlope = atof(optarg); break;
+		case 'n': stalls = false; break;
+		case 'v': verbose = true; break;
+		default: usage(argv[0]);
+		}
+	}
+	if (windowS < 2 * TREND_BUCKET_S || dropC <= 0 || stallSlope <= 0 || optind < argc - 1) {
+		usage(argv[0]);
+	}
+	srand(1);
+	std::vector<cook_row_t> rows;
+	bool generated = optind == argc;
+	int columns = generated ? synthetic_cook(rows, stalls) : read_cook(argv[optind], rows);
+	if (rows.empty()) {
+		fprintf(stderr, "no sweeps\n");
+		return 1;
+	}
+
+	std::vector<ProbeTrend> trends(columns, ProbeTrend(windowS, dropC, stallSlope));
+	std::vector<logged_event_t> events;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < rows.size(); i++) {
+		for (int c = 0; c < columns; c++) {
+			trend_event_t e = trends[c].update(rows[i].ts, rows[i].t[c]);
+			if (e != TREND_NONE) {
+				logged_event_t l = { rows[i].ts, c, e, rows[i].t[c], trends[c].slope() };
+				events.push_back(l);
+			}
+		}
+	}
+	double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() /
+		(rows.size() * columns);
+
+	printf("%u sweeps of %d probes over %.1f hours, window %u s, drop %.1f degC, stall below %.2f degC/min\n",
+		(unsigned) rows.size(), columns, (rows.back().ts - rows[0].ts) / 3600.0, windowS, dropC, stallSlope);
+	for (int c = 0; c < columns; c++) {
+		int counts[5] = { 0, 0, 0, 0, 0 };
+		for (size_t k = 0; k < events.size(); k++) {
+			if (events[k].probe == c) {
+				counts[events[k].event]++;
+			}
+		}
+		printf("  t%d: %d stalls, %d drops, slope now %.2f degC/min\n", c + 1, counts[TREND_STALL], counts[TREND_DROP],
+			trends[c].slope());
+	}
+	if (verbose) {
+		for (size_t k = 0; k < events.size(); k++) {
+			const logged_event_t* l = &events[k];
+			printf("  %6.2fh t%d %-9s at %6.1f, slope %6.2f\n", (l->ts - rows[0].ts) / 3600.0, l->probe + 1,
+				EVENT_NAMES[l->event], l->t, l->slope);
+		}
+	}
+
+	if (generated) {
+		// Lid openings on the pit probe.
+		int opens = 0, found = 0, spurious = 0;
+		for (uint32_t s = COOK_LID_EVERY_S; s < COOK_HOURS * 3600; s += COOK_LID_EVERY_S) {
+			opens++;
+		}
+		for (size_t k = 0; k < events.size(); k++) {
+			const logged_event_t* l = &events[k];
+			if (l->event != TREND_DROP) {
+				continue;
+			}
+			uint32_t s = l->ts - COOK_START_TS;
+			if (l->probe == 0 && s >= COOK_LID_EVERY_S && s % COOK_LID_EVERY_S < COOK_LID_OPEN_S) {
+				found++;
+			} else {
+				spurious++;
+			}
+		}
+		printf("lid: %d of %d openings found, %d spurious drops\n", found, opens, spurious);
+
+		// Stalls on the brisket and pork shoulder, when they had them.
+		for (int c = 1; c <= 2 && stalls; c++) {
+			size_t in = first_above(rows, c, COOK_STALL_FROM, 0);
+			size_t out = first_above(rows, c, COOK_STALL_TO, in);
+			printf("t%d stall %.2fh to %.2fh:", c + 1, (rows[in].ts - COOK_START_TS) / 3600.0,
+				(rows[out].ts - COOK_START_TS) / 3600.0);
+			bool any = false;
+			for (size_t k = 0; k < events.size(); k++) {
+				const logged_event_t* l = &events[k];
+				if (l->probe == c && (l->event == TREND_STALL || l->event == TREND_STALL_END)) {
+					printf(" %s %+.0f min", EVENT_NAMES[l->event],
+						((double) l->ts - rows[l->event == TREND_STALL ? in : out].ts) / 60.0);
+					any = true;
+				}
+			}
+			printf("%s\n", any ? "" : " not reported");
+		}
+		int others = 0;
+		for (size_t k = 0; k < events.size(); k++) {
+			if (events[k].event == TREND_STALL && (events[k].probe == 0 || events[k].probe == 3 || !stalls)) {
+				others++;
+			}
+		}
+		printf("stalls reported on probes without one: %d\n", others);
+	}
+	printf("update: %.0f ns per probe (host)\n", ns);
+	return 0;
+}
@@ -0,0 +1,307 @@
+/**
+ * Drives the station reconnect policy (main/reconnect.h) with a fake WiFi
+ * event source on the host, handling the events the way bootwifi.c's
+ * esp32_wifi_eventHandler does, through scripted link outages.
+ *
+ *   cd tools
+ *   g++ -std=gnu++11 -O2 -Ihost -I../main -o wifi_events wifi_events.cpp -x c ../main/reconnect.c
+ *   ./wifi_events [-n probes] [-v]
+ *
+ * A connect attempt made while the access point is up gets an address
+ * CONNECT_MS later; one made while it is down, or at a cached BSSID that
+ * has moved, ends in STA_DISCONNECTED after FAIL_MS.  An established link
+ * that goes away is noticed after BEACON_MS.  As in bootwifi.c a failed
+ * cached connect is retried at once with a scan, every other disconnect
+ * goes through reconnect_down() and its timer, and a -1 from it makes
+ * the station an access point for good.  Times come from host/sdkconfig.h
+ * (base, cap, jitter, failures before the fallback).
+ *
+ * Scenarios: the access point rebooting, a router restart, an outage long
+ * enough for the AP fallback, a flapping link, a cached access point that
+ * moved, and n probes (default 20) riding out the same router restart,
+ * with and without jitter, counting the most retries in any BUCKET_MS.
+ * Each reports the counters and how long the station sat waiting after
+ * the access point was back, and is checked against what the policy
+ * promises; -v lists every event.  Exits non-zero on any failure.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <map>
+#include <vector>
+
+#include "sdkconfig.h"
+
+extern "C" {
+#include "reconnect.h"
+}
+
+static const uint32_t CONNECT_MS = 800;
+static const uint32_t FAIL_MS = 3000;
+static const uint32_t BEACON_MS = 1000;
+static const uint32_t END_MS = 3600 * 1000;
+static const uint32_t BUCKET_MS = 250;
+
+static bool verbose;
+static int checks, failures;
+
+static void check(const char* name, bool ok) {
+	checks++;
+	if (!ok) {
+		failures++;
+	}
+	printf("    %-54s %s\n", name, ok ? "ok" : "FAILED");
+}
+
+typedef struct {
+	uint32_t fromMs;
+	uint32_t toMs;
+} outage_t;
+
+typedef enum {
+	EV_CONNECT,			// esp_wifi_connect(), from boot or the reconnect timer
+	EV_GOT_IP,
+	EV_DISCONNECTED,
+	EV_BEACON_LOST		// the access point went while associated
+} event_t;
+
+static const char* EVENT_NAMES[] = { "connect", "got ip", "disconnected", "beacon lost" };
+
+/**
+ * One station and its link, with bootwifi.c's handling of the events.
+ */
+class Station {
+	const std::vector<outage_t>& outages;
+	std::multimap<uint32_t, event_t> events;
+	bool associated;
+	bool usingCache;
+	bool cacheMoved;
+	int jitter;
+
+	bool linkUp(uint32_t ms) {
+		for (size_t i = 0; i < outages.size(); i++) {
+			if (ms >= outages[i].fromMs && ms < outages[i].toMs) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// When the current outage ends, or ms if the link is up.
+	uint32_t linkBack(uint32_t ms) {
+		for (size_t i = 0; i < outages.size(); i++) {
+			if (ms >= outages[i].fromMs && ms < outages[i].toMs) {
+				return outages[i].toMs;
+			}
+		}
+		return ms;
+	}
+
+	void handle(uint32_t ms, event_t ev) {
+		if (verbose) {
+			printf("      %8.1f s  %-12s\n", ms / 1000.0, EVENT_NAMES[ev]);
+		}
+		switch (ev) {
+		case EV_CONNECT:
+			attemptsMs.push_back(ms);
+			if (linkUp(ms) && !(usingCache && cacheMoved)) {
+				events.insert(std::make_pair(ms + CONNECT_MS, EV_GOT_IP));
+			} else {
+				events.insert(std::make_pair(ms + FAIL_MS, EV_DISCONNECTED));
+			}
+			break;
+		case EV_GOT_IP:
+			if (!linkUp(ms)) {
+				events.insert(std::make_pair(ms, EV_DISCONNECTED));
+				break;
+			}
+			associated = true;
+			usingCache = false;
+			reconnect_up(&r, ms);
+			waitedMs = std::max(waitedMs, ms - CONNECT_MS - lastBackMs);
+			// The next time the link goes, BEACON_MS after it does.
+			for (size_t i = 0; i < outages.size(); i++) {
+				if (outages[i].fromMs > ms) {
+					events.insert(std::make_pair(outages[i].fromMs + BEACON_MS, EV_BEACON_LOST));
+					break;
+				}
+			}
+			break;
+		case EV_BEACON_LOST:
+			if (!associated) {
+				break;
+			}
+			// The driver reports STA_DISCONNECTED.
+			associated = false;
+			// fall through
+		case EV_DISCONNECTED: {
+			lastBackMs = linkBack(ms);
+			if (usingCache) {
+				// bootwifi.c: forget the cache and scan at once.
+				usingCache = false;
+				rescans++;
+				events.insert(std::make_pair(ms, EV_CONNECT));
+				break;
+			}
+			int32_t delay = reconnect_down(&r, ms, (uint32_t) rand());
+			if (delay < 0) {
+				apSinceMs = ms;
+				events.clear();
+				break;
+			}
+			delaysMs.push_back(delay);
+			events.insert(std::make_pair(ms + delay, EV_CONNECT));
+			break;
+		}
+		}
+	}
+
+	public:
+	reconnect_t r;
+	std::vector<uint32_t> attemptsMs;	// every connect, including the first
+	std::vector<int32_t> delaysMs;		// every backoff delay handed out
+	uint32_t apSinceMs;				// became an access point, 0 if not
+	uint32_t waitedMs;				// longest from the AP back to connecting
+	uint32_t lastBackMs;
+	int rescans;
+
+	Station(const std::vector<outage_t>& outages, bool cached, bool moved, int jitterPct) :
+			outages(outages), associated(false), usingCache(cached), cacheMoved(moved), jitter(jitterPct),
+			apSinceMs(0), waitedMs(0), lastBackMs(0), rescans(0) {
+		reconnect_init(&r, CONFIG_WIFI_RECONNECT_BASE_MS, CONFIG_WIFI_RECONNECT_MAX_MS, jitter,
+			CONFIG_WIFI_AP_FALLBACK_FAILURES);
+	}
+
+	void run(uint32_t bootMs) {
+		events.insert(std::make_pair(bootMs, EV_CONNECT));
+		while (!events.empty() && events.begin()->first < END_MS) {
+			std::pair<uint32_t, event_t> ev = *events.begin();
+			events.erase(events.begin());
+			handle(ev.first, ev.second);
+		}
+	}
+};
+
+static void report(const char* name, Station& s) {
+	const reconnect_stats_t* st = &s.r.stats;
+	printf("  %s\n", name);
+	printf("    %u disconnects, %u attempts, %u reconnects, %u fallbacks", st->disconnects, st->attempts,
+		st->reconnects, st->fallbacks);
+	if (s.apSinceMs) {
+		printf(" (access point at %.1f s)", s.apSinceMs / 1000.0);
+	}
+	printf("\n    outage to IP max %.1f s; longest wait after the AP was back %.1f s\n",
+		st->maxReconnectMs / 1000.0, s.waitedMs / 1000.0);
+}
+
+// The longest any delay can be after k failures, with jitter.
+static uint32_t max_delay(int k, int jitterPct) {
+	uint64_t d = CONFIG_WIFI_RECONNECT_BASE_MS;
+	for (int i = 0; i < k && d < CONFIG_WIFI_RECONNECT_MAX_MS; i++) {
+		d *= 2;
+	}
+	d = std::min(d, (uint64_t) CONFIG_WIFI_RECONNECT_MAX_MS);
+	return (uint32_t) (d + d * jitterPct / 100);
+}
+
+static void usage(const char* name) {
+	fprintf(stderr, "usage: %s [-n probes] [-v]\n", name);
+	exit(2);
+}
+
+int main(int argc, char** argv) {
+	int probes = 20;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:v")) != -1) {
+		switch (opt) {
+		case 'n': probes = atoi(optarg); break;
+		case 'v': verbose = true; break;
+		default: usage(argv[0]);
+		}
+	}
+	if (probes < 2 || optind != argc) {
+		usage(argv[0]);
+	}
+	srand(1);
+	printf("backoff %d ms doubling to %d ms, +/-%d%%, access point after %d failures\n",
+		CONFIG_WIFI_RECONNECT_BASE_MS, CONFIG_WIFI_RECONNECT_MAX_MS, CONFIG_WIFI_RECONNECT_JITTER,
+		CONFIG_WIFI_AP_FALLBACK_FAILURES);
+
+	{
+		std::vector<outage_t> outages = { { 60000, 65000 } };
+		Station s(outages, false, false, CONFIG_WIFI_RECONNECT_JITTER);
+		s.run(0);
+		report("access point reboots for 5 s", s);
+		check("reconnects without falling back", s.r.stats.reconnects == 1 && s.apSinceMs == 0);
+		check("back within a backoff step of the AP",
+			s.waitedMs <= max_delay(s.delaysMs.size(), CONFIG_WIFI_RECONNECT_JITTER) + FAIL_MS);
+	}
+	{
+		std::vector<outage_t> outages = { { 60000, 150000 } };
+		Station s(outages, false, false, CONFIG_WIFI_RECONNECT_JITTER);
+		s.run(0);
+		report("router restarts, 90 s", s);
+		bool bounded = true;
+		for (size_t k = 0; k < s.delaysMs.size(); k++) {
+			bounded = bounded && (uint32_t) s.delaysMs[k] <= max_delay(k, CONFIG_WIFI_RECONNECT_JITTER);
+		}
+		check("every delay within base * 2^failures, capped, +jitter", bounded);
+		check("reconnects without falling back", s.r.stats.reconnects == 1 && s.apSinceMs == 0);
+	}
+	{
+		std::vector<outage_t> outages = { { 60000, 1800000 } };
+		Station s(outages, false, false, CONFIG_WIFI_RECONNECT_JITTER);
+		s.run(0);
+		report("access point gone for 29 min", s);
+		check("falls back to an access point once", s.r.stats.fallbacks == 1 && s.apSinceMs > 0);
+		check("after the configured failures, then stops trying",
+			s.r.stats.attempts == (uint32_t) CONFIG_WIFI_AP_FALLBACK_FAILURES &&
+			s.attemptsMs.back() < s.apSinceMs);
+	}
+	{
+		std::vector<outage_t> outages;
+		for (uint32_t t = 30000; t < END_MS - 60000; t += 23000) {
+			outages.push_back(outage_t { t, t + 3000 });
+		}
+		Station s(outages, false, false, CONFIG_WIFI_RECONNECT_JITTER);
+		s.run(0);
+		report("link flaps, 3 s down in every 23 s", s);
+		check("each outage starts the backoff again, no fallback",
+			s.apSinceMs == 0 && s.r.stats.reconnects == s.r.stats.disconnects);
+	}
+	{
+		std::vector<outage_t> outages;
+		Station s(outages, true, true, CONFIG_WIFI_RECONNECT_JITTER);
+		s.run(0);
+		report("cached access point has moved", s);
+		check("one scan straight after, no backoff spent", s.rescans == 1 && s.r.stats.attempts == 0 &&
+			s.attemptsMs.size() == 2 && s.attemptsMs[1] == FAIL_MS);
+	}
+
+	// A room of probes through the same restart, booted at random.
+	int peak[2];
+	for (int j = 0; j < 2; j++) {
+		int jitter = j ? CONFIG_WIFI_RECONNECT_JITTER : 0;
+		std::vector<outage_t> outages = { { 60000, 150000 } };
+		std::map<uint32_t, int> perBucket;
+		for (int p = 0; p < probes; p++) {
+			Station s(outages, false, false, jitter);
+			s.run(rand() % 1000);
+			for (size_t i = 1; i < s.attemptsMs.size(); i++) {
+				perBucket[s.attemptsMs[i] / BUCKET_MS]++;
+			}
+		}
+		peak[j] = 0;
+		for (std::map<uint32_t, int>::iterator it = perBucket.begin(); it != perBucket.end(); ++it) {
+			peak[j] = std::max(peak[j], it->second);
+		}
+	}
+	printf("  %d probes through a 90 s router restart\n", probes);
+	printf("    most connects in %u ms: %d without jitter, %d with +/-%d%%\n", BUCKET_MS, peak[0], peak[1],
+		CONFIG_WIFI_RECONNECT_JITTER);
+	check("jitter spreads the retries out", peak[1] < peak[0]);
+
+	printf("%d checks, %d failed\n", checks, failures);
+	return failures ? 1 : 0;
+}